@@ -0,0 +1,219 @@
+/*
+ * FOS benchdev: helpers shared by fosbench and fusebench
+ * Copyright (C) 2025 Mathieu Schroeter <mathieu@schroetersa.ch>
+ *
+ * This file is part of Fosfat.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "benchdev.h"
+
+
+/*
+ * Backend on the image, all reads are counted.
+ */
+
+static int
+device_read (void *data, uint64_t offset, void *buf, size_t size)
+{
+  device_t *dev = data;
+  uint8_t *it = buf;
+
+  __atomic_fetch_add (&dev->reads, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add (&dev->bytes, size, __ATOMIC_RELAXED);
+
+  if (dev->buf)
+  {
+    if (offset > dev->size || size > dev->size - offset)
+      return 0;
+    memcpy (buf, dev->buf + offset, size);
+    return 1;
+  }
+
+  while (size)
+  {
+    ssize_t res = pread (dev->fd, it, size, (off_t) offset);
+    if (res < 0 && errno == EINTR)
+      continue;
+    if (res <= 0)
+      return 0;
+
+    it     += res;
+    offset += res;
+    size   -= res;
+  }
+
+  return 1;
+}
+
+static uint64_t
+device_size (void *data)
+{
+  device_t *dev = data;
+  return dev->size;
+}
+
+const fosfat_backend_t backend_device = {
+  .read  = device_read,
+  .size  = device_size,
+  .close = NULL,
+};
+
+/*
+ * Open an image for backend_device.
+ *
+ * dev          device to initialize
+ * file         path of the image
+ * memory       true to load the whole image in memory
+ * return a boolean
+ */
+int
+device_open (device_t *dev, const char *file, int memory)
+{
+  struct stat st;
+  uint8_t *buf = NULL;
+
+  memset (dev, 0, sizeof (*dev));
+  dev->fd = open (file, O_RDONLY);
+  if (dev->fd < 0)
+    return 0;
+
+  if (fstat (dev->fd, &st))
+    goto err;
+
+  dev->size = (uint64_t) st.st_size;
+  if (!memory)
+    return 1;
+
+  buf = malloc (dev->size);
+  if (!buf)
+    goto err;
+
+  if (!device_read (dev, 0, buf, dev->size))
+    goto err;
+
+  dev->buf = buf;
+  return 1;
+
+ err:
+  free (buf);
+  close (dev->fd);
+  return 0;
+}
+
+void
+device_close (device_t *dev)
+{
+  free (dev->buf);
+  close (dev->fd);
+}
+
+/* Bytes and reads on the device since device_open(). */
+void
+device_counters (device_t *dev, uint64_t *bytes, uint64_t *reads)
+{
+  *bytes = __atomic_load_n (&dev->bytes, __ATOMIC_RELAXED);
+  *reads = __atomic_load_n (&dev->reads, __ATOMIC_RELAXED);
+}
+
+
+/*
+ * Misc.
+ */
+
+uint64_t
+now_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* xorshift32, the state must not be 0. */
+uint32_t
+bench_rand (uint32_t *state)
+{
+  uint32_t x = *state;
+
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+void
+json_string (const char *str)
+{
+  putchar ('"');
+  for (; *str; str++)
+  {
+    unsigned char c = (unsigned char) *str;
+
+    if (c == '"' || c == '\\')
+      printf ("\\%c", c);
+    else if (c < 0x20)
+      printf ("\\u%04x", c);
+    else
+      putchar (c);
+  }
+  putchar ('"');
+}
+
+/* True if name is in the comma-separated list (or if there is no list). */
+int
+selected (const char *list, const char *name)
+{
+  size_t len = strlen (name);
+  const char *it = list;
+
+  if (!list)
+    return 1;
+
+  while ((it = strstr (it, name)))
+  {
+    if ((it == list || it[-1] == ',') && (it[len] == ',' || it[len] == '\0'))
+      return 1;
+    it += len;
+  }
+
+  return 0;
+}
+
+/* Create an empty file in $TMPDIR (or /tmp), the path is returned. */
+int
+tmp_file (char *path, size_t size, const char *name)
+{
+  const char *dir = getenv ("TMPDIR");
+  int fd;
+
+  snprintf (path, size, "%s/%s-XXXXXX", dir && *dir ? dir : "/tmp", name);
+  fd = mkstemp (path);
+  if (fd < 0)
+    return 0;
+
+  close (fd);
+  return 1;
+}
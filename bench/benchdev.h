@@ -0,0 +1,55 @@
+/*
+ * FOS benchdev: helpers shared by fosbench and fusebench
+ * Copyright (C) 2025 Mathieu Schroeter <mathieu@schroetersa.ch>
+ *
+ * This file is part of Fosfat.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef BENCHDEV_H
+#define BENCHDEV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fosfat.h"
+
+#define BENCH_PATH 1024
+
+/* Image read by backend_device */
+typedef struct device_s {
+  int       fd;
+  uint8_t  *buf;               /* Whole image with --memory             */
+  uint64_t  size;
+  uint64_t  bytes;             /* Bytes read on the device              */
+  uint64_t  reads;             /* Reads on the device                   */
+} device_t;
+
+/* Backend on a device_t, all reads are counted (thread-safe) */
+extern const fosfat_backend_t backend_device;
+
+int device_open (device_t *dev, const char *file, int memory);
+void device_close (device_t *dev);
+void device_counters (device_t *dev, uint64_t *bytes, uint64_t *reads);
+
+uint64_t now_ns (void);
+uint32_t bench_rand (uint32_t *state);
+
+void json_string (const char *str);
+int selected (const char *list, const char *name);
+int tmp_file (char *path, size_t size, const char *name);
+
+#endif /* BENCHDEV_H */
@@ -0,0 +1,1103 @@
+/*
+ * FOS fosbench: benchmarks of libfosfat
+ * Copyright (C) 2025 Mathieu Schroeter <mathieu@schroetersa.ch>
+ *
+ * This file is part of Fosfat.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include "fosfat.h"
+#include "fosfat_internal.h"
+#include "benchdev.h"
+
+#define HELP_TEXT \
+"Benchmarks of libfosfat. fosfat-" LIBFOSFAT_VERSION_STR "\n\n" \
+"Usage: fosbench [options] [image ...]\n\n" \
+" -h --help             this help\n" \
+" -v --version          version\n" \
+" -j --json             print the results in JSON\n" \
+" -b --bench=LIST       comma-separated list of benchmarks [all]\n" \
+" -n --count=N          operations by benchmark [1000]\n" \
+" -o --opens=N          operations for the open benchmarks [10]\n" \
+" -t --threads=N        threads for the stress benchmark [4]\n" \
+" -z --chunk=N          bytes by read for the buffer benchmarks [4096]\n" \
+" -r --seed=N           seed for the random operations [1]\n" \
+" -C --cache=N          size of the block cache (in blocks)\n" \
+" -m --memory           load the image in memory first\n" \
+" -O --open             open the images with fosfat_open()\n" \
+" -p --mmap             open the images with F_MMAP (implies -O)\n" \
+" -U --uring            open the images with F_URING (implies -O)\n" \
+" -x --direct           open the images with F_DIRECT (implies -O)\n" \
+" -s --sidecar          open the images with F_SIDECAR (implies -O)\n" \
+" -u --undelete         open the disks with F_UNDELETE\n" \
+" -L --lazy             open the disks with F_LAZY\n" \
+" -P --parallel         open the disks with F_PARALLEL\n" \
+" -l --fos-logger       that will turn on the FOS logger\n" \
+"\n" \
+"Without image, a synthetic image is generated (and removed at the end):\n" \
+" -a --harddisk         generate a hard disk (floppy by default)\n" \
+" -d --depth=N          depth of the tree [2]\n" \
+" -w --dirs=N           sub-directories by directory [2]\n" \
+" -c --files=N          files by directory [16]\n" \
+" -M --max-size=N       max size of a file in bytes [65536]\n" \
+" -g --fragment=N       max blocks by tranche, 0 for contiguous [0]\n" \
+"\n" \
+"Benchmarks: open_cold, open_warm, stat, list_dir, buffer_seq, buffer_rand,\n" \
+"            get_file, symlink, stress\n" \
+"\n" \
+"The images are read through a backend which counts the bytes and the\n" \
+"reads on the device. With -O, the images are opened by libfosfat and the\n" \
+"bytes and the system calls are taken from fosfat_get_stats().\n" \
+"open_cold drops the image from the page cache before each open, it is\n" \
+"skipped with -m.\n" \
+"\nPlease, report bugs to <mathieu@schroetersa.ch>.\n"
+
+#define VERSION_TEXT "fosbench-" LIBFOSFAT_VERSION_STR "\n"
+
+/* The sanitizers are replacing the allocator of the glibc */
+#if defined (__SANITIZE_ADDRESS__) || defined (__SANITIZE_THREAD__)
+#define BENCH_SANITIZER
+#elif defined (__has_feature)
+#if __has_feature (address_sanitizer) || __has_feature (thread_sanitizer) \
+    || __has_feature (memory_sanitizer)
+#define BENCH_SANITIZER
+#endif
+#endif /* __SANITIZE_ADDRESS__ || __SANITIZE_THREAD__ */
+
+/*
+ * Allocations are counted by wrapping the allocator of the glibc. Use
+ * -DBENCH_NO_ALLOCS to build without.
+ */
+#if defined (__GLIBC__) && !defined (BENCH_SANITIZER) \
+    && !defined (BENCH_NO_ALLOCS)
+#define BENCH_ALLOCS
+#endif /* __GLIBC__ && !BENCH_SANITIZER && !BENCH_NO_ALLOCS */
+
+typedef struct counters_s {
+  uint64_t bytes;              /* Bytes read on the device              */
+  uint64_t reads;              /* Reads (system calls with -O)          */
+  uint64_t allocs;             /* Calls on malloc, calloc and realloc   */
+} counters_t;
+
+/* File, directory or link found on the disk */
+typedef struct entry_s {
+  char     *path;
+  int       size;              /* File size or entries of a directory   */
+  uint32_t  hash;              /* FNV-1a of the content (stress)        */
+} entry_t;
+
+typedef struct list_s {
+  entry_t      *items;
+  unsigned int  count;
+  unsigned int  max;
+} list_t;
+
+typedef struct ctx_s {
+  device_t      dev;
+  fosfat_t     *fosfat;        /* Handle for all benchmarks but open    */
+  fosfat_t     *opened;        /* Handle of the open benchmarks         */
+  unsigned int  flag;
+  int           native;        /* Opened with fosfat_open()             */
+  unsigned int  cache;
+  int           chunk;
+  unsigned int  threads;
+  list_t        dirs;
+  list_t        files;
+  list_t        links;
+  /* Position of buffer_seq */
+  unsigned int  seq_file;
+  int           seq_offset;
+  const char   *image;         /* Path of the image                     */
+  char          out[BENCH_PATH]; /* Destination of get_file           */
+} ctx_t;
+
+typedef struct result_s {
+  const char    *name;
+  unsigned long  ops;
+  unsigned long  errors;
+  double         seconds;
+  double         p50;          /* Microseconds                          */
+  double         p99;          /* Microseconds                          */
+  counters_t     counters;
+} result_t;
+
+typedef struct bench_s {
+  const char *name;
+  /* Not timed, before each operation (can be NULL) */
+  void (*prepare) (ctx_t *ctx);
+  /* Timed operation, returns a boolean */
+  int  (*op)      (ctx_t *ctx, uint32_t *rnd);
+  /* Not timed, after each operation (can be NULL) */
+  void (*finish)  (ctx_t *ctx);
+  int   opens;                 /* Count from --opens                    */
+} bench_t;
+
+typedef struct worker_s {
+  ctx_t          *ctx;
+  uint32_t        rnd;
+  unsigned long   count;
+  unsigned long   errors;
+  uint64_t       *lat;
+} worker_t;
+
+/* Allocations, and the I/O of the handles closed with -O */
+static counters_t g_counters;
+
+
+#ifdef BENCH_ALLOCS
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+void *
+malloc (size_t size)
+{
+  __atomic_fetch_add (&g_counters.allocs, 1, __ATOMIC_RELAXED);
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t nmemb, size_t size)
+{
+  __atomic_fetch_add (&g_counters.allocs, 1, __ATOMIC_RELAXED);
+  return __libc_calloc (nmemb, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+  __atomic_fetch_add (&g_counters.allocs, 1, __ATOMIC_RELAXED);
+  return __libc_realloc (ptr, size);
+}
+#endif /* BENCH_ALLOCS */
+
+/* Keep the I/O of a handle opened with fosfat_open() before closing it. */
+static void
+counters_add (fosfat_t *fosfat)
+{
+  fosfat_stats_t stats;
+
+  fosfat_get_stats (fosfat, &stats);
+  __atomic_fetch_add (&g_counters.bytes, stats.bytes, __ATOMIC_RELAXED);
+  __atomic_fetch_add (&g_counters.reads, stats.syscalls, __ATOMIC_RELAXED);
+}
+
+static void
+counters_get (ctx_t *ctx, counters_t *counters)
+{
+  uint64_t bytes, reads;
+
+  device_counters (&ctx->dev, &bytes, &reads);
+  counters->bytes  = bytes
+                   + __atomic_load_n (&g_counters.bytes, __ATOMIC_RELAXED);
+  counters->reads  = reads
+                   + __atomic_load_n (&g_counters.reads, __ATOMIC_RELAXED);
+  counters->allocs = __atomic_load_n (&g_counters.allocs, __ATOMIC_RELAXED);
+
+  /* The device is not read by libfosfat with -O */
+  if (ctx->native && ctx->fosfat)
+  {
+    fosfat_stats_t stats;
+
+    fosfat_get_stats (ctx->fosfat, &stats);
+    counters->bytes += stats.bytes;
+    counters->reads += stats.syscalls;
+  }
+}
+
+static void
+counters_diff (counters_t *res, const counters_t *a, const counters_t *b)
+{
+  res->bytes  = b->bytes  - a->bytes;
+  res->reads  = b->reads  - a->reads;
+  res->allocs = b->allocs - a->allocs;
+}
+
+static uint32_t
+fnv1a (const uint8_t *buf, int size)
+{
+  uint32_t hash = 2166136261U;
+  int i;
+
+  for (i = 0; i < size; i++)
+  {
+    hash ^= buf[i];
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+static fosfat_t *
+ctx_open (ctx_t *ctx, const char *image)
+{
+  fosfat_t *fosfat;
+
+  if (ctx->native)
+    fosfat = fosfat_open (image, FOSFAT_AD, ctx->flag);
+  else
+    fosfat = fosfat_open_backend (&backend_device, &ctx->dev,
+                                  FOSFAT_AD, ctx->flag);
+  if (fosfat && ctx->cache)
+    fosfat_blkcache_size (fosfat, ctx->cache);
+  return fosfat;
+}
+
+
+/*
+ * Entries of the disk.
+ */
+
+static int
+list_add (list_t *list, const char *path, int size)
+{
+  if (list->count == list->max)
+  {
+    unsigned int max = list->max ? list->max * 2 : 64;
+    entry_t *items = realloc (list->items, max * sizeof (*items));
+    if (!items)
+      return 0;
+    list->items = items;
+    list->max   = max;
+  }
+
+  list->items[list->count].path = strdup (path);
+  if (!list->items[list->count].path)
+    return 0;
+  list->items[list->count].size = size;
+  list->items[list->count].hash = 0;
+  list->count++;
+  return 1;
+}
+
+static void
+list_free (list_t *list)
+{
+  unsigned int i;
+
+  for (i = 0; i < list->count; i++)
+    free (list->items[i].path);
+  free (list->items);
+  memset (list, 0, sizeof (*list));
+}
+
+static int
+listdir_count (fosfat_t *fosfat, const char *loc)
+{
+  fosfat_file_t *list, *it;
+  int count = 0;
+
+  list = fosfat_list_dir (fosfat, loc);
+  for (it = list; it; it = it->next_file)
+    count++;
+  fosfat_free_listdir (list);
+  return count;
+}
+
+/* Collect all directories, files and soft-links of the tree. */
+static int
+walk (ctx_t *ctx, const char *loc)
+{
+  fosfat_dir_t *dir;
+  fosfat_file_t file;
+  int res = 1;
+
+  if (!list_add (&ctx->dirs, loc, listdir_count (ctx->fosfat, loc)))
+    return 0;
+
+  dir = fosfat_opendir (ctx->fosfat, loc);
+  if (!dir)
+    return 0;
+
+  while (res && fosfat_readdir (dir, &file))
+  {
+    char path[BENCH_PATH];
+
+    if (file.name[0] == '.' || file.att.isdel)
+      continue;
+
+    snprintf (path, sizeof (path), "%s/%s", strcmp (loc, "/") ? loc : "",
+              file.name);
+
+    if (file.att.islink)
+      res = list_add (&ctx->links, path, file.size);
+    else if (file.att.isdir)
+      res = walk (ctx, path);
+    else if (file.size > 0)
+      res = list_add (&ctx->files, path, file.size);
+  }
+
+  fosfat_closedir (dir);
+  return res;
+}
+
+/* Reference of the content for the checks of the stress benchmark. */
+static int
+hash_files (ctx_t *ctx)
+{
+  unsigned int i;
+
+  for (i = 0; i < ctx->files.count; i++)
+  {
+    entry_t *file = &ctx->files.items[i];
+    uint8_t *buf;
+
+    buf = fosfat_get_buffer (ctx->fosfat, file->path, 0, file->size);
+    if (!buf)
+      return 0;
+
+    file->hash = fnv1a (buf, file->size);
+    free (buf);
+  }
+
+  return 1;
+}
+
+
+/*
+ * Benchmarks.
+ */
+
+static void
+prepare_cold (ctx_t *ctx)
+{
+  posix_fadvise (ctx->dev.fd, 0, 0, POSIX_FADV_DONTNEED);
+}
+
+static int
+op_open (ctx_t *ctx, uint32_t *rnd)
+{
+  (void) rnd;
+  ctx->opened = ctx_open (ctx, ctx->image);
+  return !!ctx->opened;
+}
+
+static void
+finish_open (ctx_t *ctx)
+{
+  if (ctx->opened && ctx->native)
+    counters_add (ctx->opened);
+  if (ctx->opened)
+    fosfat_close (ctx->opened);
+  ctx->opened = NULL;
+}
+
+static int
+op_stat (ctx_t *ctx, uint32_t *rnd)
+{
+  fosfat_file_t *st;
+  entry_t *file;
+
+  file = &ctx->files.items[bench_rand (rnd) % ctx->files.count];
+  st = fosfat_get_stat (ctx->fosfat, file->path);
+  if (!st)
+    return 0;
+
+  free (st);
+  return 1;
+}
+
+static int
+op_list_dir (ctx_t *ctx, uint32_t *rnd)
+{
+  fosfat_file_t *list;
+  entry_t *dir;
+
+  dir = &ctx->dirs.items[bench_rand (rnd) % ctx->dirs.count];
+  list = fosfat_list_dir (ctx->fosfat, dir->path);
+  if (!list)
+    return 0;
+
+  fosfat_free_listdir (list);
+  return 1;
+}
+
+static int
+op_buffer_seq (ctx_t *ctx, uint32_t *rnd)
+{
+  entry_t *file;
+  uint8_t *buf;
+  int size;
+
+  (void) rnd;
+
+  file = &ctx->files.items[ctx->seq_file];
+  size = MIN (ctx->chunk, file->size - ctx->seq_offset);
+  buf = fosfat_get_buffer (ctx->fosfat, file->path, ctx->seq_offset, size);
+
+  ctx->seq_offset += size;
+  if (ctx->seq_offset >= file->size)
+  {
+    ctx->seq_offset = 0;
+    ctx->seq_file = (ctx->seq_file + 1) % ctx->files.count;
+  }
+
+  if (!buf)
+    return 0;
+
+  free (buf);
+  return 1;
+}
+
+static int
+op_buffer_rand (ctx_t *ctx, uint32_t *rnd)
+{
+  entry_t *file;
+  uint8_t *buf;
+  int offset;
+
+  file = &ctx->files.items[bench_rand (rnd) % ctx->files.count];
+  offset = bench_rand (rnd) % file->size;
+  buf = fosfat_get_buffer (ctx->fosfat, file->path,
+                           offset, MIN (ctx->chunk, file->size - offset));
+  if (!buf)
+    return 0;
+
+  free (buf);
+  return 1;
+}
+
+static int
+op_get_file (ctx_t *ctx, uint32_t *rnd)
+{
+  entry_t *file;
+
+  file = &ctx->files.items[bench_rand (rnd) % ctx->files.count];
+  return fosfat_get_file (ctx->fosfat, file->path, ctx->out, 0);
+}
+
+static int
+op_symlink (ctx_t *ctx, uint32_t *rnd)
+{
+  entry_t *link;
+  char *target;
+
+  link = &ctx->links.items[bench_rand (rnd) % ctx->links.count];
+  target = fosfat_symlink (ctx->fosfat, link->path);
+  if (!target)
+    return 0;
+
+  free (target);
+  return 1;
+}
+
+/* One operation on the shared handle, the result is checked. */
+static int
+op_stress (ctx_t *ctx, uint32_t *rnd)
+{
+  entry_t *entry;
+
+  switch (bench_rand (rnd) % 4)
+  {
+  case 0:
+  {
+    fosfat_file_t *st;
+    int res;
+
+    entry = &ctx->files.items[bench_rand (rnd) % ctx->files.count];
+    st = fosfat_get_stat (ctx->fosfat, entry->path);
+    if (!st)
+      return 0;
+
+    res = st->size == entry->size;
+    free (st);
+    return res;
+  }
+
+  case 1:
+    entry = &ctx->dirs.items[bench_rand (rnd) % ctx->dirs.count];
+    return listdir_count (ctx->fosfat, entry->path) == entry->size;
+
+  case 2:
+  {
+    uint8_t *buf;
+    int res;
+
+    entry = &ctx->files.items[bench_rand (rnd) % ctx->files.count];
+    buf = fosfat_get_buffer (ctx->fosfat, entry->path, 0, entry->size);
+    if (!buf)
+      return 0;
+
+    res = fnv1a (buf, entry->size) == entry->hash;
+    free (buf);
+    return res;
+  }
+
+  default:
+    if (!ctx->links.count)
+      return op_stat (ctx, rnd);
+    return op_symlink (ctx, rnd);
+  }
+}
+
+static const bench_t g_benchs[] = {
+  { "open_cold",   prepare_cold, op_open,        finish_open, 1 },
+  { "open_warm",   NULL,         op_open,        finish_open, 1 },
+  { "stat",        NULL,         op_stat,        NULL,        0 },
+  { "list_dir",    NULL,         op_list_dir,    NULL,        0 },
+  { "buffer_seq",  NULL,         op_buffer_seq,  NULL,        0 },
+  { "buffer_rand", NULL,         op_buffer_rand, NULL,        0 },
+  { "get_file",    NULL,         op_get_file,    NULL,        0 },
+  { "symlink",     NULL,         op_symlink,     NULL,        0 },
+  { "stress",      NULL,         op_stress,      NULL,        0 },
+};
+
+
+/*
+ * Runner.
+ */
+
+static int
+cmp_u64 (const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *) a;
+  uint64_t y = *(const uint64_t *) b;
+  return x < y ? -1 : x > y;
+}
+
+static void
+latencies (result_t *res, uint64_t *lat, unsigned long count)
+{
+  if (!count)
+    return;
+
+  qsort (lat, count, sizeof (*lat), cmp_u64);
+  res->p50 = lat[(count - 1) * 50 / 100] / 1000.0;
+  res->p99 = lat[(count - 1) * 99 / 100] / 1000.0;
+}
+
+static int
+bench_run (ctx_t *ctx, const bench_t *bench,
+           unsigned long count, uint32_t seed, result_t *res)
+{
+  counters_t start, end;
+  uint64_t *lat, total = 0;
+  uint32_t rnd = seed;
+  unsigned long i;
+
+  lat = malloc (count * sizeof (*lat));
+  if (!lat)
+    return 0;
+
+  res->name = bench->name;
+  res->ops  = count;
+
+  counters_get (ctx, &start);
+
+  for (i = 0; i < count; i++)
+  {
+    uint64_t t0, t1;
+    int ok;
+
+    if (bench->prepare)
+      bench->prepare (ctx);
+
+    t0 = now_ns ();
+    ok = bench->op (ctx, &rnd);
+    t1 = now_ns ();
+
+    if (bench->finish)
+      bench->finish (ctx);
+
+    lat[i] = t1 - t0;
+    total += lat[i];
+    if (!ok)
+      res->errors++;
+  }
+
+  counters_get (ctx, &end);
+  counters_diff (&res->counters, &start, &end);
+
+  res->seconds = total / 1e9;
+  latencies (res, lat, count);
+  free (lat);
+  return 1;
+}
+
+static void *
+stress_worker (void *data)
+{
+  worker_t *worker = data;
+  unsigned long i;
+
+  for (i = 0; i < worker->count; i++)
+  {
+    uint64_t t0 = now_ns ();
+    if (!op_stress (worker->ctx, &worker->rnd))
+      worker->errors++;
+    worker->lat[i] = now_ns () - t0;
+  }
+
+  return NULL;
+}
+
+/* All threads are hammering the same handle. */
+static int
+stress_run (ctx_t *ctx, unsigned long count, uint32_t seed, result_t *res)
+{
+  counters_t start, end;
+  pthread_t *threads;
+  worker_t *workers;
+  uint64_t *lat, t0;
+  unsigned int i, nb = 0;
+
+  threads = calloc (ctx->threads, sizeof (*threads));
+  workers = calloc (ctx->threads, sizeof (*workers));
+  lat     = malloc (ctx->threads * count * sizeof (*lat));
+  if (!threads || !workers || !lat)
+  {
+    free (threads);
+    free (workers);
+    free (lat);
+    return 0;
+  }
+
+  res->name = "stress";
+
+  counters_get (ctx, &start);
+  t0 = now_ns ();
+
+  for (i = 0; i < ctx->threads; i++)
+  {
+    workers[i].ctx   = ctx;
+    workers[i].rnd   = seed + i * 0x9E3779B9U;
+    workers[i].count = count;
+    workers[i].lat   = lat + (size_t) i * count;
+    if (!workers[i].rnd)
+      workers[i].rnd = 1;
+
+    if (pthread_create (&threads[nb], NULL, stress_worker, &workers[i]))
+      break;
+    nb++;
+  }
+
+  for (i = 0; i < nb; i++)
+  {
+    pthread_join (threads[i], NULL);
+    res->errors += workers[i].errors;
+  }
+
+  res->seconds = (now_ns () - t0) / 1e9;
+  counters_get (ctx, &end);
+  counters_diff (&res->counters, &start, &end);
+
+  if (nb < ctx->threads)
+    res->errors++;
+
+  res->ops = nb * count;
+  latencies (res, lat, res->ops);
+
+  free (lat);
+  free (workers);
+  free (threads);
+  return 1;
+}
+
+
+/*
+ * Reports.
+ */
+
+static void
+report_image (const char *image, const ctx_t *ctx, int json)
+{
+  const char *disk = fosfat_type (ctx->fosfat) == FOSFAT_HD ? "hd" : "fd";
+
+  if (!json)
+  {
+    printf ("Image \"%s\" (%s, %.1f MiB, %u dirs, %u files, %u links)\n\n",
+            image, disk, ctx->dev.size / 1024.0 / 1024.0,
+            ctx->dirs.count, ctx->files.count, ctx->links.count);
+    printf ("%-12s %8s %12s %10s %10s %10s %9s %9s %7s\n",
+            "bench", "ops", "ops/s", "p50 (us)", "p99 (us)",
+            "bytes/op", "reads/op", "allocs/op", "errors");
+    return;
+  }
+
+  printf ("    {\n      \"image\": ");
+  json_string (image);
+  printf (",\n      \"disk\": \"%s\",\n", disk);
+  printf ("      \"size\": %" PRIu64 ",\n", ctx->dev.size);
+  printf ("      \"dirs\": %u,\n", ctx->dirs.count);
+  printf ("      \"files\": %u,\n", ctx->files.count);
+  printf ("      \"links\": %u,\n", ctx->links.count);
+  printf ("      \"flags\": %u,\n", ctx->flag);
+  printf ("      \"fosfat_open\": %s,\n", ctx->native ? "true" : "false");
+  printf ("      \"memory\": %s,\n", ctx->dev.buf ? "true" : "false");
+  printf ("      \"threads\": %u,\n", ctx->threads);
+  printf ("      \"benchmarks\": [");
+}
+
+static void
+report_result (const result_t *res, int json, int first)
+{
+  double ops = res->ops ? res->ops : 1;
+  double rate = res->seconds > 0 ? res->ops / res->seconds : 0;
+
+  if (!json)
+  {
+    printf ("%-12s %8lu %12.0f %10.2f %10.2f %10.0f %9.2f ",
+            res->name, res->ops, rate, res->p50, res->p99,
+            res->counters.bytes / ops, res->counters.reads / ops);
+#ifdef BENCH_ALLOCS
+    printf ("%9.2f", res->counters.allocs / ops);
+#else
+    printf ("%9s", "-");
+#endif /* BENCH_ALLOCS */
+    printf (" %7lu\n", res->errors);
+    return;
+  }
+
+  printf ("%s\n        {\n", first ? "" : ",");
+  printf ("          \"name\": \"%s\",\n", res->name);
+  printf ("          \"ops\": %lu,\n", res->ops);
+  printf ("          \"errors\": %lu,\n", res->errors);
+  printf ("          \"seconds\": %.6f,\n", res->seconds);
+  printf ("          \"ops_per_sec\": %.1f,\n", rate);
+  printf ("          \"p50_us\": %.3f,\n", res->p50);
+  printf ("          \"p99_us\": %.3f,\n", res->p99);
+  printf ("          \"bytes_read\": %" PRIu64 ",\n", res->counters.bytes);
+  printf ("          \"bytes_per_op\": %.1f,\n", res->counters.bytes / ops);
+  printf ("          \"device_reads\": %" PRIu64 ",\n", res->counters.reads);
+#ifdef BENCH_ALLOCS
+  printf ("          \"allocs_per_op\": %.2f\n", res->counters.allocs / ops);
+#else
+  printf ("          \"allocs_per_op\": null\n");
+#endif /* BENCH_ALLOCS */
+  printf ("        }");
+}
+
+/* Run all selected benchmarks on one image, returns the number of errors. */
+static unsigned long
+bench_image (ctx_t *ctx, const char *image, int memory, const char *list,
+             unsigned long count, unsigned long opens, uint32_t seed,
+             int json)
+{
+  unsigned long errors = 0;
+  unsigned int i;
+  int first = 1;
+
+  /* The device is only used for the size and the page cache with -O */
+  if (!device_open (&ctx->dev, image, memory))
+  {
+    fprintf (stderr, "The image \"%s\" cannot be read\n", image);
+    return 1;
+  }
+
+  ctx->image  = image;
+  ctx->fosfat = ctx_open (ctx, image);
+  if (!ctx->fosfat)
+  {
+    fprintf (stderr, "The image \"%s\" cannot be opened\n", image);
+    device_close (&ctx->dev);
+    return 1;
+  }
+
+  if (!walk (ctx, "/")
+      || (ctx->threads && selected (list, "stress") && !hash_files (ctx)))
+  {
+    fprintf (stderr, "The tree of \"%s\" cannot be read\n", image);
+    errors++;
+    goto out;
+  }
+
+  report_image (image, ctx, json);
+
+  for (i = 0; i < countof (g_benchs); i++)
+  {
+    const bench_t *bench = &g_benchs[i];
+    result_t res;
+    int ok;
+
+    if (!selected (list, bench->name))
+      continue;
+
+    /* Nothing to do on this disk */
+    if ((!ctx->files.count && strcmp (bench->name, "list_dir")
+         && !bench->opens)
+        || (!ctx->links.count && !strcmp (bench->name, "symlink"))
+        || (ctx->dev.buf && bench->prepare == prepare_cold))
+      continue;
+
+    memset (&res, 0, sizeof (res));
+
+    if (!strcmp (bench->name, "stress"))
+    {
+      if (!ctx->threads)
+        continue;
+      ok = stress_run (ctx, count, seed, &res);
+    }
+    else
+      ok = bench_run (ctx, bench, bench->opens ? opens : count, seed, &res);
+
+    if (!ok)
+    {
+      fprintf (stderr, "Benchmark %s: not enough memory\n", bench->name);
+      errors++;
+      continue;
+    }
+
+    report_result (&res, json, first);
+    errors += res.errors;
+    first = 0;
+  }
+
+  if (json)
+    printf ("%s]\n    }", first ? "" : "\n      ");
+  else
+    printf ("\n");
+
+ out:
+  fosfat_close (ctx->fosfat);
+  ctx->fosfat = NULL;
+  list_free (&ctx->dirs);
+  list_free (&ctx->files);
+  list_free (&ctx->links);
+  ctx->seq_file = 0;
+  ctx->seq_offset = 0;
+  device_close (&ctx->dev);
+  return errors;
+}
+
+static void
+print_info (void)
+{
+  printf (HELP_TEXT);
+}
+
+static void
+print_version (void)
+{
+  printf (VERSION_TEXT);
+}
+
+int
+main (int argc, char **argv)
+{
+  int json = 0, memory = 0, next_option, i;
+  unsigned long count = 1000, opens = 10, errors = 0;
+  uint32_t seed = 1;
+  const char *list = NULL;
+  char generated[BENCH_PATH] = { 0 };
+  fosfat_gen_t gen;
+  ctx_t ctx;
+
+  const char *const short_options = "ab:c:C:d:g:hjlLmM:n:o:OpPr:st:uUvw:xz:";
+
+  const struct option long_options[] = {
+    { "help",       no_argument,       NULL, 'h' },
+    { "version",    no_argument,       NULL, 'v' },
+    { "json",       no_argument,       NULL, 'j' },
+    { "bench",      required_argument, NULL, 'b' },
+    { "count",      required_argument, NULL, 'n' },
+    { "opens",      required_argument, NULL, 'o' },
+    { "threads",    required_argument, NULL, 't' },
+    { "chunk",      required_argument, NULL, 'z' },
+    { "seed",       required_argument, NULL, 'r' },
+    { "cache",      required_argument, NULL, 'C' },
+    { "memory",     no_argument,       NULL, 'm' },
+    { "open",       no_argument,       NULL, 'O' },
+    { "mmap",       no_argument,       NULL, 'p' },
+    { "uring",      no_argument,       NULL, 'U' },
+    { "direct",     no_argument,       NULL, 'x' },
+    { "sidecar",    no_argument,       NULL, 's' },
+    { "undelete",   no_argument,       NULL, 'u' },
+    { "lazy",       no_argument,       NULL, 'L' },
+    { "parallel",   no_argument,       NULL, 'P' },
+    { "fos-logger", no_argument,       NULL, 'l' },
+    { "harddisk",   no_argument,       NULL, 'a' },
+    { "depth",      required_argument, NULL, 'd' },
+    { "dirs",       required_argument, NULL, 'w' },
+    { "files",      required_argument, NULL, 'c' },
+    { "max-size",   required_argument, NULL, 'M' },
+    { "fragment",   required_argument, NULL, 'g' },
+    { NULL,         0,                 NULL,  0  }
+  };
+
+  memset (&ctx, 0, sizeof (ctx));
+  ctx.chunk   = 4096;
+  ctx.threads = 4;
+  fosfat_gen_defaults (&gen);
+
+  /* check options */
+  do
+  {
+    next_option = getopt_long (argc, argv, short_options, long_options, NULL);
+    switch (next_option)
+    {
+    default :           /* unknown */
+    case '?':           /* invalid option */
+    case 'h':           /* -h or --help */
+      print_info ();
+      return -1;
+    case 'v':           /* -v or --version */
+      print_version ();
+      return -1;
+    case 'j':           /* -j or --json */
+      json = 1;
+      break;
+    case 'b':           /* -b or --bench */
+      list = optarg;
+      break;
+    case 'n':           /* -n or --count */
+      count = strtoul (optarg, NULL, 0);
+      break;
+    case 'o':           /* -o or --opens */
+      opens = strtoul (optarg, NULL, 0);
+      break;
+    case 't':           /* -t or --threads */
+      ctx.threads = (unsigned int) strtoul (optarg, NULL, 0);
+      break;
+    case 'z':           /* -z or --chunk */
+      ctx.chunk = atoi (optarg);
+      break;
+    case 'r':           /* -r or --seed */
+      seed = (uint32_t) strtoul (optarg, NULL, 0);
+      break;
+    case 'C':           /* -C or --cache */
+      ctx.cache = (unsigned int) strtoul (optarg, NULL, 0);
+      break;
+    case 'm':           /* -m or --memory */
+      memory = 1;
+      break;
+    case 'O':           /* -O or --open */
+      ctx.native = 1;
+      break;
+    case 'p':           /* -p or --mmap */
+      ctx.native = 1;
+      ctx.flag |= F_MMAP;
+      break;
+    case 'U':           /* -U or --uring */
+      ctx.native = 1;
+      ctx.flag |= F_URING;
+      break;
+    case 'x':           /* -x or --direct */
+      ctx.native = 1;
+      ctx.flag |= F_DIRECT;
+      break;
+    case 's':           /* -s or --sidecar */
+      ctx.native = 1;
+      ctx.flag |= F_SIDECAR;
+      break;
+    case 'u':           /* -u or --undelete */
+      ctx.flag |= F_UNDELETE;
+      break;
+    case 'L':           /* -L or --lazy */
+      ctx.flag |= F_LAZY;
+      break;
+    case 'P':           /* -P or --parallel */
+      ctx.flag |= F_PARALLEL;
+      break;
+    case 'l':           /* -l or --fos-logger */
+      fosfat_logger (1);
+      break;
+    case 'a':           /* -a or --harddisk */
+      gen.disk = FOSFAT_HD;
+      break;
+    case 'd':           /* -d or --depth */
+      gen.depth = (unsigned int) strtoul (optarg, NULL, 0);
+      break;
+    case 'w':           /* -w or --dirs */
+      gen.dirs = (unsigned int) strtoul (optarg, NULL, 0);
+      break;
+    case 'c':           /* -c or --files */
+      gen.files = (unsigned int) strtoul (optarg, NULL, 0);
+      break;
+    case 'M':           /* -M or --max-size */
+      gen.size_max = (uint32_t) strtoul (optarg, NULL, 0);
+      break;
+    case 'g':           /* -g or --fragment */
+      gen.fragment = (unsigned int) strtoul (optarg, NULL, 0);
+      break;
+    case -1:            /* end */
+      break;
+    }
+  } while (next_option != -1);
+
+  if (!count || !opens || ctx.chunk <= 0 || (memory && ctx.native))
+  {
+    print_info ();
+    return -1;
+  }
+
+  if (!seed)
+    seed = 1;
+
+  if (!tmp_file (ctx.out, sizeof (ctx.out), "fosbench-out"))
+  {
+    fprintf (stderr, "The temporary files cannot be created\n");
+    return -1;
+  }
+
+  if (argc == optind)
+  {
+    fosfat_gen_info_t info;
+
+    gen.seed = seed;
+    if (!tmp_file (generated, sizeof (generated), "fosbench")
+        || !fosfat_gen_image (generated, &gen, &info))
+    {
+      fprintf (stderr, "The image cannot be generated\n");
+      unlink (ctx.out);
+      if (*generated)
+        unlink (generated);
+      return -1;
+    }
+  }
+
+  if (json)
+    printf ("{\n  \"version\": \"%s\",\n  \"images\": [\n",
+            LIBFOSFAT_VERSION_STR);
+
+  if (*generated)
+    errors += bench_image (&ctx, generated, memory, list,
+                           count, opens, seed, json);
+
+  for (i = optind; i < argc; i++)
+  {
+    if (json && (i > optind || *generated))
+      printf (",\n");
+    errors += bench_image (&ctx, argv[i], memory, list,
+                           count, opens, seed, json);
+  }
+
+  if (json)
+    printf ("\n  ]\n}\n");
+
+  unlink (ctx.out);
+  if (*generated)
+  {
+    unlink (generated);
+    if (ctx.flag & F_SIDECAR)
+    {
+      char sidecar[BENCH_PATH + 8];
+
+      snprintf (sidecar, sizeof (sidecar), "%s.fosidx", generated);
+      unlink (sidecar);
+    }
+  }
+
+  return errors ? 1 : 0;
+}
@@ -24,20 +24,11 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <errno.h>
-#include <fcntl.h>
-#include <string.h>     /* strcmp strncmp strstr strlen strdup memcpy memset */
-#include <time.h>       /* mktime */
-#include <fuse.h>
+#include <string.h>     /* strdup */
 #include <getopt.h>
 
 #include "fosfat.h"
-#include "fosfat_internal.h"
-#include "fosgra.h"
-
-/* Rights */
-#define FOS_DIR             0555
-#define FOS_FILE            0444
+#include "fosops.h"
 
 #define HELP_DEVICE \
 "file.di  : disk image\n" \
@@ -55,408 +46,13 @@
 " -d --fuse-debugger    that will turn on the FUSE debugger\n" \
 " -i --image-bmp        convert on the fly .IMAGE and .COLOR to .BMP\n" \
 " -t --text             convert on the fly some text files to .TXT\n" \
+" -x --direct           bypass the page cache (O_DIRECT) with a device\n" \
 " device                " HELP_DEVICE \
 " mountpoint            for example, /mnt/smaky\n" \
 "\nPlease, report bugs to <mathieu@schroetersa.ch>.\n"
 
 #define VERSION_TEXT "fosmount-" LIBFOSFAT_VERSION_STR "\n"
 
-
-static fosfat_t *fosfat;
-
-#define FLYID "@"
-
-static int g_bmp = 0;
-static int g_txt = 0;
-
-
-static char *
-trim_fosname (const char *path)
-{
-  char *it, res[256];
-
-  snprintf (res, sizeof (res), "%s", path);
-  it = strstr (res, "." FLYID ".");
-  if (it)
-    *it = '\0';
-
-  return strdup (res);
-}
-
-static size_t
-get_filesize (fosfat_file_t *file, const char *path)
-{
-  fosfat_ftype_t ftype = FOSFAT_FTYPE_OTHER;
-
-  if (file->att.isdir || file->att.islink || file->att.isencoded)
-    return file->size;
-
-  ftype = fosfat_ftype (file->name);
-
-  if (g_bmp && ftype == FOSFAT_FTYPE_IMAGE && fosgra_is_image (fosfat, path))
-    return fosgra_bmp_get_size (fosfat, path);
-
-  return file->size;
-}
-
-static uint8_t *
-get_buffer (fosfat_file_t *file, const char *path, off_t offset, size_t size)
-{
-  fosfat_ftype_t ftype = FOSFAT_FTYPE_OTHER;
-
-  if (file->att.isdir || file->att.islink || file->att.isencoded)
-    goto std;
-
-  ftype = fosfat_ftype (file->name);
-
-  if (g_bmp && ftype == FOSFAT_FTYPE_IMAGE && fosgra_is_image (fosfat, path))
-  {
-    size_t image_size = 0;
-    uint8_t *image_buffer = fosgra_bmp_get_buffer (fosfat, path, &image_size);
-    uint8_t *dec = calloc (1, size);
-    memcpy (dec, image_buffer + offset, size);
-    free (image_buffer);
-    return dec;
-  }
-
-  if (g_txt && ftype == FOSFAT_FTYPE_TEXT)
-  {
-    uint8_t *text_buffer = fosfat_get_buffer (fosfat, path, offset, size);
-    fosfat_sma2iso8859 ((char *) text_buffer, size, FOSFAT_ASCII_LF);
-    return text_buffer;
-  }
-
-std:
-  return fosfat_get_buffer (fosfat, path, offset, size);
-}
-
-/*
- * Convert 'fosfat_file_t' to 'struct stat'.
- */
-static struct stat *
-in_stat (fosfat_file_t *file, const char *path)
-{
-  struct stat *st;
-  struct tm time;
-
-  st = calloc (1, sizeof (struct stat));
-  if (!st)
-    return NULL;
-
-  memset (&time, 0, sizeof (time));
-
-  /* Directory, symlink or file */
-  if (file->att.isdir)
-  {
-    st->st_mode = S_IFDIR | FOS_DIR;
-    st->st_nlink = 2;
-  }
-  else if (file->att.islink)
-  {
-    st->st_mode = S_IFLNK | FOS_DIR;
-    st->st_nlink = 2;
-  }
-  else
-  {
-    st->st_mode = S_IFREG | FOS_FILE;
-    st->st_nlink = 1;
-  }
-
-  /* Size */
-  st->st_size = get_filesize (file, path);
-
-  /* Time */
-  time.tm_year = file->time_r.year - 1900;
-  time.tm_mon  = file->time_r.month - 1;
-  time.tm_mday = file->time_r.day;
-  time.tm_hour = file->time_r.hour;
-  time.tm_min  = file->time_r.minute;
-  time.tm_sec  = file->time_r.second;
-  st->st_atime = mktime (&time);
-  time.tm_year = file->time_w.year - 1900;
-  time.tm_mon  = file->time_w.month - 1;
-  time.tm_mday = file->time_w.day;
-  time.tm_hour = file->time_w.hour;
-  time.tm_min  = file->time_w.minute;
-  time.tm_sec  = file->time_w.second;
-  st->st_mtime = mktime (&time);
-  time.tm_year = file->time_c.year - 1900;
-  time.tm_mon  = file->time_c.month - 1;
-  time.tm_mday = file->time_c.day;
-  time.tm_hour = file->time_c.hour;
-  time.tm_min  = file->time_c.minute;
-  time.tm_sec  = file->time_c.second;
-  st->st_ctime = mktime (&time);
-
-  return st;
-}
-
-/*
- * Get the file stat from a path an return as struct stat.
- */
-static struct stat *
-get_stat (const char *path)
-{
-  char *location;
-  struct stat *st = NULL;
-  fosfat_file_t *file;
-
-  location = trim_fosname (path);
-
-  file = fosfat_get_stat (fosfat, location);
-  if (file)
-  {
-    st = in_stat (file, location);
-    free (file);
-  }
-
-  if (location)
-    free (location);
-
-  return st;
-}
-
-/*
- * FUSE : read the target of a symlink.
- *
- * path         (foo/bar)
- * dst          target
- * size         max length
- * return 0 for success
- */
-static int
-fos_readlink (const char *path, char *dst, size_t size)
-{
-  int res = -ENOENT;
-  char *link, *location;
-
-  location = trim_fosname (path);
-
-  link = fosfat_symlink (fosfat, location);
-
-  if (strlen (link) < size)
-  {
-    memcpy (dst, link, strlen (link) + 1);
-    res = 0;
-  }
-
-  if (link)
-    free (link);
-  if (location)
-    free (location);
-
-  return res;
-}
-
-/*
- * FUSE : get attributes of a file.
- *
- * path         (foo/bar)
- * stbuf        attributes
- * return 0 for success
- */
-static int
-fos_getattr (const char *path, struct stat *stbuf, struct fuse_file_info *fi)
-{
-  int ret = 0;
-  char *location;
-  struct stat *st;
-
-  (void) fi;
-
-  /* Root directory */
-  if (!strcmp (path, "/"))
-    location = strdup ("/sys_list");
-  else
-    location = trim_fosname (path);
-
-  /* Get file stats */
-  st = get_stat (location);
-  if (st)
-  {
-    memcpy (stbuf, st, sizeof (*stbuf));
-    free (st);
-  }
-  else
-    ret = -ENOENT;
-
-  if (location)
-    free (location);
-
-  return ret;
-}
-
-/*
- * FUSE : read a directory.
- *
- * path         (foo/bar)
- * buf          buffer for filler
- * filler       function for put each entry
- * offset       not used
- * fi           not used
- * return 0 for success
- */
-static int
-fos_readdir (const char *path, void *buf, fuse_fill_dir_t filler,
-             off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags)
-{
-  int ret = -ENOENT;
-  char *location;
-  fosfat_file_t *file, *first_file;
-
-  (void) offset;
-  (void) fi;
-  (void) flags;
-
-  location = trim_fosname (path);
-
-  /* First entries */
-  filler (buf, "..", NULL, 0, 0);
-
-  /* Files and directories */
-  file = fosfat_list_dir (fosfat, location);
-  if (!file)
-    goto out;
-
-  first_file = file;
-
-  do
-  {
-    char _path[256];
-    struct stat *st;
-    char *name;
-    fosfat_ftype_t ftype = FOSFAT_FTYPE_OTHER;
-
-    snprintf (_path, sizeof (_path), "%s/%s", location, file->name);
-    remove_dup_slashes (_path);
-    st = in_stat (file, _path);
-
-    ftype = fosfat_ftype (file->name);
-
-    /* add identification for .IMAGE and .COLOR translated to BMP */
-    if (g_bmp && ftype == FOSFAT_FTYPE_IMAGE && fosgra_is_image (fosfat, _path))
-    {
-      name = calloc (1, strlen (file->name) + strlen (FLYID) + 6);
-      sprintf (name, "%s." FLYID ".bmp", file->name);
-    }
-    /* add identification for text files translated to ISO-8859-1 */
-    else if (g_txt && ftype == FOSFAT_FTYPE_TEXT)
-    {
-      name = calloc (1, strlen (file->name) + strlen (FLYID) + 6);
-      sprintf (name, "%s." FLYID ".txt", file->name);
-    }
-    else
-      name = strdup (file->name);
-
-    if (strstr (name, ".dir"))
-      *(name + strlen (name) - 4) = '\0';
-
-    /* Add entry in the file list */
-    filler (buf, name, st, 0, 0);
-    free (st);
-    free (name);
-  }
-  while ((file = file->next_file));
-
-  fosfat_free_listdir (first_file);
-  ret = 0;
-
- out:
-  if (location)
-    free (location);
-
-  return ret;
-}
-
-/*
- * FUSE : test if a file can be opened.
- *
- * path         (foo/bar)
- * fi           flags
- * return 0 for success
- */
-static int
-fos_open (const char *path, struct fuse_file_info *fi)
-{
-  int ret = 0;
-  char *location;
-
-  location = trim_fosname (path);
-
-  if ((fi->flags & 3) != O_RDONLY)
-    ret = -EACCES;
-  else if (!fosfat_isopenexm (fosfat, location))
-    ret = -ENOENT;
-
-  if (location)
-    free (location);
-
-  return ret;
-}
-
-/*
- * FUSE : read the data of a file.
- *
- * path         (foo/bar)
- * buf          buffer for put the data
- * size         size in bytes
- * offset       offset in bytes
- * fi           not used
- * return the size
- */
-static int
-fos_read (const char *path, char *buf, size_t size,
-          off_t offset, struct fuse_file_info *fi)
-{
-  int res = -ENOENT;
-  int length;
-  char *location;
-  uint8_t *buf_tmp;
-  fosfat_file_t *file = NULL;
-
-  (void) fi;
-
-  location = trim_fosname (path);
-
-  /* Get the stats and test if it is a file */
-  file = fosfat_get_stat (fosfat, location);
-  if (!file)
-    goto out;
-
-  if (file->att.isdir)
-    goto out;
-
-  length = get_filesize (file, location);
-
-  if (offset < length)
-  {
-    /* Fix the size in function of the offset */
-    if (offset + (signed) size > length)
-      size = length - offset;
-
-    /* Read the data */
-    buf_tmp = get_buffer (file, location, offset, size);
-
-    /* Copy the data for FUSE */
-    if (buf_tmp)
-    {
-      memcpy (buf, buf_tmp, size);
-      free (buf_tmp);
-      res = size;
-    }
-  }
-  else
-    res = 0;
-
- out:
-  if (file)
-    free (file);
-  if (location)
-    free (location);
-
-  return res;
-}
-
 /* Print help. */
 void
 print_info (void)
@@ -471,26 +67,19 @@ print_version (void)
   printf (VERSION_TEXT);
 }
 
-/* FUSE implemented functions */
-static struct fuse_operations fosfat_oper = {
-  .getattr  = fos_getattr,
-  .readdir  = fos_readdir,
-  .open     = fos_open,
-  .read     = fos_read,
-  .readlink = fos_readlink,
-};
-
 int
 main (int argc, char **argv)
 {
   int i;
   int next_option;
-  int res = 0, fusedebug = 0, foslog = 0;
+  int res = 0, fusedebug = 0, foslog = 0, bmp = 0, txt = 0;
+  unsigned int flags = 0;
   char *device;
   char **arg;
+  fosfat_t *fosfat;
   fosfat_disk_t type = FOSFAT_AD;
 
-  const char *const short_options = "adfhlitv";
+  const char *const short_options = "adfhlitvx";
 
   const struct option long_options[] = {
     { "harddisk",      no_argument, NULL, 'a' },
@@ -501,6 +90,7 @@ main (int argc, char **argv)
     { "image-bmp",     no_argument, NULL, 'i' },
     { "text",          no_argument, NULL, 't' },
     { "version",       no_argument, NULL, 'v' },
+    { "direct",        no_argument, NULL, 'x' },
     { NULL,            0,           NULL,  0  }
   };
 
@@ -532,10 +122,13 @@ main (int argc, char **argv)
       fosfat_logger (1);
       break;
     case 'i':           /* -i or --image-bmp */
-      g_bmp = 1;
+      bmp = 1;
       break ;
     case 't':           /* -t or --text */
-      g_txt = 1;
+      txt = 1;
+      break;
+    case 'x':           /* -x or --direct */
+      flags |= F_DIRECT;
       break;
     case -1:            /* end */
       break ;
@@ -550,7 +143,7 @@ main (int argc, char **argv)
   }
 
   /* table for fuse */
-  arg = malloc (sizeof (char *) * (3 + fusedebug + foslog));
+  arg = malloc (sizeof (char *) * (2 + fusedebug + foslog));
   if (arg)
   {
     arg[0] = strdup (argv[0]);
@@ -562,15 +155,12 @@ main (int argc, char **argv)
 
     device = strdup (argv[optind]);
     arg[1 + fusedebug + foslog] = strdup (argv[optind + 1]);
-
-    /* FUSE must be used as single-thread */
-    arg[2 + fusedebug + foslog] = strdup ("-s");
   }
   else
     return -1;
 
   /* Open the floppy disk (or hard disk) */
-  fosfat = fosfat_open (device, type, 0);
+  fosfat = fosfat_open (device, type, flags);
   if (!fosfat)
   {
     fprintf (stderr, "Could not open %s for mounting!\n", device);
@@ -579,13 +169,14 @@ main (int argc, char **argv)
   else
   {
     /* FUSE */
-    res = fuse_main (3 + fusedebug + foslog, arg, &fosfat_oper, NULL);
+    fosops_init (fosfat, bmp, txt);
+    res = fuse_main (2 + fusedebug + foslog, arg, &fosops_oper, NULL);
 
     /* Close the device */
     fosfat_close (fosfat);
   }
 
-  for (i = 0; i < 3 + fusedebug + foslog; i++)
+  for (i = 0; i < 2 + fusedebug + foslog; i++)
     free (*(arg + i));
   free (arg);
 
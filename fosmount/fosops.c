@@ -0,0 +1,550 @@
+/*
+ * FOS fosmount: FUSE operations for the Smaky file system
+ * Copyright (C) 2006-2010,2025 Mathieu Schroeter <mathieu@schroetersa.ch>
+ *
+ * Thanks to Pierre Arnaud for his help and the documentation
+ *    And to Epsitec SA for the Smaky computers
+ *
+ * This file is part of Fosfat.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>     /* strcmp strncmp strstr strlen strdup memcpy memset */
+#include <time.h>       /* mktime */
+
+#include "fosfat.h"
+#include "fosfat_internal.h"
+#include "fosgra.h"
+#include "fosops.h"
+
+/* Rights */
+#define FOS_DIR             0555
+#define FOS_FILE            0444
+
+static fosfat_t *fosfat = NULL;
+
+#define FLYID "@"
+
+static int g_bmp = 0;
+static int g_txt = 0;
+
+/* File opened by fos_open(), kept in fi->fh */
+typedef struct fos_file_s {
+  fosfat_fh_t   *fh;
+  char          *location;     /* Path without the conversion suffix    */
+  fosfat_file_t *stat;
+  size_t         length;       /* Size given by get_filesize()          */
+} fos_file_t;
+
+
+static char *
+trim_fosname (const char *path)
+{
+  char *it, res[256];
+
+  snprintf (res, sizeof (res), "%s", path);
+  it = strstr (res, "." FLYID ".");
+  if (it)
+    *it = '\0';
+
+  return strdup (res);
+}
+
+static size_t
+get_filesize (fosfat_file_t *file, const char *path)
+{
+  fosfat_ftype_t ftype = FOSFAT_FTYPE_OTHER;
+
+  if (file->att.isdir || file->att.islink || file->att.isencoded)
+    return file->size;
+
+  ftype = fosfat_ftype (file->name);
+
+  if (g_bmp && ftype == FOSFAT_FTYPE_IMAGE && fosgra_is_image (fosfat, path))
+    return fosgra_bmp_get_size (fosfat, path);
+
+  return file->size;
+}
+
+/*
+ * Read the data with the file handle if the file is opened.
+ */
+static int
+read_data (fosfat_fh_t *fh, const char *path,
+           off_t offset, size_t size, uint8_t *dst)
+{
+  if (fh)
+    return fosfat_fpread (fh, dst, size, offset);
+
+  return fosfat_read_into (fosfat, path, offset, size, dst);
+}
+
+static int
+read_buffer (fosfat_file_t *file, fosfat_fh_t *fh, const char *path,
+             off_t offset, size_t size, uint8_t *dst)
+{
+  int res;
+  fosfat_ftype_t ftype = FOSFAT_FTYPE_OTHER;
+
+  if (file->att.isdir || file->att.islink || file->att.isencoded)
+    goto std;
+
+  ftype = fosfat_ftype (file->name);
+
+  if (g_bmp && ftype == FOSFAT_FTYPE_IMAGE && fosgra_is_image (fosfat, path))
+  {
+    size_t image_size = 0;
+    uint8_t *image_buffer = fosgra_bmp_get_buffer (fosfat, path, &image_size);
+    if (!image_buffer)
+      return -1;
+    memcpy (dst, image_buffer + offset, size);
+    free (image_buffer);
+    return size;
+  }
+
+  if (g_txt && ftype == FOSFAT_FTYPE_TEXT)
+  {
+    res = read_data (fh, path, offset, size, dst);
+    if (res > 0)
+      fosfat_sma2iso8859 ((char *) dst, res, FOSFAT_ASCII_LF);
+    return res;
+  }
+
+std:
+  return read_data (fh, path, offset, size, dst);
+}
+
+/*
+ * Convert 'fosfat_file_t' to 'struct stat'.
+ */
+static void
+in_stat (fosfat_file_t *file, const char *path, struct stat *st)
+{
+  struct tm time;
+
+  memset (st, 0, sizeof (*st));
+  memset (&time, 0, sizeof (time));
+
+  /* Directory, symlink or file */
+  if (file->att.isdir)
+  {
+    st->st_mode = S_IFDIR | FOS_DIR;
+    st->st_nlink = 2;
+  }
+  else if (file->att.islink)
+  {
+    st->st_mode = S_IFLNK | FOS_DIR;
+    st->st_nlink = 2;
+  }
+  else
+  {
+    st->st_mode = S_IFREG | FOS_FILE;
+    st->st_nlink = 1;
+  }
+
+  /* Size */
+  st->st_size = get_filesize (file, path);
+
+  /* Time */
+  time.tm_year = file->time_r.year - 1900;
+  time.tm_mon  = file->time_r.month - 1;
+  time.tm_mday = file->time_r.day;
+  time.tm_hour = file->time_r.hour;
+  time.tm_min  = file->time_r.minute;
+  time.tm_sec  = file->time_r.second;
+  st->st_atime = mktime (&time);
+  time.tm_year = file->time_w.year - 1900;
+  time.tm_mon  = file->time_w.month - 1;
+  time.tm_mday = file->time_w.day;
+  time.tm_hour = file->time_w.hour;
+  time.tm_min  = file->time_w.minute;
+  time.tm_sec  = file->time_w.second;
+  st->st_mtime = mktime (&time);
+  time.tm_year = file->time_c.year - 1900;
+  time.tm_mon  = file->time_c.month - 1;
+  time.tm_mday = file->time_c.day;
+  time.tm_hour = file->time_c.hour;
+  time.tm_min  = file->time_c.minute;
+  time.tm_sec  = file->time_c.second;
+  st->st_ctime = mktime (&time);
+}
+
+/*
+ * Get the file stat from a path an return as struct stat.
+ */
+static struct stat *
+get_stat (const char *path)
+{
+  char *location;
+  struct stat *st = NULL;
+  fosfat_file_t *file;
+
+  location = trim_fosname (path);
+
+  file = fosfat_get_stat (fosfat, location);
+  if (file)
+  {
+    st = malloc (sizeof (struct stat));
+    if (st)
+      in_stat (file, location, st);
+    free (file);
+  }
+
+  if (location)
+    free (location);
+
+  return st;
+}
+
+/*
+ * FUSE : read the target of a symlink.
+ *
+ * path         (foo/bar)
+ * dst          target
+ * size         max length
+ * return 0 for success
+ */
+static int
+fos_readlink (const char *path, char *dst, size_t size)
+{
+  int res = -ENOENT;
+  char *link, *location;
+
+  FOSFAT_PROBE2 (fosmount, readlink__start, path, size);
+
+  location = trim_fosname (path);
+
+  link = fosfat_symlink (fosfat, location);
+
+  if (link && strlen (link) < size)
+  {
+    memcpy (dst, link, strlen (link) + 1);
+    res = 0;
+  }
+
+  if (link)
+    free (link);
+  if (location)
+    free (location);
+
+  FOSFAT_PROBE2 (fosmount, readlink__done, path, res);
+  return res;
+}
+
+/*
+ * FUSE : get attributes of a file.
+ *
+ * path         (foo/bar)
+ * stbuf        attributes
+ * return 0 for success
+ */
+static int
+fos_getattr (const char *path, struct stat *stbuf, struct fuse_file_info *fi)
+{
+  int ret = 0;
+  char *location;
+  struct stat *st;
+
+  (void) fi;
+
+  FOSFAT_PROBE1 (fosmount, getattr__start, path);
+
+  /* Root directory */
+  if (!strcmp (path, "/"))
+    location = strdup ("/sys_list");
+  else
+    location = trim_fosname (path);
+
+  /* Get file stats */
+  st = get_stat (location);
+  if (st)
+  {
+    memcpy (stbuf, st, sizeof (*stbuf));
+    free (st);
+  }
+  else
+    ret = -ENOENT;
+
+  if (location)
+    free (location);
+
+  FOSFAT_PROBE3 (fosmount, getattr__done, path, ret,
+                 ret ? 0 : stbuf->st_size);
+  return ret;
+}
+
+/*
+ * FUSE : read a directory.
+ *
+ * path         (foo/bar)
+ * buf          buffer for filler
+ * filler       function for put each entry
+ * offset       not used
+ * fi           not used
+ * return 0 for success
+ */
+static int
+fos_readdir (const char *path, void *buf, fuse_fill_dir_t filler,
+             off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags)
+{
+  int ret = -ENOENT;
+  int count = 0;
+  char *location;
+  fosfat_dir_t *dir;
+  fosfat_file_t file;
+
+  (void) offset;
+  (void) fi;
+  (void) flags;
+
+  FOSFAT_PROBE1 (fosmount, readdir__start, path);
+
+  location = trim_fosname (path);
+
+  /* First entries */
+  filler (buf, "..", NULL, 0, 0);
+
+  /* Files and directories */
+  dir = fosfat_opendir (fosfat, location);
+  if (!dir)
+    goto out;
+
+  while (fosfat_readdir (dir, &file))
+  {
+    char _path[256];
+    char name[FOSFAT_NAMELGT + sizeof (FLYID) + 5];
+    struct stat st;
+    fosfat_ftype_t ftype = FOSFAT_FTYPE_OTHER;
+
+    snprintf (_path, sizeof (_path), "%s/%s", location, file.name);
+    remove_dup_slashes (_path);
+    in_stat (&file, _path, &st);
+
+    ftype = fosfat_ftype (file.name);
+
+    /* add identification for .IMAGE and .COLOR translated to BMP */
+    if (g_bmp && ftype == FOSFAT_FTYPE_IMAGE && fosgra_is_image (fosfat, _path))
+      snprintf (name, sizeof (name), "%s." FLYID ".bmp", file.name);
+    /* add identification for text files translated to ISO-8859-1 */
+    else if (g_txt && ftype == FOSFAT_FTYPE_TEXT)
+      snprintf (name, sizeof (name), "%s." FLYID ".txt", file.name);
+    else
+      snprintf (name, sizeof (name), "%s", file.name);
+
+    if (strstr (name, ".dir"))
+      *(name + strlen (name) - 4) = '\0';
+
+    /* Add entry in the file list */
+    filler (buf, name, &st, 0, 0);
+    count++;
+  }
+
+  fosfat_closedir (dir);
+  ret = 0;
+
+ out:
+  if (location)
+    free (location);
+
+  FOSFAT_PROBE3 (fosmount, readdir__done, path, ret, count);
+  return ret;
+}
+
+/*
+ * FUSE : test if a file can be opened.
+ *
+ * The file handle, the attributes and the size (with the conversions)
+ * are kept for the reads, then the file is resolved only one time.
+ *
+ * path         (foo/bar)
+ * fi           flags
+ * return 0 for success
+ */
+static int
+fos_open (const char *path, struct fuse_file_info *fi)
+{
+  int ret = 0;
+  char *location;
+  fos_file_t *file = NULL;
+
+  FOSFAT_PROBE1 (fosmount, open__start, path);
+
+  location = trim_fosname (path);
+
+  if ((fi->flags & 3) != O_RDONLY)
+    ret = -EACCES;
+  else if (!fosfat_isopenexm (fosfat, location))
+    ret = -ENOENT;
+  else
+    file = calloc (1, sizeof (fos_file_t));
+
+  /* Without handle, the reads resolve the path (like before the open) */
+  fi->fh = 0;
+  if (file)
+  {
+    file->stat = fosfat_get_stat (fosfat, location);
+    if (file->stat)
+      file->fh = fosfat_fopen (fosfat, location);
+
+    if (file->fh)
+    {
+      file->length   = get_filesize (file->stat, location);
+      file->location = location;
+      location = NULL;
+      fi->fh = (uintptr_t) file;
+    }
+    else
+    {
+      if (file->stat)
+        free (file->stat);
+      free (file);
+    }
+  }
+
+  if (location)
+    free (location);
+
+  FOSFAT_PROBE2 (fosmount, open__done, path, ret);
+  return ret;
+}
+
+/*
+ * FUSE : release an opened file.
+ *
+ * path         not used
+ * fi           file handle
+ * return 0
+ */
+static int
+fos_release (const char *path, struct fuse_file_info *fi)
+{
+  fos_file_t *file = (fos_file_t *) (uintptr_t) fi->fh;
+
+  (void) path;
+
+  FOSFAT_PROBE1 (fosmount, release__start, path);
+
+  if (file)
+  {
+    fosfat_fclose (file->fh);
+    free (file->location);
+    free (file->stat);
+    free (file);
+  }
+  fi->fh = 0;
+
+  FOSFAT_PROBE2 (fosmount, release__done, path, 0);
+  return 0;
+}
+
+/*
+ * FUSE : read the data of a file.
+ *
+ * path         (foo/bar)
+ * buf          buffer for put the data
+ * size         size in bytes
+ * offset       offset in bytes
+ * fi           file handle
+ * return the size
+ */
+static int
+fos_read (const char *path, char *buf, size_t size,
+          off_t offset, struct fuse_file_info *fi)
+{
+  int res = -ENOENT;
+  int length;
+  char *location = NULL;
+  fosfat_file_t *file = NULL;
+  fos_file_t *opened = fi ? (fos_file_t *) (uintptr_t) fi->fh : NULL;
+  fosfat_fh_t *fh = NULL;
+
+  FOSFAT_PROBE3 (fosmount, read__start, path, size, offset);
+
+  /* The attributes and the size are resolved by fos_open() */
+  if (opened)
+  {
+    fh     = opened->fh;
+    file   = opened->stat;
+    length = opened->length;
+  }
+  else
+  {
+    location = trim_fosname (path);
+
+    /* Get the stats and test if it is a file */
+    file = fosfat_get_stat (fosfat, location);
+    if (!file)
+      goto out;
+
+    length = get_filesize (file, location);
+  }
+
+  if (file->att.isdir)
+    goto out;
+
+  if (offset < length)
+  {
+    /* Fix the size in function of the offset */
+    if (offset + (signed) size > length)
+      size = length - offset;
+
+    /* Read the data directly in the FUSE buffer */
+    res = read_buffer (file, fh, opened ? opened->location : location,
+                       offset, size, (uint8_t *) buf);
+    if (res < 0)
+      res = -ENOENT;
+  }
+  else
+    res = 0;
+
+ out:
+  if (file && !opened)
+    free (file);
+  if (location)
+    free (location);
+
+  FOSFAT_PROBE3 (fosmount, read__done, path, offset, res);
+  return res;
+}
+
+/* FUSE implemented functions */
+const struct fuse_operations fosops_oper = {
+  .getattr  = fos_getattr,
+  .readdir  = fos_readdir,
+  .open     = fos_open,
+  .read     = fos_read,
+  .release  = fos_release,
+  .readlink = fos_readlink,
+};
+
+/*
+ * Set the disk and the conversions used by the operations.
+ *
+ * fosfat       disk handle
+ * bmp          convert .IMAGE and .COLOR to .BMP
+ * txt          convert the text files to ISO-8859-1
+ */
+void
+fosops_init (fosfat_t *disk, int bmp, int txt)
+{
+  fosfat = disk;
+  g_bmp  = bmp;
+  g_txt  = txt;
+}
@@ -0,0 +1,34 @@
+/*
+ * FOS fosmount: FUSE operations for the Smaky file system
+ * Copyright (C) 2025 Mathieu Schroeter <mathieu@schroetersa.ch>
+ *
+ * This file is part of Fosfat.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FOSOPS_H
+#define FOSOPS_H
+
+#include <fuse.h>
+
+#include "fosfat.h"
+
+/* FUSE implemented functions, see fosops_init() */
+extern const struct fuse_operations fosops_oper;
+
+void fosops_init (fosfat_t *disk, int bmp, int txt);
+
+#endif /* FOSOPS_H */
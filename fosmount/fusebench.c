@@ -0,0 +1,865 @@
+/*
+ * FOS fusebench: benchmarks of the fosmount operations without mount
+ * Copyright (C) 2025 Mathieu Schroeter <mathieu@schroetersa.ch>
+ *
+ * This file is part of Fosfat.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "fosfat.h"
+#include "fosfat_internal.h"
+#include "fosops.h"
+#include "benchdev.h"
+
+#define HELP_TEXT \
+"Benchmarks of the fosmount operations without mount. fosfat-" LIBFOSFAT_VERSION_STR "\n\n" \
+"Usage: fusebench [options] [image]\n\n" \
+" -h --help             this help\n" \
+" -v --version          version\n" \
+" -j --json             print the results in JSON\n" \
+" -b --bench=LIST       comma-separated list of scenarios [all]\n" \
+" -n --count=N          reads for the random scenario [1000]\n" \
+" -z --chunk=N          bytes by random read [4096]\n" \
+" -r --seed=N           seed for the random reads [1]\n" \
+" -C --cache=N          size of the block cache (in blocks)\n" \
+" -m --memory           load the image in memory first\n" \
+" -i --image-bmp        convert .IMAGE and .COLOR to .BMP (like fosmount)\n" \
+" -t --text             convert some text files to .TXT (like fosmount)\n" \
+" -L --lazy             open the disk with F_LAZY\n" \
+" -P --parallel         open the disk with F_PARALLEL\n" \
+" -a --harddisk         generate a hard disk when no image is given\n" \
+" -l --fos-logger       that will turn on the FOS logger\n" \
+"\n" \
+"Scenarios: ls      (ls -lR of the tree)\n" \
+"           cp      (cp -r of the tree)\n" \
+"           rand    (random reads in the files)\n" \
+"           convert (reads of the .BMP and .TXT conversions, like -i -t)\n" \
+"\n" \
+"A new handle is opened for each scenario. Without image, a synthetic\n" \
+"image is generated (and removed at the end).\n" \
+"\nPlease, report bugs to <mathieu@schroetersa.ch>.\n"
+
+#define VERSION_TEXT "fusebench-" LIBFOSFAT_VERSION_STR "\n"
+
+/* Size of the reads by the kernel (max_read) */
+#define BENCH_READ (128 * 1024)
+
+typedef enum bench_op {
+  OP_GETATTR,
+  OP_READDIR,
+  OP_OPEN,
+  OP_READ,
+  OP_RELEASE,
+  OP_READLINK,
+  OP_LAST
+} bench_op_t;
+
+static const char *const g_opnames[OP_LAST] = {
+  [OP_GETATTR]  = "getattr",
+  [OP_READDIR]  = "readdir",
+  [OP_OPEN]     = "open",
+  [OP_READ]     = "read",
+  [OP_RELEASE]  = "release",
+  [OP_READLINK] = "readlink",
+};
+
+typedef struct counters_s {
+  uint64_t bytes;              /* Bytes read on the device              */
+  uint64_t reads;              /* Reads on the device                   */
+} counters_t;
+
+/* Statistics of one operation */
+typedef struct opstat_s {
+  unsigned long  count;
+  unsigned long  errors;
+  uint64_t       time;         /* Nanoseconds                           */
+  uint64_t      *lat;
+  unsigned long  max;
+  counters_t     counters;
+  uint64_t       data;         /* Bytes returned by read                */
+} opstat_t;
+
+typedef struct run_s {
+  const char *name;
+  uint64_t    time;            /* Nanoseconds                           */
+  counters_t  counters;
+  opstat_t    ops[OP_LAST];
+} run_t;
+
+/* Entry of a directory, added by the filler */
+typedef struct entry_s {
+  char   *name;
+  mode_t  mode;
+} entry_t;
+
+typedef struct entries_s {
+  entry_t      *items;
+  unsigned int  count;
+  unsigned int  max;
+} entries_t;
+
+/* Opened file of the random scenario */
+typedef struct file_s {
+  char                   *path;
+  off_t                   size;
+  int                     opened;
+  struct fuse_file_info   fi;
+} file_t;
+
+typedef struct files_s {
+  file_t       *items;
+  unsigned int  count;
+  unsigned int  max;
+} files_t;
+
+typedef struct scenario_s {
+  const char *name;
+  void (*run) (run_t *run);
+  int   bmp;                   /* Force the conversions                 */
+} scenario_t;
+
+static device_t g_dev;          /* Image read by all scenarios */
+static unsigned long g_count = 1000;
+static int g_chunk = 4096;
+static uint32_t g_seed = 1;
+
+
+/*
+ * Calls on the operations of fosmount, each call is measured.
+ */
+
+typedef struct probe_s {
+  uint64_t   time;
+  counters_t counters;
+} probe_t;
+
+static void
+probe_begin (probe_t *probe)
+{
+  device_counters (&g_dev, &probe->counters.bytes, &probe->counters.reads);
+  probe->time = now_ns ();
+}
+
+static void
+probe_end (run_t *run, bench_op_t op, const probe_t *probe, int res)
+{
+  opstat_t *stat = &run->ops[op];
+  uint64_t time = now_ns () - probe->time;
+  uint64_t bytes, reads;
+
+  device_counters (&g_dev, &bytes, &reads);
+
+  if (stat->count == stat->max)
+  {
+    unsigned long max = stat->max ? stat->max * 2 : 256;
+    uint64_t *lat = realloc (stat->lat, max * sizeof (*lat));
+    if (lat)
+    {
+      stat->lat = lat;
+      stat->max = max;
+    }
+  }
+
+  if (stat->count < stat->max)
+    stat->lat[stat->count] = time;
+
+  stat->count++;
+  stat->time += time;
+  stat->counters.bytes += bytes - probe->counters.bytes;
+  stat->counters.reads += reads - probe->counters.reads;
+  if (res < 0)
+    stat->errors++;
+}
+
+static int
+filler (void *buf, const char *name, const struct stat *st, off_t off,
+        enum fuse_fill_dir_flags flags)
+{
+  entries_t *list = buf;
+
+  (void) off;
+  (void) flags;
+
+  if (list->count == list->max)
+  {
+    unsigned int max = list->max ? list->max * 2 : 64;
+    entry_t *items = realloc (list->items, max * sizeof (*items));
+    if (!items)
+      return 1;
+    list->items = items;
+    list->max   = max;
+  }
+
+  list->items[list->count].name = strdup (name);
+  if (!list->items[list->count].name)
+    return 1;
+  list->items[list->count].mode = st ? st->st_mode : 0;
+  list->count++;
+  return 0;
+}
+
+static void
+entries_free (entries_t *list)
+{
+  unsigned int i;
+
+  for (i = 0; i < list->count; i++)
+    free (list->items[i].name);
+  free (list->items);
+  memset (list, 0, sizeof (*list));
+}
+
+static int
+do_getattr (run_t *run, const char *path, struct stat *st)
+{
+  probe_t probe;
+  int res;
+
+  probe_begin (&probe);
+  res = fosops_oper.getattr (path, st, NULL);
+  probe_end (run, OP_GETATTR, &probe, res);
+  return res;
+}
+
+static int
+do_readdir (run_t *run, const char *path, entries_t *list)
+{
+  probe_t probe;
+  int res;
+
+  probe_begin (&probe);
+  res = fosops_oper.readdir (path, list, filler, 0, NULL, 0);
+  probe_end (run, OP_READDIR, &probe, res);
+  return res;
+}
+
+static int
+do_open (run_t *run, const char *path, struct fuse_file_info *fi)
+{
+  probe_t probe;
+  int res;
+
+  memset (fi, 0, sizeof (*fi));
+  fi->flags = O_RDONLY;
+
+  probe_begin (&probe);
+  res = fosops_oper.open (path, fi);
+  probe_end (run, OP_OPEN, &probe, res);
+  return res;
+}
+
+static int
+do_read (run_t *run, const char *path, char *buf, size_t size, off_t offset,
+         struct fuse_file_info *fi)
+{
+  probe_t probe;
+  int res;
+
+  probe_begin (&probe);
+  res = fosops_oper.read (path, buf, size, offset, fi);
+  probe_end (run, OP_READ, &probe, res);
+  if (res > 0)
+    run->ops[OP_READ].data += res;
+  return res;
+}
+
+static int
+do_release (run_t *run, const char *path, struct fuse_file_info *fi)
+{
+  probe_t probe;
+  int res;
+
+  probe_begin (&probe);
+  res = fosops_oper.release (path, fi);
+  probe_end (run, OP_RELEASE, &probe, res);
+  return res;
+}
+
+static int
+do_readlink (run_t *run, const char *path)
+{
+  char target[BENCH_PATH];
+  probe_t probe;
+  int res;
+
+  probe_begin (&probe);
+  res = fosops_oper.readlink (path, target, sizeof (target));
+  probe_end (run, OP_READLINK, &probe, res);
+  return res;
+}
+
+static void
+join (char *dst, size_t size, const char *dir, const char *name)
+{
+  snprintf (dst, size, "%s/%s", strcmp (dir, "/") ? dir : "", name);
+}
+
+/* Read a whole file like cat or cp. */
+static void
+read_file (run_t *run, const char *path, char *buf)
+{
+  struct fuse_file_info fi;
+  off_t offset = 0;
+  int res;
+
+  if (do_open (run, path, &fi) < 0)
+    return;
+
+  do
+  {
+    res = do_read (run, path, buf, BENCH_READ, offset, &fi);
+    offset += res;
+  }
+  while (res == BENCH_READ);
+
+  do_release (run, path, &fi);
+}
+
+
+/*
+ * Scenarios.
+ */
+
+/* ls -lR: lstat of each entry, then the sub-directories. */
+static void
+ls_dir (run_t *run, const char *path)
+{
+  entries_t list;
+  struct stat st;
+  unsigned int i;
+
+  memset (&list, 0, sizeof (list));
+
+  if (do_getattr (run, path, &st) < 0 || do_readdir (run, path, &list) < 0)
+    goto out;
+
+  for (i = 0; i < list.count; i++)
+  {
+    char child[BENCH_PATH];
+
+    if (list.items[i].name[0] == '.')
+      continue;
+
+    join (child, sizeof (child), path, list.items[i].name);
+    if (do_getattr (run, child, &st) < 0)
+      continue;
+
+    list.items[i].mode = st.st_mode;
+    if (S_ISLNK (st.st_mode))
+      do_readlink (run, child);
+  }
+
+  for (i = 0; i < list.count; i++)
+  {
+    char child[BENCH_PATH];
+
+    if (list.items[i].name[0] == '.' || !S_ISDIR (list.items[i].mode))
+      continue;
+
+    join (child, sizeof (child), path, list.items[i].name);
+    ls_dir (run, child);
+  }
+
+ out:
+  entries_free (&list);
+}
+
+static void
+scenario_ls (run_t *run)
+{
+  ls_dir (run, "/");
+}
+
+/* cp -r: all files are read, the soft-links are copied as links. */
+static void
+cp_dir (run_t *run, const char *path, char *buf, const char *only)
+{
+  entries_t list;
+  struct stat st;
+  unsigned int i;
+
+  memset (&list, 0, sizeof (list));
+
+  if (do_readdir (run, path, &list) < 0)
+    goto out;
+
+  for (i = 0; i < list.count; i++)
+  {
+    char child[BENCH_PATH];
+    const char *name = list.items[i].name;
+
+    if (name[0] == '.')
+      continue;
+
+    join (child, sizeof (child), path, name);
+    if (do_getattr (run, child, &st) < 0)
+      continue;
+
+    if (S_ISDIR (st.st_mode))
+      cp_dir (run, child, buf, only);
+    else if (S_ISLNK (st.st_mode))
+    {
+      if (!only)
+        do_readlink (run, child);
+    }
+    else if (!only || strstr (name, only))
+      read_file (run, child, buf);
+  }
+
+ out:
+  entries_free (&list);
+}
+
+static void
+scenario_cp (run_t *run)
+{
+  char *buf = malloc (BENCH_READ);
+
+  if (!buf)
+    return;
+
+  cp_dir (run, "/", buf, NULL);
+  free (buf);
+}
+
+/* Only the files converted on the fly (the names with "@."). */
+static void
+scenario_convert (run_t *run)
+{
+  char *buf = malloc (BENCH_READ);
+
+  if (!buf)
+    return;
+
+  cp_dir (run, "/", buf, ".@.");
+  free (buf);
+}
+
+static void
+collect_files (run_t *run, const char *path, files_t *files)
+{
+  entries_t list;
+  unsigned int i;
+
+  memset (&list, 0, sizeof (list));
+
+  if (do_readdir (run, path, &list) < 0)
+    goto out;
+
+  for (i = 0; i < list.count; i++)
+  {
+    char child[BENCH_PATH];
+    struct stat st;
+
+    if (list.items[i].name[0] == '.')
+      continue;
+
+    join (child, sizeof (child), path, list.items[i].name);
+    if (do_getattr (run, child, &st) < 0)
+      continue;
+
+    if (S_ISDIR (st.st_mode))
+      collect_files (run, child, files);
+    else if (S_ISREG (st.st_mode) && st.st_size > 0)
+    {
+      if (files->count == files->max)
+      {
+        unsigned int max = files->max ? files->max * 2 : 64;
+        file_t *items = realloc (files->items, max * sizeof (*items));
+        if (!items)
+          break;
+        files->items = items;
+        files->max   = max;
+      }
+
+      memset (&files->items[files->count], 0, sizeof (file_t));
+      files->items[files->count].path = strdup (child);
+      files->items[files->count].size = st.st_size;
+      if (files->items[files->count].path)
+        files->count++;
+    }
+  }
+
+ out:
+  entries_free (&list);
+}
+
+/* Random reads in the files, each file is opened by the first read. */
+static void
+scenario_rand (run_t *run)
+{
+  files_t files;
+  uint32_t rnd = g_seed;
+  unsigned long i;
+  unsigned int j;
+  char *buf;
+
+  memset (&files, 0, sizeof (files));
+
+  buf = malloc (g_chunk);
+  if (!buf)
+    return;
+
+  collect_files (run, "/", &files);
+  if (!files.count)
+    goto out;
+
+  for (i = 0; i < g_count; i++)
+  {
+    file_t *file = &files.items[bench_rand (&rnd) % files.count];
+    off_t offset;
+
+    if (!file->opened)
+    {
+      if (do_open (run, file->path, &file->fi) < 0)
+        continue;
+      file->opened = 1;
+    }
+
+    offset = bench_rand (&rnd) % file->size;
+    offset -= offset % g_chunk;
+    do_read (run, file->path, buf, g_chunk, offset, &file->fi);
+  }
+
+  for (j = 0; j < files.count; j++)
+    if (files.items[j].opened)
+      do_release (run, files.items[j].path, &files.items[j].fi);
+
+ out:
+  for (j = 0; j < files.count; j++)
+    free (files.items[j].path);
+  free (files.items);
+  free (buf);
+}
+
+static const scenario_t g_scenarios[] = {
+  { "ls",      scenario_ls,      0 },
+  { "cp",      scenario_cp,      0 },
+  { "rand",    scenario_rand,    0 },
+  { "convert", scenario_convert, 1 },
+};
+
+
+/*
+ * Reports.
+ */
+
+static int
+cmp_u64 (const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *) a;
+  uint64_t y = *(const uint64_t *) b;
+  return x < y ? -1 : x > y;
+}
+
+static double
+percentile (opstat_t *stat, int pct)
+{
+  unsigned long count = MIN (stat->count, stat->max);
+
+  if (!count)
+    return 0;
+  return stat->lat[(count - 1) * pct / 100] / 1000.0;
+}
+
+static void
+report_run (run_t *run, int json, int first)
+{
+  int op, firstop = 1;
+
+  if (!json)
+    printf ("%s (%.3f s, %" PRIu64 " bytes in %" PRIu64 " reads on the device)\n",
+            run->name, run->time / 1e9, run->counters.bytes,
+            run->counters.reads);
+  else
+  {
+    printf ("%s\n    {\n", first ? "" : ",");
+    printf ("      \"name\": \"%s\",\n", run->name);
+    printf ("      \"seconds\": %.6f,\n", run->time / 1e9);
+    printf ("      \"bytes_read\": %" PRIu64 ",\n", run->counters.bytes);
+    printf ("      \"device_reads\": %" PRIu64 ",\n", run->counters.reads);
+    printf ("      \"ops\": [");
+  }
+
+  for (op = 0; op < OP_LAST; op++)
+  {
+    opstat_t *stat = &run->ops[op];
+    double count = stat->count;
+
+    if (!stat->count)
+      continue;
+
+    qsort (stat->lat, MIN (stat->count, stat->max), sizeof (*stat->lat),
+           cmp_u64);
+
+    if (!json)
+    {
+      printf ("  %-9s %8lu %10.2f %10.2f %10.2f %10.0f %9.2f %7lu\n",
+              g_opnames[op], stat->count, stat->time / count / 1000.0,
+              percentile (stat, 50), percentile (stat, 99),
+              stat->counters.bytes / count, stat->counters.reads / count,
+              stat->errors);
+      continue;
+    }
+
+    printf ("%s\n        {\n", firstop ? "" : ",");
+    printf ("          \"op\": \"%s\",\n", g_opnames[op]);
+    printf ("          \"count\": %lu,\n", stat->count);
+    printf ("          \"errors\": %lu,\n", stat->errors);
+    printf ("          \"mean_us\": %.3f,\n", stat->time / count / 1000.0);
+    printf ("          \"p50_us\": %.3f,\n", percentile (stat, 50));
+    printf ("          \"p99_us\": %.3f,\n", percentile (stat, 99));
+    printf ("          \"bytes_read\": %" PRIu64 ",\n", stat->counters.bytes);
+    printf ("          \"device_reads\": %" PRIu64 ",\n",
+            stat->counters.reads);
+    printf ("          \"data\": %" PRIu64 "\n", stat->data);
+    printf ("        }");
+    firstop = 0;
+  }
+
+  if (json)
+    printf ("%s]\n    }", firstop ? "" : "\n      ");
+  else
+    printf ("\n");
+}
+
+static void
+print_info (void)
+{
+  printf (HELP_TEXT);
+}
+
+static void
+print_version (void)
+{
+  printf (VERSION_TEXT);
+}
+
+int
+main (int argc, char **argv)
+{
+  int json = 0, memory = 0, bmp = 0, txt = 0, first = 1, next_option;
+  unsigned int flag = 0, cache = 0, i;
+  unsigned long errors = 0;
+  const char *list = NULL, *image;
+  char generated[BENCH_PATH] = { 0 };
+  fosfat_gen_t gen;
+
+  const char *const short_options = "ab:C:hijlLmn:Pr:tvz:";
+
+  const struct option long_options[] = {
+    { "help",       no_argument,       NULL, 'h' },
+    { "version",    no_argument,       NULL, 'v' },
+    { "json",       no_argument,       NULL, 'j' },
+    { "bench",      required_argument, NULL, 'b' },
+    { "count",      required_argument, NULL, 'n' },
+    { "chunk",      required_argument, NULL, 'z' },
+    { "seed",       required_argument, NULL, 'r' },
+    { "cache",      required_argument, NULL, 'C' },
+    { "memory",     no_argument,       NULL, 'm' },
+    { "image-bmp",  no_argument,       NULL, 'i' },
+    { "text",       no_argument,       NULL, 't' },
+    { "lazy",       no_argument,       NULL, 'L' },
+    { "parallel",   no_argument,       NULL, 'P' },
+    { "harddisk",   no_argument,       NULL, 'a' },
+    { "fos-logger", no_argument,       NULL, 'l' },
+    { NULL,         0,                 NULL,  0  }
+  };
+
+  fosfat_gen_defaults (&gen);
+
+  /* check options */
+  do
+  {
+    next_option = getopt_long (argc, argv, short_options, long_options, NULL);
+    switch (next_option)
+    {
+    default :           /* unknown */
+    case '?':           /* invalid option */
+    case 'h':           /* -h or --help */
+      print_info ();
+      return -1;
+    case 'v':           /* -v or --version */
+      print_version ();
+      return -1;
+    case 'j':           /* -j or --json */
+      json = 1;
+      break;
+    case 'b':           /* -b or --bench */
+      list = optarg;
+      break;
+    case 'n':           /* -n or --count */
+      g_count = strtoul (optarg, NULL, 0);
+      break;
+    case 'z':           /* -z or --chunk */
+      g_chunk = atoi (optarg);
+      break;
+    case 'r':           /* -r or --seed */
+      g_seed = (uint32_t) strtoul (optarg, NULL, 0);
+      break;
+    case 'C':           /* -C or --cache */
+      cache = (unsigned int) strtoul (optarg, NULL, 0);
+      break;
+    case 'm':           /* -m or --memory */
+      memory = 1;
+      break;
+    case 'i':           /* -i or --image-bmp */
+      bmp = 1;
+      break;
+    case 't':           /* -t or --text */
+      txt = 1;
+      break;
+    case 'L':           /* -L or --lazy */
+      flag |= F_LAZY;
+      break;
+    case 'P':           /* -P or --parallel */
+      flag |= F_PARALLEL;
+      break;
+    case 'a':           /* -a or --harddisk */
+      gen.disk = FOSFAT_HD;
+      break;
+    case 'l':           /* -l or --fos-logger */
+      fosfat_logger (1);
+      break;
+    case -1:            /* end */
+      break;
+    }
+  } while (next_option != -1);
+
+  if (g_chunk <= 0)
+  {
+    print_info ();
+    return -1;
+  }
+
+  if (!g_seed)
+    g_seed = 1;
+
+  if (argc > optind)
+    image = argv[optind];
+  else
+  {
+    fosfat_gen_info_t info;
+
+    gen.seed = g_seed;
+    if (!tmp_file (generated, sizeof (generated), "fusebench")
+        || !fosfat_gen_image (generated, &gen, &info))
+    {
+      fprintf (stderr, "The image cannot be generated\n");
+      if (*generated)
+        unlink (generated);
+      return -1;
+    }
+
+    image = generated;
+  }
+
+  if (!device_open (&g_dev, image, memory))
+  {
+    fprintf (stderr, "The image \"%s\" cannot be read\n", image);
+    if (*generated)
+      unlink (generated);
+    return -1;
+  }
+
+  if (json)
+  {
+    printf ("{\n  \"version\": \"%s\",\n  \"image\": ", LIBFOSFAT_VERSION_STR);
+    json_string (image);
+    printf (",\n  \"size\": %" PRIu64 ",\n", g_dev.size);
+    printf ("  \"memory\": %s,\n", memory ? "true" : "false");
+    printf ("  \"scenarios\": [");
+  }
+  else
+  {
+    printf ("Image \"%s\" (%.1f MiB)\n\n",
+            image, g_dev.size / 1024.0 / 1024.0);
+    printf ("  %-9s %8s %10s %10s %10s %10s %9s %7s\n",
+            "op", "count", "mean (us)", "p50 (us)", "p99 (us)",
+            "bytes/op", "reads/op", "errors");
+  }
+
+  for (i = 0; i < countof (g_scenarios); i++)
+  {
+    const scenario_t *scenario = &g_scenarios[i];
+    fosfat_t *fosfat;
+    counters_t start, end;
+    run_t run;
+    int op;
+
+    if (!selected (list, scenario->name))
+      continue;
+
+    /* Like a new mount */
+    fosfat = fosfat_open_backend (&backend_device, &g_dev, FOSFAT_AD, flag);
+    if (!fosfat)
+    {
+      fprintf (stderr, "The image \"%s\" cannot be opened\n", image);
+      errors++;
+      break;
+    }
+
+    if (cache)
+      fosfat_blkcache_size (fosfat, cache);
+
+    if (scenario->bmp)
+      fosops_init (fosfat, 1, 1);
+    else
+      fosops_init (fosfat, bmp, txt);
+
+    memset (&run, 0, sizeof (run));
+    run.name = scenario->name;
+
+    device_counters (&g_dev, &start.bytes, &start.reads);
+    run.time = now_ns ();
+    scenario->run (&run);
+    run.time = now_ns () - run.time;
+    device_counters (&g_dev, &end.bytes, &end.reads);
+    run.counters.bytes = end.bytes - start.bytes;
+    run.counters.reads = end.reads - start.reads;
+
+    fosops_init (NULL, 0, 0);
+    fosfat_close (fosfat);
+
+    report_run (&run, json, first);
+    first = 0;
+
+    for (op = 0; op < OP_LAST; op++)
+    {
+      errors += run.ops[op].errors;
+      free (run.ops[op].lat);
+    }
+  }
+
+  if (json)
+    printf ("%s]\n}\n", first ? "" : "\n  ");
+
+  device_close (&g_dev);
+  if (*generated)
+    unlink (generated);
+
+  return errors ? 1 : 0;
+}
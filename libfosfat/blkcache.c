@@ -0,0 +1,311 @@
+/*
+ * FOS libfosfat: API for Smaky file system
+ * Copyright (C) 2025 Mathieu Schroeter <mathieu@schroetersa.ch>
+ *
+ * This file is part of Fosfat.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "fosfat.h"
+#include "fosfat_internal.h"
+
+#define BLKCACHE_NIL          UINT32_MAX
+
+/*
+ * The block cache is a bounded LRU of raw 256 bytes blocks. The entries
+ * are preallocated in a table and are linked by their indexes, then no
+ * allocation is done when a block is inserted or evicted.
+ *
+ * Even a get changes the LRU list, then all accesses are serialized by
+ * the mutex of the cache.
+ */
+
+/* Entry in the block cache */
+typedef struct blkcache_entry_s {
+  uint32_t key;                /* Absolute block's number               */
+  uint32_t prev;               /* Previous entry in the LRU list        */
+  uint32_t next;               /* Next entry in the LRU list            */
+  uint32_t hnext;              /* Next entry in the hash bucket         */
+} blkcache_entry_t;
+
+/* Main block cache structure */
+struct blkcache_s {
+  unsigned int      size;      /* Number of entries                     */
+  unsigned int      used;      /* Number of entries in use              */
+  uint32_t          mask;      /* Mask for the hash buckets             */
+  uint32_t         *buckets;   /* Hash buckets (first entry)            */
+  blkcache_entry_t *entries;   /* All entries                           */
+  uint8_t          *data;      /* Blocks (size * FOSFAT_BLK bytes)      */
+  uint32_t          head;      /* Most recently used                    */
+  uint32_t          tail;      /* Least recently used                   */
+  unsigned long     hits;      /* Blocks served by the cache            */
+  unsigned long     misses;    /* Blocks not found in the cache         */
+  fosfat_mutex_t    mutex;     /* Lock for all accesses                 */
+};
+
+
+static inline uint32_t
+blkcache_hash (fosfat_blkcache_t *cache, uint32_t key)
+{
+  return (key * 2654435761U) & cache->mask;
+}
+
+static void
+blkcache_unlink (fosfat_blkcache_t *cache, uint32_t idx)
+{
+  blkcache_entry_t *e = &cache->entries[idx];
+
+  if (e->prev != BLKCACHE_NIL)
+    cache->entries[e->prev].next = e->next;
+  else
+    cache->head = e->next;
+
+  if (e->next != BLKCACHE_NIL)
+    cache->entries[e->next].prev = e->prev;
+  else
+    cache->tail = e->prev;
+}
+
+static void
+blkcache_push_front (fosfat_blkcache_t *cache, uint32_t idx)
+{
+  blkcache_entry_t *e = &cache->entries[idx];
+
+  e->prev = BLKCACHE_NIL;
+  e->next = cache->head;
+
+  if (cache->head != BLKCACHE_NIL)
+    cache->entries[cache->head].prev = idx;
+  cache->head = idx;
+
+  if (cache->tail == BLKCACHE_NIL)
+    cache->tail = idx;
+}
+
+static void
+blkcache_hash_remove (fosfat_blkcache_t *cache, uint32_t idx)
+{
+  uint32_t *it = &cache->buckets[blkcache_hash (cache, cache->entries[idx].key)];
+
+  while (*it != BLKCACHE_NIL)
+  {
+    if (*it == idx)
+    {
+      *it = cache->entries[idx].hnext;
+      return;
+    }
+    it = &cache->entries[*it].hnext;
+  }
+}
+
+static uint32_t
+blkcache_lookup (fosfat_blkcache_t *cache, uint32_t key)
+{
+  uint32_t idx = cache->buckets[blkcache_hash (cache, key)];
+
+  while (idx != BLKCACHE_NIL && cache->entries[idx].key != key)
+    idx = cache->entries[idx].hnext;
+
+  return idx;
+}
+
+/*
+ * Create a new block cache.
+ *
+ * size         number of blocks in the cache
+ * return the cache or NULL if size is 0 or on error
+ */
+fosfat_blkcache_t *
+fosfat_blkcache_new (unsigned int size)
+{
+  unsigned int i, nbuckets = 1;
+  fosfat_blkcache_t *cache;
+
+  if (!size)
+    return NULL;
+
+  cache = calloc (1, sizeof (fosfat_blkcache_t));
+  if (!cache)
+    return NULL;
+
+  while (nbuckets < size)
+    nbuckets <<= 1;
+
+  fosfat_mutex_init (&cache->mutex);
+
+  cache->size    = size;
+  cache->mask    = nbuckets - 1;
+  cache->head    = BLKCACHE_NIL;
+  cache->tail    = BLKCACHE_NIL;
+  cache->buckets = malloc (nbuckets * sizeof (*cache->buckets));
+  cache->entries = malloc (size * sizeof (*cache->entries));
+  cache->data    = malloc ((size_t) size * FOSFAT_BLK);
+
+  if (!cache->buckets || !cache->entries || !cache->data)
+  {
+    fosfat_blkcache_free (cache);
+    return NULL;
+  }
+
+  for (i = 0; i < nbuckets; i++)
+    cache->buckets[i] = BLKCACHE_NIL;
+
+  return cache;
+}
+
+/*
+ * Release the block cache.
+ *
+ * cache        the block cache
+ */
+void
+fosfat_blkcache_free (fosfat_blkcache_t *cache)
+{
+  if (!cache)
+    return;
+
+  fosfat_mutex_destroy (&cache->mutex);
+  free (cache->buckets);
+  free (cache->entries);
+  free (cache->data);
+  free (cache);
+}
+
+/*
+ * Get a block from the cache.
+ *
+ * The block becomes the most recently used.
+ *
+ * cache        the block cache
+ * key          absolute block's number
+ * data         where to copy the 256 bytes
+ * return a boolean (true if the block was in the cache)
+ */
+int
+fosfat_blkcache_get (fosfat_blkcache_t *cache, uint32_t key, void *data)
+{
+  uint32_t idx;
+
+  if (!cache)
+    return 0;
+
+  fosfat_mutex_lock (&cache->mutex);
+
+  idx = blkcache_lookup (cache, key);
+  if (idx == BLKCACHE_NIL)
+  {
+    cache->misses++;
+    fosfat_mutex_unlock (&cache->mutex);
+    return 0;
+  }
+
+  cache->hits++;
+  memcpy (data, cache->data + (size_t) idx * FOSFAT_BLK, FOSFAT_BLK);
+
+  if (cache->head != idx)
+  {
+    blkcache_unlink (cache, idx);
+    blkcache_push_front (cache, idx);
+  }
+
+  fosfat_mutex_unlock (&cache->mutex);
+  return 1;
+}
+
+/*
+ * Put a block in the cache.
+ *
+ * When the cache is full, the least recently used block is evicted.
+ *
+ * cache        the block cache
+ * key          absolute block's number
+ * data         the 256 bytes
+ */
+void
+fosfat_blkcache_put (fosfat_blkcache_t *cache, uint32_t key, const void *data)
+{
+  uint32_t idx, b;
+
+  if (!cache)
+    return;
+
+  fosfat_mutex_lock (&cache->mutex);
+
+  idx = blkcache_lookup (cache, key);
+  if (idx != BLKCACHE_NIL)
+    blkcache_unlink (cache, idx);
+  else
+  {
+    if (cache->used < cache->size)
+      idx = cache->used++;
+    else
+    {
+      /* Evict the least recently used */
+      idx = cache->tail;
+      blkcache_unlink (cache, idx);
+      blkcache_hash_remove (cache, idx);
+    }
+
+    b = blkcache_hash (cache, key);
+    cache->entries[idx].key   = key;
+    cache->entries[idx].hnext = cache->buckets[b];
+    cache->buckets[b] = idx;
+  }
+
+  memcpy (cache->data + (size_t) idx * FOSFAT_BLK, data, FOSFAT_BLK);
+  blkcache_push_front (cache, idx);
+
+  fosfat_mutex_unlock (&cache->mutex);
+}
+
+/*
+ * Get the counters of the block cache.
+ *
+ * cache        the block cache
+ * hits         number of blocks served by the cache
+ * misses       number of blocks not found in the cache
+ */
+void
+fosfat_blkcache_counters (fosfat_blkcache_t *cache,
+                          unsigned long *hits, unsigned long *misses)
+{
+  if (cache)
+    fosfat_mutex_lock (&cache->mutex);
+
+  if (hits)
+    *hits = cache ? cache->hits : 0;
+  if (misses)
+    *misses = cache ? cache->misses : 0;
+
+  if (cache)
+    fosfat_mutex_unlock (&cache->mutex);
+}
+
+/*
+ * Get the size of the cache.
+ *
+ * cache        the block cache
+ * return the number of blocks (0 if there is no cache)
+ */
+unsigned int
+fosfat_blkcache_blocks (fosfat_blkcache_t *cache)
+{
+  return cache ? cache->size : 0;
+}
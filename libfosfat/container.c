@@ -0,0 +1,615 @@
+/*
+ * FOS libfosfat: API for Smaky file system
+ * Copyright (C) 2025 Mathieu Schroeter <mathieu@schroetersa.ch>
+ *
+ * This file is part of Fosfat.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#ifdef HAVE_ZLIB_H
+#include <zlib.h>
+#endif /* HAVE_ZLIB_H */
+
+#include "fosfat.h"
+#include "fosfat_internal.h"
+
+/*
+ * Compressed container
+ * ~~~~~~~~~~~~~~~~~~~~
+ * A container keeps a disk image in chunks of a fixed size which are
+ * compressed independently, then a block can be read without to inflate
+ * the whole image. The file is in little-endian:
+ *
+ *  | header (40 bytes) | chunks | index (count * 16 bytes) |
+ *
+ * Each entry of the index gives the offset and the size of a chunk in the
+ * container and how it is stored:
+ *
+ *  - CONTAINER_ZERO: the chunk is only zeros and nothing is stored;
+ *  - CONTAINER_RAW : the chunk is stored as is (not compressible);
+ *  - CONTAINER_ZLIB: the chunk is compressed with zlib.
+ *
+ * The last chunk can be shorter. The index is written at the end, then
+ * the image can be compressed in one pass. The most recently inflated
+ * chunks are kept in a small LRU cache.
+ *
+ * Without zlib, only the zero and raw chunks are supported (the writer
+ * does not compress and the reader fails on a compressed chunk).
+ */
+
+#define CONTAINER_MAGIC       "FOSZ"
+#define CONTAINER_VERSION     1
+#define CONTAINER_HEADER      40
+#define CONTAINER_ENTRY       16
+#define CONTAINER_CHUNK_MIN   FOSFAT_BLK
+#define CONTAINER_CHUNK_MAX   (16 * 1024 * 1024)
+#define CONTAINER_CACHE       16
+
+#define CONTAINER_ZERO        0
+#define CONTAINER_RAW         1
+#define CONTAINER_ZLIB        2
+
+/* One chunk of the index */
+typedef struct container_entry_s {
+  uint64_t offset;             /* Address in the container              */
+  uint32_t csize;              /* Stored size                           */
+  uint32_t type;               /* CONTAINER_ZERO, RAW or ZLIB           */
+} container_entry_t;
+
+/* One inflated chunk */
+typedef struct container_slot_s {
+  int64_t        chunk;        /* Index of the chunk or -1              */
+  unsigned long  tick;         /* Last use                              */
+  uint8_t       *data;         /* Inflated data                         */
+} container_slot_t;
+
+/* Opened container */
+typedef struct container_s {
+  fosfat_io_t       *raw;      /* The container file                    */
+  uint32_t           chunk;    /* Size of a chunk                       */
+  uint32_t           count;    /* Number of chunks                      */
+  uint64_t           size;     /* Size of the image                     */
+  container_entry_t *index;    /* Chunks                                */
+  container_slot_t   slots[CONTAINER_CACHE]; /* Inflated chunks         */
+  uint8_t           *cbuf;     /* Buffer for a compressed chunk         */
+  unsigned long      tick;     /* Clock for the LRU                     */
+  fosfat_mutex_t     mutex;    /* Lock for the slots and cbuf           */
+} container_t;
+
+/* Container in writing */
+struct container_writer_s {
+  FILE              *fp;       /* Destination                           */
+  uint32_t           chunk;    /* Size of a chunk                       */
+  uint8_t           *buf;      /* Current chunk                         */
+  uint32_t           fill;     /* Bytes in the current chunk            */
+  uint8_t           *cbuf;     /* Compressed chunk                      */
+  size_t             cmax;     /* Size of cbuf                          */
+  uint64_t           size;     /* Size of the image                     */
+  uint64_t           offset;   /* Next address in the container         */
+  container_entry_t *index;    /* Chunks already written                */
+  uint32_t           count;    /* Number of chunks                      */
+  uint32_t           alloc;    /* Allocated entries                     */
+  int                error;    /* A write has failed                    */
+};
+
+
+static void
+put_le32 (uint8_t *it, uint32_t v)
+{
+  it[0] = v;
+  it[1] = v >> 8;
+  it[2] = v >> 16;
+  it[3] = v >> 24;
+}
+
+static void
+put_le64 (uint8_t *it, uint64_t v)
+{
+  put_le32 (it, (uint32_t) v);
+  put_le32 (it + 4, (uint32_t) (v >> 32));
+}
+
+static uint32_t
+get_le32 (const uint8_t *it)
+{
+  return it[0] | it[1] << 8 | it[2] << 16 | (uint32_t) it[3] << 24;
+}
+
+static uint64_t
+get_le64 (const uint8_t *it)
+{
+  return get_le32 (it) | (uint64_t) get_le32 (it + 4) << 32;
+}
+
+static int
+iszero (const uint8_t *data, size_t size)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    if (data[i])
+      return 0;
+
+  return 1;
+}
+
+/*
+ * Load a chunk in a slot of the cache.
+ *
+ * The mutex must be locked.
+ *
+ * c            the container
+ * chunk        index of the chunk
+ * return the slot or NULL on error
+ */
+static container_slot_t *
+container_chunk (container_t *c, uint32_t chunk)
+{
+  unsigned int i;
+  container_slot_t *slot = &c->slots[0];
+  const container_entry_t *entry = &c->index[chunk];
+  uint32_t len =
+    (uint32_t) MIN (c->chunk, c->size - (uint64_t) chunk * c->chunk);
+
+  c->tick++;
+
+  for (i = 0; i < CONTAINER_CACHE; i++)
+  {
+    if (c->slots[i].chunk == chunk)
+    {
+      c->slots[i].tick = c->tick;
+      return &c->slots[i];
+    }
+
+    if (c->slots[i].tick < slot->tick)
+      slot = &c->slots[i];
+  }
+
+  if (!slot->data)
+  {
+    slot->data = malloc (c->chunk);
+    if (!slot->data)
+      return NULL;
+  }
+
+  slot->chunk = -1;
+
+  switch (entry->type)
+  {
+  case CONTAINER_RAW:
+    if (entry->csize != len
+        || !fosfat_io_read (c->raw, entry->offset, slot->data, len))
+      return NULL;
+    break;
+
+#ifdef HAVE_ZLIB_H
+  case CONTAINER_ZLIB:
+  {
+    uLongf dlen = len;
+
+    /* A compressed chunk is always smaller */
+    if (entry->csize >= len
+        || !fosfat_io_read (c->raw, entry->offset, c->cbuf, entry->csize)
+        || uncompress (slot->data, &dlen, c->cbuf, entry->csize) != Z_OK
+        || dlen != len)
+    {
+      foslog (FOSLOG_ERROR, "chunk %"PRIu32" of the container is corrupted",
+              chunk);
+      return NULL;
+    }
+    break;
+  }
+#endif /* HAVE_ZLIB_H */
+
+  default:
+    foslog (FOSLOG_ERROR, "chunk %"PRIu32" of the container is not "
+            "supported (type %"PRIu32")", chunk, entry->type);
+    return NULL;
+  }
+
+  slot->chunk = chunk;
+  slot->tick  = c->tick;
+  return slot;
+}
+
+static int
+container_read (void *data, uint64_t offset, void *buf, size_t size)
+{
+  container_t *c = data;
+  uint8_t *it = buf;
+
+  if (offset > c->size || size > c->size - offset)
+    return 0;
+
+  while (size)
+  {
+    uint32_t chunk = (uint32_t) (offset / c->chunk);
+    uint32_t in    = (uint32_t) (offset % c->chunk);
+    size_t   len   = MIN (size, (size_t) (c->chunk - in));
+
+    if (c->index[chunk].type == CONTAINER_ZERO)
+      memset (it, 0, len);
+    else
+    {
+      container_slot_t *slot;
+
+      fosfat_mutex_lock (&c->mutex);
+      slot = container_chunk (c, chunk);
+      if (slot)
+        memcpy (it, slot->data + in, len);
+      fosfat_mutex_unlock (&c->mutex);
+
+      if (!slot)
+        return 0;
+    }
+
+    it     += len;
+    offset += len;
+    size   -= len;
+  }
+
+  return 1;
+}
+
+static uint64_t
+container_size (void *data)
+{
+  container_t *c = data;
+  return c->size;
+}
+
+static void
+container_close (void *data)
+{
+  unsigned int i;
+  container_t *c = data;
+
+  for (i = 0; i < CONTAINER_CACHE; i++)
+    free (c->slots[i].data);
+
+  fosfat_io_close (c->raw);
+  fosfat_mutex_destroy (&c->mutex);
+  free (c->cbuf);
+  free (c->index);
+  free (c);
+}
+
+static const fosfat_backend_t backend_container = {
+  .read  = container_read,
+  .size  = container_size,
+  .close = container_close,
+};
+
+/*
+ * Test if a device is a container.
+ *
+ * io           the device
+ * return a boolean
+ */
+int
+fosfat_container_probe (fosfat_io_t *io)
+{
+  char magic[4];
+
+  return fosfat_io_read (io, 0, magic, sizeof (magic))
+         && !memcmp (magic, CONTAINER_MAGIC, sizeof (magic));
+}
+
+/*
+ * Open a container.
+ *
+ * The device of the container is owned by the new handle; it is closed
+ * on error.
+ *
+ * raw          the container file
+ * return the handle on the image or NULL on error
+ */
+fosfat_io_t *
+fosfat_container_open (fosfat_io_t *raw)
+{
+  uint32_t i;
+  uint64_t indexoff, chk;
+  uint8_t header[CONTAINER_HEADER];
+  uint8_t *index = NULL;
+  container_t *c;
+
+  c = calloc (1, sizeof (container_t));
+  if (!c)
+    goto err;
+
+  if (!fosfat_io_read (raw, 0, header, sizeof (header))
+      || memcmp (header, CONTAINER_MAGIC, 4))
+    goto err;
+
+  if (get_le32 (header + 4) != CONTAINER_VERSION)
+  {
+    foslog (FOSLOG_ERROR, "version %"PRIu32" of the container is not "
+            "supported", get_le32 (header + 4));
+    goto err;
+  }
+
+  c->chunk  = get_le32 (header + 8);
+  c->count  = get_le32 (header + 12);
+  c->size   = get_le64 (header + 16);
+  indexoff  = get_le64 (header + 24);
+  chk       = get_le64 (header + 32);
+
+  if (c->chunk < CONTAINER_CHUNK_MIN || c->chunk > CONTAINER_CHUNK_MAX
+      || c->count != (c->size + c->chunk - 1) / c->chunk)
+    goto corrupted;
+
+  index    = malloc ((size_t) c->count * CONTAINER_ENTRY + 1);
+  c->index = calloc (c->count + 1, sizeof (container_entry_t));
+  c->cbuf  = malloc (c->chunk);
+  if (!index || !c->index || !c->cbuf)
+    goto err;
+
+  if (!fosfat_io_read (raw, indexoff, index,
+                       (size_t) c->count * CONTAINER_ENTRY)
+      || fosfat_checksum (index, (size_t) c->count * CONTAINER_ENTRY) != chk)
+    goto corrupted;
+
+  for (i = 0; i < c->count; i++)
+  {
+    const uint8_t *it = index + (size_t) i * CONTAINER_ENTRY;
+
+    c->index[i].offset = get_le64 (it);
+    c->index[i].csize  = get_le32 (it + 8);
+    c->index[i].type   = get_le32 (it + 12);
+  }
+
+  for (i = 0; i < CONTAINER_CACHE; i++)
+    c->slots[i].chunk = -1;
+
+  free (index);
+  c->raw = raw;
+  fosfat_mutex_init (&c->mutex);
+
+  foslog (FOSLOG_NOTICE, "compressed container: %"PRIu32" chunks of "
+          "%"PRIu32" bytes", c->count, c->chunk);
+
+  return fosfat_io_backend (&backend_container, c);
+
+ corrupted:
+  foslog (FOSLOG_ERROR, "the container is corrupted");
+ err:
+  if (c)
+  {
+    free (c->cbuf);
+    free (c->index);
+  }
+  free (index);
+  free (c);
+  fosfat_io_close (raw);
+  return NULL;
+}
+
+/*
+ * Write the current chunk.
+ *
+ * w            the writer
+ * return a boolean
+ */
+static int
+container_flush (fosfat_cwriter_t *w)
+{
+  container_entry_t *entry;
+  const uint8_t *out = w->buf;
+
+  if (!w->fill)
+    return 1;
+
+  if (w->count == w->alloc)
+  {
+    uint32_t alloc = w->alloc ? w->alloc * 2 : 64;
+    container_entry_t *index =
+      realloc (w->index, alloc * sizeof (container_entry_t));
+
+    if (!index)
+      return 0;
+
+    w->index = index;
+    w->alloc = alloc;
+  }
+
+  entry = &w->index[w->count];
+  entry->offset = w->offset;
+  entry->csize  = w->fill;
+  entry->type   = CONTAINER_RAW;
+
+  if (iszero (w->buf, w->fill))
+  {
+    entry->csize = 0;
+    entry->type  = CONTAINER_ZERO;
+  }
+#ifdef HAVE_ZLIB_H
+  else
+  {
+    uLongf clen = (uLongf) w->cmax;
+
+    /* Stored as is when it is not smaller */
+    if (compress2 (w->cbuf, &clen, w->buf, w->fill, Z_BEST_COMPRESSION) == Z_OK
+        && clen < w->fill)
+    {
+      entry->csize = (uint32_t) clen;
+      entry->type  = CONTAINER_ZLIB;
+      out = w->cbuf;
+    }
+  }
+#endif /* HAVE_ZLIB_H */
+
+  if (entry->csize && fwrite (out, 1, entry->csize, w->fp) != entry->csize)
+    return 0;
+
+  w->offset += entry->csize;
+  w->count++;
+  w->fill = 0;
+  return 1;
+}
+
+/*
+ * Create a container.
+ *
+ * chunk        size of a chunk (0 for FOSFAT_CONTAINER_CHUNK)
+ * file         location of the container (overwritten)
+ * return the writer or NULL on error
+ */
+fosfat_cwriter_t *
+fosfat_container_create (const char *file, uint32_t chunk)
+{
+  static const uint8_t header[CONTAINER_HEADER];
+  fosfat_cwriter_t *w;
+
+  if (!chunk)
+    chunk = FOSFAT_CONTAINER_CHUNK;
+
+  if (!file || chunk < CONTAINER_CHUNK_MIN || chunk > CONTAINER_CHUNK_MAX)
+    return NULL;
+
+  w = calloc (1, sizeof (fosfat_cwriter_t));
+  if (!w)
+    return NULL;
+
+  w->chunk = chunk;
+  w->buf   = malloc (chunk);
+#ifdef HAVE_ZLIB_H
+  w->cmax  = compressBound (chunk);
+  w->cbuf  = malloc (w->cmax);
+  if (!w->cbuf)
+    goto err;
+#endif /* HAVE_ZLIB_H */
+  if (!w->buf)
+    goto err;
+
+  w->fp = fopen (file, "wb");
+  if (!w->fp)
+    goto err;
+
+  /* The header is written with the index */
+  if (fwrite (header, 1, sizeof (header), w->fp) != sizeof (header))
+  {
+    fclose (w->fp);
+    goto err;
+  }
+
+  w->offset = sizeof (header);
+  return w;
+
+ err:
+  free (w->cbuf);
+  free (w->buf);
+  free (w);
+  return NULL;
+}
+
+/*
+ * Append bytes of the image.
+ *
+ * w            the writer
+ * data         the bytes
+ * size         number of bytes
+ * return a boolean
+ */
+int
+fosfat_container_write (fosfat_cwriter_t *w, const void *data, size_t size)
+{
+  const uint8_t *it = data;
+
+  if (!w || w->error)
+    return 0;
+
+  while (size)
+  {
+    size_t len = MIN (size, (size_t) (w->chunk - w->fill));
+
+    memcpy (w->buf + w->fill, it, len);
+    w->fill += (uint32_t) len;
+    w->size += len;
+    it      += len;
+    size    -= len;
+
+    if (w->fill == w->chunk && !container_flush (w))
+    {
+      w->error = 1;
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/*
+ * Write the index and close the container.
+ *
+ * w            the writer
+ * return a boolean (false if a write has failed)
+ */
+int
+fosfat_container_close (fosfat_cwriter_t *w)
+{
+  uint32_t i;
+  uint8_t header[CONTAINER_HEADER];
+  uint8_t *index = NULL;
+  size_t isize;
+  int res = 0;
+
+  if (!w)
+    return 0;
+
+  if (w->error || !container_flush (w))
+    goto out;
+
+  isize = (size_t) w->count * CONTAINER_ENTRY;
+  index = malloc (isize + 1);
+  if (!index)
+    goto out;
+
+  for (i = 0; i < w->count; i++)
+  {
+    uint8_t *it = index + (size_t) i * CONTAINER_ENTRY;
+
+    put_le64 (it,      w->index[i].offset);
+    put_le32 (it + 8,  w->index[i].csize);
+    put_le32 (it + 12, w->index[i].type);
+  }
+
+  memcpy (header, CONTAINER_MAGIC, 4);
+  put_le32 (header + 4,  CONTAINER_VERSION);
+  put_le32 (header + 8,  w->chunk);
+  put_le32 (header + 12, w->count);
+  put_le64 (header + 16, w->size);
+  put_le64 (header + 24, w->offset);
+  put_le64 (header + 32, fosfat_checksum (index, isize));
+
+  res = fwrite (index, 1, isize, w->fp) == isize
+        && !fseek (w->fp, 0, SEEK_SET)
+        && fwrite (header, 1, sizeof (header), w->fp) == sizeof (header);
+
+ out:
+  if (fclose (w->fp))
+    res = 0;
+  free (index);
+  free (w->index);
+  free (w->cbuf);
+  free (w->buf);
+  free (w);
+  return res;
+}
@@ -0,0 +1,1038 @@
+/*
+ * FOS libfosfat: API for Smaky file system
+ * Copyright (C) 2025 Mathieu Schroeter <mathieu@schroetersa.ch>
+ *
+ * This file is part of Fosfat.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#ifdef _WIN32
+#include <w32disk.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif /* !_WIN32 */
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#if defined (__NR_io_uring_setup) && defined (__NR_io_uring_enter)
+#define HAVE_IO_URING
+#endif
+#endif /* HAVE_LINUX_IO_URING_H */
+
+#include "fosfat.h"
+#include "fosfat_internal.h"
+
+/*
+ * Device I/O
+ * ~~~~~~~~~~
+ * All reads on a device (or an image) are positional. Nothing is shared
+ * between two reads (no file position), then the same handle can be used
+ * for concurrent reads.
+ *
+ * POSIX  : pread (2) on a file descriptor, or a read-only mmap (2) of the
+ *          whole image where a read is only a memcpy.
+ * Linux  : like POSIX but the batches are submitted at once in an io_uring
+ *          and they are completed in any order.
+ * Direct : O_DIRECT on the file descriptor. The reads are done by aligned
+ *          windows in aligned buffers (from a small pool) and only the
+ *          useful part is copied. Nothing is kept in the page cache.
+ * Window$: stdio for the files and the w32disk library for the devices.
+ *          A seek and a read are not atomic, then the reads are
+ *          serialized by a mutex.
+ * User   : the functions of a fosfat_backend_t (an image in memory, ...).
+ *
+ * A compressed container (see container.c) is detected with the open and
+ * it is read through a user backend on top of the device.
+ *
+ * A backend without batch support reads the requests one by one.
+ */
+
+/* Backend operations */
+typedef struct io_ops_s {
+  int  (*read)  (fosfat_io_t *io, uint64_t offset, void *buf, size_t size);
+  int  (*batch) (fosfat_io_t *io, const fosfat_io_req_t *reqs,
+                 unsigned int count);
+  void (*close) (fosfat_io_t *io);
+} io_ops_t;
+
+#ifdef O_DIRECT
+
+#define DIRECT_ALIGN          4096
+#define DIRECT_WINDOW         (64 * 1024)
+#define DIRECT_POOL           8
+
+/* Aligned buffers for O_DIRECT */
+typedef struct direct_s {
+  uint8_t        *pool[DIRECT_POOL]; /* Free windows                    */
+  unsigned int    count;       /* Number of free windows                */
+  int             disabled;    /* O_DIRECT removed (1), or failed (-1)  */
+  fosfat_mutex_t  mutex;       /* Lock for the pool                     */
+} direct_t;
+
+#endif /* O_DIRECT */
+
+#ifdef HAVE_IO_URING
+
+#define URING_ENTRIES         64
+
+/* Rings shared with the kernel */
+typedef struct uring_s {
+  int                  fd;     /* Ring's file descriptor                */
+  unsigned int         entries; /* Number of SQE                        */
+  uint8_t             *sq_map; /* Submission ring                       */
+  size_t               sq_size;
+  uint8_t             *cq_map; /* Completion ring (can be sq_map)       */
+  size_t               cq_size;
+  struct io_uring_sqe *sqes;   /* Submission entries                    */
+  size_t               sqes_size;
+  unsigned int        *sq_head;
+  unsigned int        *sq_tail;
+  unsigned int        *sq_mask;
+  unsigned int        *sq_array;
+  unsigned int        *cq_head;
+  unsigned int        *cq_tail;
+  unsigned int        *cq_mask;
+  struct io_uring_cqe *cqes;
+  fosfat_mutex_t       mutex;  /* Only one batch at a time              */
+  int                  broken; /* io_uring_enter has failed, use pread  */
+} uring_t;
+
+#endif /* HAVE_IO_URING */
+
+/* Main device I/O structure */
+struct fosfat_io_s {
+  const io_ops_t *ops;         /* Backend                               */
+#ifdef _WIN32
+  FILE           *fp;          /* Image file                            */
+  w32disk_t      *disk;        /* Physical device                       */
+  fosfat_mutex_t  mutex;       /* Lock for seek + read                  */
+#else
+  int             fd;          /* File descriptor                       */
+  uint8_t        *map;         /* Image mapped in memory                */
+#endif /* !_WIN32 */
+#ifdef HAVE_IO_URING
+  uring_t        *uring;       /* Ring for the batches                  */
+#endif /* HAVE_IO_URING */
+#ifdef O_DIRECT
+  direct_t       *direct;      /* Aligned buffers for O_DIRECT          */
+#endif /* O_DIRECT */
+  fosfat_backend_t user;       /* Functions of a user backend           */
+  void           *data;        /* User data for the backend             */
+  uint64_t        size;        /* Size of the device (if known)         */
+  fosfat_blkcache_t *blkcache; /* Cache for the blocks around the reads */
+  uint64_t        bytes;       /* Bytes read (statistics)               */
+  uint64_t        syscalls;    /* System calls for the reads            */
+};
+
+
+static int
+io_user_read (fosfat_io_t *io, uint64_t offset, void *buf, size_t size)
+{
+  int res;
+
+  fosfat_stats_add (io->syscalls, 1);
+  res = io->user.read (io->data, offset, buf, size);
+  if (res)
+    fosfat_stats_add (io->bytes, size);
+
+  return res;
+}
+
+static void
+io_user_close (fosfat_io_t *io)
+{
+  if (io->user.close)
+    io->user.close (io->data);
+}
+
+static const io_ops_t io_user = {
+  .read  = io_user_read,
+  .close = io_user_close,
+};
+
+static int
+memory_read (void *data, uint64_t offset, void *buf, size_t size)
+{
+  const fosfat_memory_t *mem = data;
+
+  if (!mem->buf || offset > mem->size || size > mem->size - offset)
+    return 0;
+
+  memcpy (buf, mem->buf + offset, size);
+  return 1;
+}
+
+static uint64_t
+memory_size (void *data)
+{
+  const fosfat_memory_t *mem = data;
+  return mem->size;
+}
+
+static const fosfat_backend_t backend_memory = {
+  .read  = memory_read,
+  .size  = memory_size,
+};
+
+#ifdef _WIN32
+
+static int
+io_stdio_read (fosfat_io_t *io, uint64_t offset, void *buf, size_t size)
+{
+  int res = 0;
+
+  fosfat_stats_add (io->syscalls, 1);
+
+  fosfat_mutex_lock (&io->mutex);
+  if (!fseeko64 (io->fp, (off64_t) offset, SEEK_SET))
+    res = fread (buf, 1, size, io->fp) == size;
+  fosfat_mutex_unlock (&io->mutex);
+
+  if (res)
+    fosfat_stats_add (io->bytes, size);
+
+  return res;
+}
+
+static void
+io_stdio_close (fosfat_io_t *io)
+{
+  fclose (io->fp);
+}
+
+/*
+ * The devices are read by sectors (512 bytes with Window$). The sectors
+ * which are covering the range are read and only the useful part is
+ * copied.
+ */
+static int
+io_w32disk_read (fosfat_io_t *io, uint64_t offset, void *buf, size_t size)
+{
+  int read;
+  size_t ssize, csector;
+  uint64_t sector;
+  uint8_t *buffer;
+
+  ssize = w32disk_sectorsize (io->disk);
+  if (!ssize)
+    return 0;
+
+  sector  = offset / ssize;
+  csector = (size_t) ((offset % ssize + size + ssize - 1) / ssize);
+
+  buffer = calloc (1, csector * ssize);
+  if (!buffer)
+    return 0;
+
+  fosfat_stats_add (io->syscalls, 1);
+
+  fosfat_mutex_lock (&io->mutex);
+  read = w32disk_readsectors (io->disk, buffer,
+                              (unsigned long int) sector, csector);
+  fosfat_mutex_unlock (&io->mutex);
+  if (read)
+  {
+    fosfat_stats_add (io->bytes, csector * ssize);
+    memcpy (buf, buffer + offset % ssize, size);
+  }
+
+  free (buffer);
+  return read;
+}
+
+static void
+io_w32disk_close (fosfat_io_t *io)
+{
+  w32disk_free (io->disk);
+}
+
+static const io_ops_t io_stdio = {
+  .read  = io_stdio_read,
+  .batch = NULL,
+  .close = io_stdio_close,
+};
+
+static const io_ops_t io_w32disk = {
+  .read  = io_w32disk_read,
+  .batch = NULL,
+  .close = io_w32disk_close,
+};
+
+#else
+
+static int
+io_pread_read (fosfat_io_t *io, uint64_t offset, void *buf, size_t size)
+{
+  uint8_t *it = buf;
+
+  while (size)
+  {
+    ssize_t res;
+
+    fosfat_stats_add (io->syscalls, 1);
+    res = pread (io->fd, it, size, (off_t) offset);
+    if (res < 0 && errno == EINTR)
+      continue;
+    if (res <= 0)
+      return 0;
+
+    fosfat_stats_add (io->bytes, res);
+    it     += res;
+    offset += res;
+    size   -= res;
+  }
+
+  return 1;
+}
+
+static void
+io_pread_close (fosfat_io_t *io)
+{
+  close (io->fd);
+}
+
+static int
+io_mmap_read (fosfat_io_t *io, uint64_t offset, void *buf, size_t size)
+{
+  if (offset > io->size || size > io->size - offset)
+    return 0;
+
+  fosfat_stats_add (io->bytes, size);
+  memcpy (buf, io->map + offset, size);
+  return 1;
+}
+
+static void
+io_mmap_close (fosfat_io_t *io)
+{
+  munmap (io->map, (size_t) io->size);
+  close (io->fd);
+}
+
+#ifdef O_DIRECT
+
+static uint8_t *
+direct_get (direct_t *direct)
+{
+  void *buf = NULL;
+
+  fosfat_mutex_lock (&direct->mutex);
+  if (direct->count)
+    buf = direct->pool[--direct->count];
+  fosfat_mutex_unlock (&direct->mutex);
+
+  if (!buf && posix_memalign (&buf, DIRECT_ALIGN, DIRECT_WINDOW))
+    return NULL;
+
+  return buf;
+}
+
+static void
+direct_put (direct_t *direct, uint8_t *buf)
+{
+  fosfat_mutex_lock (&direct->mutex);
+  if (direct->count < DIRECT_POOL)
+  {
+    direct->pool[direct->count++] = buf;
+    buf = NULL;
+  }
+  fosfat_mutex_unlock (&direct->mutex);
+
+  free (buf);
+}
+
+/*
+ * Some file systems are accepting O_DIRECT with open but not with the
+ * reads. Then the flag is removed and the aligned reads are going through
+ * the page cache. The flag is removed only once, but all threads which got
+ * EINVAL can retry their read when it has worked.
+ */
+static int
+direct_disable (fosfat_io_t *io)
+{
+  int res;
+
+  fosfat_mutex_lock (&io->direct->mutex);
+  if (!io->direct->disabled)
+  {
+    int flags = fcntl (io->fd, F_GETFL);
+
+    io->direct->disabled =
+      flags >= 0 && !fcntl (io->fd, F_SETFL, flags & ~O_DIRECT) ? 1 : -1;
+    if (io->direct->disabled > 0)
+      foslog (FOSLOG_WARNING, "O_DIRECT is refused, the page cache is used");
+  }
+  res = io->direct->disabled > 0;
+  fosfat_mutex_unlock (&io->direct->mutex);
+
+  return res;
+}
+
+/*
+ * Put in the block cache the blocks of a window which are not copied for
+ * the caller. The blocks around a tranche (BD, BL or DATA) are often read
+ * just after.
+ *
+ * io           handle
+ * start        offset of the window on the device
+ * window       the window
+ * in           offset of the first byte copied for the caller
+ * need         end of the bytes copied for the caller
+ * got          bytes read in the window
+ */
+static void
+direct_keep (fosfat_io_t *io, uint64_t start, const uint8_t *window,
+             size_t in, size_t need, size_t got)
+{
+  size_t b;
+
+  if (!io->blkcache)
+    return;
+
+  for (b = 0; b + FOSFAT_BLK <= got; b += FOSFAT_BLK)
+    if (b + FOSFAT_BLK <= in || b >= need)
+      fosfat_blkcache_put (io->blkcache,
+                           (uint32_t) ((start + b) / FOSFAT_BLK), window + b);
+}
+
+static int
+io_direct_read (fosfat_io_t *io, uint64_t offset, void *buf, size_t size)
+{
+  int res = 1;
+  uint8_t *it = buf;
+  uint8_t *window;
+
+  window = direct_get (io->direct);
+  if (!window)
+    return 0;
+
+  while (res && size)
+  {
+    uint64_t start = offset & ~((uint64_t) DIRECT_ALIGN - 1);
+    size_t in   = (size_t) (offset - start);
+    size_t len  = MIN (DIRECT_WINDOW,
+                       (in + size + DIRECT_ALIGN - 1) & ~(DIRECT_ALIGN - 1));
+    size_t need = MIN (len, in + size);
+    size_t got  = 0;
+
+    /* The window can be cut by the end of the device */
+    while (got < need)
+    {
+      ssize_t r;
+
+      fosfat_stats_add (io->syscalls, 1);
+      r = pread (io->fd, window + got, len - got, (off_t) (start + got));
+      if (r < 0 && (errno == EINTR || (errno == EINVAL && direct_disable (io))))
+        continue;
+      if (r <= 0)
+      {
+        res = 0;
+        break;
+      }
+      fosfat_stats_add (io->bytes, r);
+      got += (size_t) r;
+    }
+
+    if (!res)
+      break;
+
+    memcpy (it, window + in, need - in);
+    direct_keep (io, start, window, in, need, got);
+    it     += need - in;
+    offset += need - in;
+    size   -= need - in;
+  }
+
+  direct_put (io->direct, window);
+  return res;
+}
+
+static void
+io_direct_close (fosfat_io_t *io)
+{
+  while (io->direct->count)
+    free (io->direct->pool[--io->direct->count]);
+
+  fosfat_mutex_destroy (&io->direct->mutex);
+  free (io->direct);
+  close (io->fd);
+}
+
+static const io_ops_t io_direct = {
+  .read  = io_direct_read,
+  .batch = NULL,
+  .close = io_direct_close,
+};
+
+#endif /* O_DIRECT */
+
+static const io_ops_t io_pread = {
+  .read  = io_pread_read,
+  .batch = NULL,
+  .close = io_pread_close,
+};
+
+static const io_ops_t io_mmap = {
+  .read  = io_mmap_read,
+  .batch = NULL,
+  .close = io_mmap_close,
+};
+
+#endif /* !_WIN32 */
+
+#ifdef HAVE_IO_URING
+
+static void
+uring_free (uring_t *ring)
+{
+  if (ring->sqes)
+    munmap (ring->sqes, ring->sqes_size);
+  if (ring->cq_map && ring->cq_map != ring->sq_map)
+    munmap (ring->cq_map, ring->cq_size);
+  if (ring->sq_map)
+    munmap (ring->sq_map, ring->sq_size);
+
+  close (ring->fd);
+  fosfat_mutex_destroy (&ring->mutex);
+  free (ring);
+}
+
+/*
+ * Create the rings with the raw syscalls (no liburing).
+ *
+ * entries      number of submission entries
+ * return the rings or NULL if io_uring is not available
+ */
+static uring_t *
+uring_new (unsigned int entries)
+{
+  void *map;
+  uring_t *ring;
+  struct io_uring_params p;
+
+  ring = calloc (1, sizeof (uring_t));
+  if (!ring)
+    return NULL;
+
+  memset (&p, 0, sizeof (p));
+  ring->fd = (int) syscall (__NR_io_uring_setup, entries, &p);
+  if (ring->fd < 0)
+  {
+    free (ring);
+    return NULL;
+  }
+
+  fosfat_mutex_init (&ring->mutex);
+
+  ring->entries   = p.sq_entries;
+  ring->sq_size   = p.sq_off.array + p.sq_entries * sizeof (unsigned int);
+  ring->cq_size   = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+  ring->sqes_size = p.sq_entries * sizeof (struct io_uring_sqe);
+
+  /* Both rings are in the same mapping with the recent kernels */
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    ring->sq_size = ring->cq_size = MAX (ring->sq_size, ring->cq_size);
+
+  map = mmap (NULL, ring->sq_size, PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  if (map == MAP_FAILED)
+    goto err;
+  ring->sq_map = map;
+
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    ring->cq_map = ring->sq_map;
+  else
+  {
+    map = mmap (NULL, ring->cq_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    if (map == MAP_FAILED)
+      goto err;
+    ring->cq_map = map;
+  }
+
+  map = mmap (NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  if (map == MAP_FAILED)
+    goto err;
+  ring->sqes = map;
+
+  ring->sq_head  = (unsigned int *) (ring->sq_map + p.sq_off.head);
+  ring->sq_tail  = (unsigned int *) (ring->sq_map + p.sq_off.tail);
+  ring->sq_mask  = (unsigned int *) (ring->sq_map + p.sq_off.ring_mask);
+  ring->sq_array = (unsigned int *) (ring->sq_map + p.sq_off.array);
+  ring->cq_head  = (unsigned int *) (ring->cq_map + p.cq_off.head);
+  ring->cq_tail  = (unsigned int *) (ring->cq_map + p.cq_off.tail);
+  ring->cq_mask  = (unsigned int *) (ring->cq_map + p.cq_off.ring_mask);
+  ring->cqes     = (struct io_uring_cqe *) (ring->cq_map + p.cq_off.cqes);
+
+  return ring;
+
+ err:
+  uring_free (ring);
+  return NULL;
+}
+
+/*
+ * Withdraw the submission entries not yet consumed by the kernel.
+ *
+ * Without SQPOLL, the kernel reads the submission ring only in
+ * io_uring_enter, then the tail can be moved back to the head while the
+ * lock is held.
+ *
+ * ring         the rings
+ * tail         tail before the submission of the group
+ * return the number of entries consumed (in flight or completed)
+ */
+static unsigned int
+uring_withdraw (uring_t *ring, unsigned int tail)
+{
+  unsigned int head = __atomic_load_n (ring->sq_head, __ATOMIC_ACQUIRE);
+
+  __atomic_store_n (ring->sq_tail, head, __ATOMIC_RELEASE);
+  return head - tail;
+}
+
+/*
+ * Submit the requests and wait for all completions.
+ *
+ * The requests are submitted by groups of the ring's size. A short read
+ * (or an operation not supported by an old kernel) is completed with
+ * pread. When io_uring_enter fails, the entries not consumed are withdrawn
+ * and all requests in flight are waited, because the kernel writes in the
+ * buffers of the caller. Then the ring is no longer used and the next
+ * batches are read with pread.
+ */
+static int
+io_uring_batch (fosfat_io_t *io, const fosfat_io_req_t *reqs,
+                unsigned int count)
+{
+  int res = 1;
+  unsigned int done = 0;
+  uring_t *ring = io->uring;
+
+  fosfat_mutex_lock (&ring->mutex);
+
+  if (ring->broken)
+  {
+    fosfat_mutex_unlock (&ring->mutex);
+
+    for (; res && done < count; done++)
+      res = io_pread_read (io, reqs[done].offset, reqs[done].buf,
+                           reqs[done].size);
+    return res;
+  }
+
+  while (res && done < count)
+  {
+    unsigned int i, reaped = 0;
+    unsigned int n = MIN (count - done, ring->entries);
+    unsigned int tail = *ring->sq_tail;
+
+    for (i = 0; i < n; i++)
+    {
+      unsigned int idx = (tail + i) & *ring->sq_mask;
+      struct io_uring_sqe *sqe = &ring->sqes[idx];
+      const fosfat_io_req_t *req = &reqs[done + i];
+
+      memset (sqe, 0, sizeof (*sqe));
+      sqe->opcode    = IORING_OP_READ;
+      sqe->fd        = io->fd;
+      sqe->addr      = (uint64_t) (uintptr_t) req->buf;
+      sqe->len       = (uint32_t) req->size;
+      sqe->off       = req->offset;
+      sqe->user_data = done + i;
+      ring->sq_array[idx] = idx;
+    }
+
+    __atomic_store_n (ring->sq_tail, tail + n, __ATOMIC_RELEASE);
+
+    /* On failure, n is only the number of requests in flight */
+    while (reaped < n)
+    {
+      unsigned int head = *ring->cq_head;
+      unsigned int ctail = __atomic_load_n (ring->cq_tail, __ATOMIC_ACQUIRE);
+      unsigned int submit = tail + n
+                            - __atomic_load_n (ring->sq_head, __ATOMIC_ACQUIRE);
+
+      /* Completions in any order */
+      for (; head != ctail; head++)
+      {
+        const struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        const fosfat_io_req_t *req;
+        size_t got = cqe->res > 0 ? (size_t) cqe->res : 0;
+
+        /* A stale completion is not for this group (then not in reqs) */
+        if (cqe->user_data < done || cqe->user_data >= done + n)
+        {
+          foslog (FOSLOG_WARNING, "unexpected io_uring completion");
+          continue;
+        }
+
+        req = &reqs[cqe->user_data];
+        reaped++;
+        fosfat_stats_add (io->bytes, got);
+
+        if (got < req->size
+            && !io_pread_read (io, req->offset + got,
+                               (uint8_t *) req->buf + got, req->size - got))
+          res = 0;
+      }
+
+      __atomic_store_n (ring->cq_head, head, __ATOMIC_RELEASE);
+
+      if (reaped >= n)
+        break;
+
+      fosfat_stats_add (io->syscalls, 1);
+      if (syscall (__NR_io_uring_enter, ring->fd, submit, 1,
+                   IORING_ENTER_GETEVENTS, NULL, 0) < 0
+          && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+      {
+        if (!ring->broken)
+          foslog (FOSLOG_ERROR, "io_uring_enter has failed (%s)",
+                  strerror (errno));
+        ring->broken = 1;
+        res = 0;
+
+        /* Wait only the requests already consumed by the kernel */
+        n = uring_withdraw (ring, tail);
+      }
+    }
+
+    done += n;
+  }
+
+  fosfat_mutex_unlock (&ring->mutex);
+  return res;
+}
+
+static void
+io_uring_close (fosfat_io_t *io)
+{
+  uring_free (io->uring);
+  close (io->fd);
+}
+
+static const io_ops_t io_uring = {
+  .read  = io_pread_read,
+  .batch = io_uring_batch,
+  .close = io_uring_close,
+};
+
+#endif /* HAVE_IO_URING */
+
+/*
+ * Open a device or an image.
+ *
+ * With Window$, a location of only one char is a drive letter ('a' for the
+ * diskette, 'c' for the first hard disk, etc,...).
+ *
+ * dev          device or location
+ * flag         F_MMAP to map the whole image in memory (POSIX only),
+ *              F_URING to submit the batches in an io_uring (Linux only),
+ *              F_DIRECT to bypass the page cache (POSIX only)
+ * return the handle or NULL on error
+ */
+fosfat_io_t *
+fosfat_io_open (const char *dev, unsigned int flag)
+{
+  fosfat_io_t *io;
+
+  if (!dev)
+    return NULL;
+
+  io = calloc (1, sizeof (fosfat_io_t));
+  if (!io)
+    return NULL;
+
+#ifdef _WIN32
+  (void) flag;
+
+  if (strlen (dev) > 1)
+  {
+    io->fp = fopen (dev, "rb");
+    io->ops = &io_stdio;
+  }
+  else
+  {
+    io->disk = w32disk_new (*dev - 'a');
+    io->ops = &io_w32disk;
+  }
+
+  if (!io->fp && !io->disk)
+    goto err;
+
+  fosfat_mutex_init (&io->mutex);
+#else
+  io->ops = &io_pread;
+
+  /* The direct I/O excludes the mapping and the io_uring */
+  if (flag & F_DIRECT)
+  {
+#ifdef O_DIRECT
+    io->direct = calloc (1, sizeof (direct_t));
+    io->fd = io->direct ? open (dev, O_RDONLY | O_DIRECT) : -1;
+    if (io->fd >= 0)
+    {
+      fosfat_mutex_init (&io->direct->mutex);
+      io->ops = &io_direct;
+      flag &= ~(F_MMAP | F_URING);
+    }
+    else
+    {
+      free (io->direct);
+      io->direct = NULL;
+    }
+#endif /* O_DIRECT */
+    if (io->ops != &io_direct)
+      foslog (FOSLOG_WARNING, "%s cannot be opened with O_DIRECT", dev);
+  }
+
+  if (io->ops != &io_direct)
+    io->fd = open (dev, O_RDONLY);
+  if (io->fd < 0)
+    goto err;
+
+  if (flag & F_MMAP)
+  {
+    off_t size = lseek (io->fd, 0, SEEK_END);
+    void *map = size > 0
+                ? mmap (NULL, (size_t) size, PROT_READ, MAP_SHARED, io->fd, 0)
+                : MAP_FAILED;
+
+    if (map != MAP_FAILED)
+    {
+      io->map  = map;
+      io->size = (uint64_t) size;
+      io->ops  = &io_mmap;
+    }
+    else
+      foslog (FOSLOG_WARNING, "%s cannot be mapped, pread is used", dev);
+  }
+
+  /* A mapped image has nothing to wait */
+  if ((flag & F_URING) && io->ops == &io_pread)
+  {
+#ifdef HAVE_IO_URING
+    io->uring = uring_new (URING_ENTRIES);
+    if (io->uring)
+      io->ops = &io_uring;
+    else
+#endif /* HAVE_IO_URING */
+      foslog (FOSLOG_WARNING, "io_uring is not available, pread is used");
+  }
+#endif /* !_WIN32 */
+
+  /* The compressed containers are read like the raw images */
+  if (fosfat_container_probe (io))
+    return fosfat_container_open (io);
+
+  return io;
+
+ err:
+  free (io);
+  return NULL;
+}
+
+/*
+ * Open a device provided by a user backend.
+ *
+ * The user data is released (close function) if the handle cannot be
+ * created.
+ *
+ * backend      the functions of the backend (copied)
+ * data         user data for the functions
+ * return the handle
+ */
+fosfat_io_t *
+fosfat_io_backend (const fosfat_backend_t *backend, void *data)
+{
+  fosfat_io_t *io;
+
+  if (!backend || !backend->read)
+    return NULL;
+
+  io = calloc (1, sizeof (fosfat_io_t));
+  if (!io)
+  {
+    if (backend->close)
+      backend->close (data);
+    return NULL;
+  }
+
+  io->ops  = &io_user;
+  io->user = *backend;
+  io->data = data;
+  io->size = backend->size ? backend->size (data) : 0;
+#ifdef _WIN32
+  fosfat_mutex_init (&io->mutex);
+#else
+  io->fd   = -1;
+#endif /* !_WIN32 */
+
+  return io;
+}
+
+/*
+ * Get the backend for an image in memory.
+ *
+ * return the functions of the backend
+ */
+const fosfat_backend_t *
+fosfat_backend_memory (void)
+{
+  return &backend_memory;
+}
+
+/*
+ * Read bytes on the device.
+ *
+ * io           handle
+ * offset       address on the device (in bytes)
+ * buf          where to copy the data
+ * size         number of bytes
+ * return a boolean (true only if all bytes are read)
+ */
+int
+fosfat_io_read (fosfat_io_t *io, uint64_t offset, void *buf, size_t size)
+{
+  if (!io || !buf)
+    return 0;
+
+  return io->ops->read (io, offset, buf, size);
+}
+
+/*
+ * Read many ranges on the device.
+ *
+ * With io_uring, all requests are in flight at the same time. Else they
+ * are read one by one.
+ *
+ * io           handle
+ * reqs         the requests
+ * count        number of requests
+ * return a boolean (true only if all requests are read)
+ */
+int
+fosfat_io_batch (fosfat_io_t *io, const fosfat_io_req_t *reqs,
+                 unsigned int count)
+{
+  unsigned int i;
+
+  if (!io || (count && !reqs))
+    return 0;
+
+  /* One request is not faster with a batch */
+  if (io->ops->batch && count > 1)
+    return io->ops->batch (io, reqs, count);
+
+  for (i = 0; i < count; i++)
+    if (!io->ops->read (io, reqs[i].offset, reqs[i].buf, reqs[i].size))
+      return 0;
+
+  return 1;
+}
+
+/*
+ * Test if the batches are asynchronous.
+ *
+ * io           handle
+ * return a boolean (true if the requests of a batch are in flight at the
+ *        same time)
+ */
+int
+fosfat_io_isasync (fosfat_io_t *io)
+{
+  return io && io->ops->batch;
+}
+
+/*
+ * Set the block cache of the handle.
+ *
+ * With O_DIRECT, the blocks of the aligned windows which are not asked
+ * are put in this cache. The keys are the absolute blocks (offset / 256).
+ * It must not be set on the device of a container (the offsets are not
+ * the blocks of the disk).
+ *
+ * io           handle
+ * cache        the block cache (can be NULL)
+ */
+void
+fosfat_io_cache (fosfat_io_t *io, fosfat_blkcache_t *cache)
+{
+  if (io)
+    io->blkcache = cache;
+}
+
+/*
+ * Get the counters of the reads.
+ *
+ * The bytes are counted by each backend as they are really transferred
+ * (the whole window with O_DIRECT, the sectors with a Window$ device).
+ *
+ * io           handle
+ * bytes        where to copy the number of bytes read
+ * syscalls     where to copy the number of system calls
+ */
+void
+fosfat_io_stats (fosfat_io_t *io, uint64_t *bytes, uint64_t *syscalls)
+{
+  *bytes    = io ? __atomic_load_n (&io->bytes,    __ATOMIC_RELAXED) : 0;
+  *syscalls = io ? __atomic_load_n (&io->syscalls, __ATOMIC_RELAXED) : 0;
+}
+
+/*
+ * Reset the counters of the reads.
+ *
+ * io           handle
+ */
+void
+fosfat_io_reset (fosfat_io_t *io)
+{
+  if (!io)
+    return;
+
+  __atomic_store_n (&io->bytes,    0, __ATOMIC_RELAXED);
+  __atomic_store_n (&io->syscalls, 0, __ATOMIC_RELAXED);
+}
+
+/*
+ * Close the device.
+ *
+ * io           handle
+ */
+void
+fosfat_io_close (fosfat_io_t *io)
+{
+  if (!io)
+    return;
+
+  io->ops->close (io);
+#ifdef _WIN32
+  fosfat_mutex_destroy (&io->mutex);
+#endif /* _WIN32 */
+  free (io);
+}
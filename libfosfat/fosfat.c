@@ -26,13 +26,14 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <inttypes.h>
+#include <limits.h>     /* INT_MAX */
 #include <ctype.h>      /* tolower */
 #include <string.h>     /* strcasecmp strncasecmp strdup strlen strtok
                            memcmp memcpy strcasestr */
 
-#ifdef _WIN32
-#include <w32disk.h>
-#endif /* _WIN32 */
+#ifndef _WIN32
+#include <unistd.h>     /* sysconf */
+#endif /* !_WIN32 */
 
 #include "fosfat.h"
 #include "fosfat_internal.h"
@@ -40,22 +41,8 @@
 #define FOSFAT_NBL            4
 #define FOSFAT_Y2K            70
 
-#define FOSFAT_BLOCK0         0x00
-#define FOSFAT_SYSLIST        0x01
-
-#define FOSBOOT_FD            0x10
-#define FOSBOOT_HD            0x20
-
-#define FOSFAT_DEV            void
-
-/* FOS attributes and type */
-#define FOSFAT_ATT_OPENEX     (1 <<  0)
-#define FOSFAT_ATT_MULTIPLE   (1 <<  1)
-#define FOSFAT_ATT_DIR        (1 << 12)
-#define FOSFAT_ATT_VISIBLE    (1 << 13)
-#define FOSFAT_ATT_ENCODED    (1 << 17)
-#define FOSFAT_ATT_LINK       (1 << 24)
-#define FOSFAT_TYPE_SYSTEM    0xF8
+/* Max number of workers for the parallel scan */
+#define FOSFAT_SCAN_WORKERS   16
 
 /* List of all block types */
 typedef enum block_type {
@@ -71,94 +58,120 @@ typedef enum search_type {
   S_BLF                        /* Search BL File                        */
 } fosfat_search_t;
 
-/* Block 0 (256 bytes) */
-typedef struct block_0_s {
-  uint8_t sys[44];             /* SYSTEM folder                         */
-  int8_t  nlo[16];             /* Disk name                             */
-  uint8_t chk[4];              /* Check control                         */
-  uint8_t mes[172];            /* Message                               */
-  uint8_t change;              /* Need of change the CHK number         */
-  uint8_t bonchk;              /* New format                            */
-  uint8_t oldchk[4];           /* Old CHK value                         */
-  uint8_t newchk[4];           /* New CHK value                         */
-  uint8_t reserve[10];         /* Unused                                */
-} fosfat_b0_t;
-
-/* File in a Block List (60 bytes) */
-typedef struct block_listf_s {
-  int8_t  name[16];            /* Filename                              */
-  uint8_t typ;                 /* Filetype                              */
-  uint8_t ope;                 /* Open counter                          */
-  uint8_t att[4];              /* Attributes                            */
-  uint8_t lg[4];               /* Length in blocks                      */
-  uint8_t lgb[2];              /* Number of bytes in the last block     */
-  uint8_t cd[3];               /* Date of Creation                      */
-  uint8_t ch[3];               /* Hour of Creation                      */
-  uint8_t wd[3];               /* Date of the last Write                */
-  uint8_t wh[3];               /* Hour of the last Write                */
-  uint8_t rd[3];               /* Date of the last Read                 */
-  uint8_t rh[3];               /* Hour of the last Read                 */
-  uint8_t secid[3];            /* Security ID                           */
-  uint8_t clope;               /* Open mode before CLOSE                */
-  uint8_t pt[4];               /* Pointer on the BD                     */
-  uint8_t lgf[4];              /* File size in bytes                    */
-  uint8_t code[2];             /* Code control                          */
-} fosfat_blf_t;
-
-/* Block List (256 bytes) */
-typedef struct block_list_s {
-  fosfat_blf_t file[4];        /* 4 BL files (240 bytes)                */
-  uint8_t      next[4];        /* Next BL                               */
-  uint8_t      chk[4];         /* Check control                         */
-  uint8_t      prev[4];        /* Previous BL                           */
-  uint8_t      reserve[4];     /* Unused                                */
-  /* Not in the block */
-  uint32_t     pt;             /* Block's number of this BL             */
-  /* Linked list */
-  struct       block_list_s *next_bl;
-} fosfat_bl_t;
-
-/* Block Description (256 bytes) */
-typedef struct block_desc_s {
-  uint8_t next[4];             /* Next BD                               */
-  uint8_t prev[4];             /* Previous BD                           */
-  uint8_t npt[2];              /* Number of tranches in the BD          */
-  uint8_t pts[42][4];          /* Pointers on the tranches (max 42)     */
-  int8_t  name[16];            /* Filename                              */
-  uint8_t nbs[42];             /* Length (in blocks) of each tranches   */
-  uint8_t reserve[4];          /* Unused                                */
-  uint8_t lst[2];              /* Number of byte in the last tranche    */
-  uint8_t hac[2];              /* Hashing function if LIST              */
-  uint8_t nbl[2];              /* Number of BL used if LIST             */
-  uint8_t chk[4];              /* Check control                         */
-  uint8_t off[4];              /* Offset (in blocks) of all previous BD */
-  uint8_t free[2];             /* Unused                                */
-  /* Linked list */
-  struct  block_desc_s *next_bd;
-  struct  block_list_s *first_bl;
-} fosfat_bd_t;
-
-/* Cache list for name, BD and BL blocks */
-typedef struct cache_list_s {
-  char    *name;
+/* Decoded attributes of a node, see fosfat_node_stat() */
+typedef struct cache_attr_s {
+  int32_t       size;          /* Size of the file                      */
+  uint8_t       isvisible;     /* If is visible                         */
+  uint8_t       isencoded;     /* If is encoded                         */
+  fosfat_time_t time_c;        /* Creation date                         */
+  fosfat_time_t time_w;        /* Writing date                          */
+  fosfat_time_t time_r;        /* Use date                              */
+} cacheattr_t;
+
+/* Node of the cache for name, BD and BL blocks */
+typedef struct cache_node_s {
+  char     name[FOSFAT_NAMELGT]; /* Name (inline)                       */
+  uint8_t  isdir;              /* If is a directory                     */
+  uint8_t  islink;             /* If is a soft link                     */
+  uint8_t  isdel;              /* If is deleted                         */
+  uint8_t  loaded;             /* If the content is loaded              */
+  uint8_t  issystem;           /* If is a system file                   */
   uint32_t bl;                 /* BL Address                            */
   uint32_t bd;                 /* BD Address                            */
-  int      isdir;              /* If is a directory                     */
-  int      islink;             /* If is a soft link                     */
-  int      isdel;              /* If is deleted                         */
-  /* Linked list */
-  struct   cache_list_s *sub;
-  struct   cache_list_s *next;
-} cachelist_t;
+  uint32_t parent;             /* Index of the directory                */
+  uint32_t first;              /* Index of the first file (directory)   */
+  uint32_t count;              /* Number of files (directory)           */
+  cacheattr_t attr;            /* Decoded attributes                    */
+} cachenode_t;
+
+/*
+ * Cache of all files in an arena. The root (SYS_LIST) is always the first
+ * node and the content of a directory is contiguous.
+ */
+typedef struct cache_s {
+  cachenode_t *nodes;          /* Arena of nodes                        */
+  uint32_t     count;          /* Number of nodes                       */
+  uint32_t     size;           /* Number of nodes allocated             */
+  int          error;          /* A directory cannot be added           */
+} fosfat_cache_t;
+
+#define CACHE_ROOT            0
+
+/* Entry in the path index */
+typedef struct pathidx_entry_s {
+  uint32_t parent;             /* Index of the directory                */
+  uint32_t node;               /* Index of the file or directory        */
+  uint32_t len;                /* Length of the key in the name         */
+  uint32_t hash;               /* Hash of the key (case-folded)         */
+  uint32_t next;               /* Next entry in the same bucket         */
+} pathidx_entry_t;
+
+/* Path index on the cache data (directory + name) */
+typedef struct pathidx_s {
+  uint32_t         mask;       /* Mask for the buckets                  */
+  uint32_t         count;      /* Number of entries                     */
+  uint32_t         size;       /* Number of entries allocated           */
+  int              error;      /* An entry cannot be added              */
+  uint32_t        *buckets;    /* First entry of each bucket            */
+  pathidx_entry_t *entries;    /* All entries                           */
+} pathidx_t;
+
+#define PATHIDX_NONE          UINT32_MAX
+
+/* Run of consecutive blocks to read */
+typedef struct blkrun_s {
+  uint32_t     block;          /* First block                           */
+  unsigned int nbs;            /* Number of blocks                      */
+  uint8_t     *data;           /* Where to copy the nbs * 256 bytes     */
+} fosfat_blkrun_t;
+
+/* Extent of a file (one tranche) */
+typedef struct extent_s {
+  uint32_t block;              /* First block of the tranche            */
+  uint32_t nbs;                /* Number of blocks                      */
+  uint32_t off;                /* Offset (in bytes) in the file         */
+  uint32_t len;                /* Length (in bytes)                     */
+} fosfat_extent_t;
 
 /* Main fosfat structure */
 struct fosfat_s {
-  FOSFAT_DEV  *dev;            /* file disk image or physical device    */
-  int          isfile;         /* if it's a file                        */
-  int          fosboot;        /* FOSBOOT address                       */
-  uint32_t     foschk;         /* CHK                                   */
-  int          viewdel;        /* list deleted files                    */
-  cachelist_t *cachelist;      /* cache data                            */
+  fosfat_io_t       *dev;       /* file disk image or physical device   */
+  int                isfile;    /* if it's a file                       */
+  int                fosboot;   /* FOSBOOT address                      */
+  uint32_t           foschk;    /* CHK                                  */
+  int                viewdel;   /* list deleted files                   */
+  fosfat_cache_t     cache;     /* cache data                           */
+  pathidx_t          pathidx;   /* index on the cache data              */
+  int                lazy;      /* load the directories on demand       */
+  fosfat_mutex_t     cachelock; /* lock for the lazy loading            */
+  fosfat_blkcache_t *blkcache;  /* cache for the last blocks read       */
+  fosfat_ra_t       *readahead; /* prefetch of the sequential reads     */
+  unsigned int       ra_min;    /* first readahead window (blocks)      */
+  unsigned int       ra_max;    /* biggest readahead window (blocks)    */
+  fosfat_stats_t     stats;     /* I/O and cache counters               */
+};
+
+
+/* Open file */
+struct fosfat_fh_s {
+  fosfat_t        *fosfat;     /* disk handle                          */
+  fosfat_extent_t *extents;    /* extent index of the data             */
+  unsigned int     count;      /* number of extents                    */
+  uint32_t         size;       /* length of the data                   */
+  uint32_t         pos;        /* current position                     */
+  fosfat_mutex_t   lock;       /* lock for the readahead states        */
+  uint32_t         ra_next;    /* offset of the next sequential read   */
+  uint32_t         ra_window;  /* readahead window (blocks)            */
+  uint32_t         ra_end;     /* end of the data already prefetched   */
+};
+
+/* Directory stream on the cache */
+struct fosfat_dir_s {
+  fosfat_t *fosfat;            /* Handle                                */
+  uint32_t  first;             /* Index of the first file               */
+  uint32_t  count;             /* Number of files                       */
+  uint32_t  pos;               /* Next file                             */
+  uint32_t  sysdir;            /* Index of SYS_LIST (for "..dir")       */
 };
 
 
@@ -166,26 +179,20 @@ struct fosfat_s {
 static int g_logger = 0;
 
 
-#define FOSFAT_IS(handle, loc, att)                   \
+#define FOSFAT_IS(handle, loc, test)                  \
   {                                                   \
-    int res = 0;                                      \
-    fosfat_blf_t *entry;                              \
+    fosfat_info_t info;                               \
                                                       \
-    entry = fosfat_search_insys (handle, loc, S_BLF); \
-    if (!entry)                                       \
+    if (!fosfat_lookup (handle, loc, &info))          \
       return 0;                                       \
                                                       \
-    if (fosfat_in_is##att (entry))                    \
-      res = 1;                                        \
-                                                      \
-    free (entry);                                     \
-    return res;                                       \
+    return !!info.test;                               \
   }
-#define FOSFAT_IS_DIR(handle, loc)     FOSFAT_IS(handle, loc, dir)
-#define FOSFAT_IS_LINK(handle, loc)    FOSFAT_IS(handle, loc, link)
-#define FOSFAT_IS_VISIBLE(handle, loc) FOSFAT_IS(handle, loc, visible)
-#define FOSFAT_IS_ENCODED(handle, loc) FOSFAT_IS(handle, loc, encoded)
-#define FOSFAT_IS_OPENEXM(handle, loc) FOSFAT_IS(handle, loc, openexm)
+#define FOSFAT_IS_DIR(handle, loc)     FOSFAT_IS(handle, loc, att.isdir)
+#define FOSFAT_IS_LINK(handle, loc)    FOSFAT_IS(handle, loc, att.islink)
+#define FOSFAT_IS_VISIBLE(handle, loc) FOSFAT_IS(handle, loc, att.isvisible)
+#define FOSFAT_IS_ENCODED(handle, loc) FOSFAT_IS(handle, loc, att.isencoded)
+#define FOSFAT_IS_OPENEXM(handle, loc) FOSFAT_IS(handle, loc, isopenexm)
 
 /*
  * Translate a block number to an address.
@@ -199,49 +206,11 @@ static int g_logger = 0;
  * fosboot      offset in the FOS address
  * return the address of this block on the disk
  */
-static inline uint32_t
+static inline uint64_t
 blk2add (uint32_t block, int fosboot)
 {
-  return ((block + fosboot) * FOSFAT_BLK);
-}
-
-#ifdef _WIN32
-/*
- * Translate a block number to a sector.
- *
- * This function depend if the media is an HARD DISK or an 3"1/2 DISK.
- * The FOSBOOT is the double in number of blocks for an hard disk.
- * The real address is the sector given by the disk with the size of the
- * FOSBOOT part.
- *
- * block        the block's number given by the disk
- * fosboot      offset in the FOS address
- * return the sector on the disk
- */
-static inline uint32_t
-blk2sector (uint32_t block, int fosboot)
-{
-  /* FIXME: div by 2 only right if the sector size is 512 */
-  return ((block + fosboot) / 2);
-}
-
-/*
- * Return the offset in the block to get the right Smaky's block.
- *
- * Smaky's blocks are of 256 bytes and Win32 uses 512. This function search
- * if an offset of 256 is necessary to get the right Smaky's block, or not.
- *
- * block        the block's number given by the disk
- * fosboot      offset in the FOS address
- * return the offset in the Win32's block
- */
-static inline uint32_t
-sec_offset (uint32_t block, int fosboot)
-{
-  /* FIXME: modulo by 2 only right if the sector size is 512 */
-  return (((block + fosboot) % 2) ? FOSFAT_BLK : 0);
+  return ((uint64_t) (block + fosboot) * FOSFAT_BLK);
 }
-#endif /* _WIN32 */
 
 /*
  * Convert char table to an integer.
@@ -327,21 +296,6 @@ my_strcasestr (const char *s1, const char *s2)
 #endif /* !_WIN32 */
 }
 
-static inline char *
-my_strndup (const char *src, size_t n)
-{
-#ifdef _WIN32
-  char *dst;
-
-  dst = malloc (n + 1);
-  memcpy (dst, src, n);
-  dst[n] = '\0';
-  return dst;
-#else
-  return strndup (src, n);
-#endif /* !_WIN32 */
-}
-
 #ifdef _WIN32
 void *
 memmem (const void *haystack, size_t haystack_len,
@@ -372,6 +326,126 @@ fosfat_logger (int state)
     g_logger = 0;
 }
 
+/*
+ * Change the size of the block cache.
+ *
+ * The blocks already cached are dropped.
+ *
+ * fosfat       handle
+ * blocks       number of blocks, 0 to disable the cache
+ * return a boolean (true for success)
+ */
+int
+fosfat_blkcache_size (fosfat_t *fosfat, unsigned int blocks)
+{
+  fosfat_blkcache_t *cache = NULL;
+
+  if (!fosfat)
+    return 0;
+
+  if (blocks)
+  {
+    cache = fosfat_blkcache_new (blocks);
+    if (!cache)
+      return 0;
+  }
+
+  /* The worker must not fetch in the old cache */
+  fosfat_ra_wait (fosfat->readahead);
+
+  fosfat_blkcache_free (fosfat->blkcache);
+  fosfat->blkcache = cache;
+  fosfat_io_cache (fosfat->dev, cache);
+
+  return 1;
+}
+
+/*
+ * Change the readahead windows.
+ *
+ * fosfat       handle
+ * min          first window (in blocks)
+ * max          biggest window (in blocks), 0 to disable
+ * return a boolean (true for success)
+ */
+int
+fosfat_readahead_size (fosfat_t *fosfat, unsigned int min, unsigned int max)
+{
+  if (!fosfat || min > max)
+    return 0;
+
+  fosfat->ra_min = min ? min : 1;
+  fosfat->ra_max = max;
+  return 1;
+}
+
+/*
+ * Get the readahead counters.
+ *
+ * fosfat       handle
+ * stats        where to copy the counters
+ */
+void
+fosfat_readahead_stats (fosfat_t *fosfat, fosfat_ra_stats_t *stats)
+{
+  if (!stats)
+    return;
+
+  fosfat_ra_counters (fosfat ? fosfat->readahead : NULL, stats);
+}
+
+/*
+ * Get the I/O and cache counters.
+ *
+ * All the counters are 64 bits wide, then they are copied one by one
+ * without lock.
+ *
+ * fosfat       handle
+ * stats        where to copy the counters
+ */
+void
+fosfat_get_stats (fosfat_t *fosfat, fosfat_stats_t *stats)
+{
+  size_t i;
+  const uint64_t *src;
+  uint64_t *dst = (uint64_t *) stats;
+
+  if (!stats)
+    return;
+
+  memset (stats, 0, sizeof (*stats));
+  if (!fosfat)
+    return;
+
+  src = (const uint64_t *) &fosfat->stats;
+  for (i = 0; i < sizeof (*stats) / sizeof (uint64_t); i++)
+    dst[i] = __atomic_load_n (&src[i], __ATOMIC_RELAXED);
+
+  /* Counted by the device */
+  fosfat_io_stats (fosfat->dev, &stats->bytes, &stats->syscalls);
+}
+
+/*
+ * Reset the I/O and cache counters.
+ *
+ * fosfat       handle
+ */
+void
+fosfat_reset_stats (fosfat_t *fosfat)
+{
+  size_t i;
+  uint64_t *it;
+
+  if (!fosfat)
+    return;
+
+  it = (uint64_t *) &fosfat->stats;
+  for (i = 0; i < sizeof (fosfat->stats) / sizeof (uint64_t); i++)
+    __atomic_store_n (&it[i], 0, __ATOMIC_RELAXED);
+
+  fosfat_io_reset (fosfat->dev);
+}
+
 /*
  * Print function for the internal FOS logger.
  */
@@ -380,6 +454,7 @@ foslog (foslog_t type, const char *msg, ...)
 {
   va_list va;
   char log[32] = "[fosfat] ";
+  char line[1024];
 
   if (!g_logger || !msg)
     return;
@@ -400,35 +475,13 @@ foslog (foslog_t type, const char *msg, ...)
     strcat (log, "notice");
   }
 
-  fprintf (stderr, "%s: ", log);
-  vfprintf (stderr, msg, va);
-  fprintf (stderr, "\n");
+  /* Only one write in order to not mix the lines of many threads */
+  vsnprintf (line, sizeof (line), msg, va);
+  fprintf (stderr, "%s: %s\n", log, line);
 
   va_end (va);
 }
 
-/*
- * Free a DATA file variable.
- *
- * It will be used only when a data is loaded to copy a file on the PC,
- * to free each block after each write.
- *
- * var          pointer on the data block
- */
-static void
-fosfat_free_data (fosfat_data_t *var)
-{
-  fosfat_data_t *d, *free_d;
-
-  d = var;
-  while (d)
-  {
-    free_d = d;
-    d = d->next_data;
-    free (free_d);
-  }
-}
-
 /*
  * Free a BD file variable.
  *
@@ -623,168 +676,320 @@ fosfat_in_isnotdel (fosfat_blf_t *file)
 }
 
 /*
- * Read a block defined by a type.
+ * Count the blocks read on the device.
  *
- * This function read a block on the disk and return the structure in
- * function of the type chosen. Each type use 256 bytes, but the structures
- * are always bigger. The order of the attributes in each structures is
- * very important, because the informations from the device are just copied
- * directly without parsing.
+ * fosfat       handle
+ * type         type of the blocks
+ * nbs          number of blocks
+ */
+static void
+fosfat_stats_blocks (fosfat_t *fosfat, fosfat_type_t type, uint64_t nbs)
+{
+  switch (type)
+  {
+  case B_B0:
+    fosfat_stats_add (fosfat->stats.b0, nbs);
+    break;
+  case B_BL:
+    fosfat_stats_add (fosfat->stats.bl, nbs);
+    break;
+  case B_BD:
+    fosfat_stats_add (fosfat->stats.bd, nbs);
+    break;
+  case B_DATA:
+    fosfat_stats_add (fosfat->stats.data, nbs);
+    break;
+  }
+}
+
+/*
+ * Keep the biggest value of a counter.
+ *
+ * var          the counter
+ * value        the new value
+ */
+static void
+fosfat_stats_max (uint64_t *var, uint64_t value)
+{
+  uint64_t max = __atomic_load_n (var, __ATOMIC_RELAXED);
+
+  while (value > max
+         && !__atomic_compare_exchange_n (var, &max, value, 1,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+}
+
+/*
+ * Read the raw 256 bytes of a block.
+ *
+ * The block is first searched in the block cache. Only when it is not
+ * available, it is read on the device and then put in the cache.
  *
  * fosfat       handle
  * block        block position
- * type         type of this block (B_B0, B_BL, B_BD or B_DATA)
- * return a pointer on the new block or NULL if broken
+ * data         where to copy the 256 bytes
+ * type         type of this block (for the statistics)
+ * return a boolean (true for success)
  */
-static void *
-fosfat_read_b (fosfat_t *fosfat, uint32_t block, fosfat_type_t type)
+static int
+fosfat_read_raw (fosfat_t *fosfat, uint32_t block, void *data,
+                 fosfat_type_t type)
 {
-#ifdef _WIN32
-  size_t ssize, csector = 1;
-  int8_t *buffer = NULL;
-#endif /* _WIN32 */
-
-  if (!fosfat || !fosfat->dev)
-    return NULL;
+  int read = 0;
+  uint32_t key = block + fosfat->fosboot;
 
-#ifdef _WIN32
-  if (!fosfat->isfile)
+  if (fosfat_blkcache_get (fosfat->blkcache, key, data))
   {
-    /* sector seems to be always 512 with Window$ */
-    ssize = w32disk_sectorsize (fosfat->dev);
+    fosfat_stats_add (fosfat->stats.blk_hits, 1);
+    return 1;
+  }
 
-    csector = (size_t) FOSFAT_BLK / ssize;
-    if (!csector)
-      csector = 1;
+  fosfat_stats_add (fosfat->stats.blk_misses, 1);
+  fosfat_stats_blocks (fosfat, type, 1);
 
-    buffer = calloc (1, csector * ssize);
-    if (!buffer)
-      return NULL;
-  }
-  else
-#endif /* _WIN32 */
-  /* Move the pointer on the block */
-  if (fseek (fosfat->dev, blk2add (block, fosfat->fosboot), SEEK_SET))
-    return NULL;
+  read = fosfat_io_read (fosfat->dev, blk2add (block, fosfat->fosboot),
+                         data, (size_t) FOSFAT_BLK);
+  if (read)
+    fosfat_blkcache_put (fosfat->blkcache, key, data);
 
-  switch (type)
-  {
-  case B_B0:
-  {
-    fosfat_b0_t *blk;
-    int read = 0;
+  return read;
+}
 
-    blk = malloc (sizeof (fosfat_b0_t));
-    if (!blk)
-      break;
+/*
+ * Read a batch of requests and put the blocks in the block cache.
+ *
+ * All reads of tranches and data (the misses of the block cache) are
+ * passing here. The probes batch__start and batch__done are around the
+ * device access, with the first block, the number of requests and the
+ * size in bytes (0 if broken).
+ *
+ * fosfat       handle
+ * reqs         the requests
+ * n            number of requests
+ * return a boolean (true for success)
+ */
+static int
+fosfat_read_batch (fosfat_t *fosfat, const fosfat_io_req_t *reqs,
+                   unsigned int n)
+{
+  int res;
+  unsigned int r, i;
+  size_t size = 0;
+  uint32_t block = (uint32_t) (reqs[0].offset / FOSFAT_BLK) - fosfat->fosboot;
 
-#ifdef _WIN32
-    if (!fosfat->isfile)
-    {
-      read = w32disk_readsectors (fosfat->dev, buffer,
-                                  blk2sector (block, fosfat->fosboot), csector);
-      if (read)
-      {
-        memcpy (blk, buffer + sec_offset (block, fosfat->fosboot),
-                (size_t) FOSFAT_BLK);
-        free (buffer);
-      }
-    }
-    else
-#endif /* _WIN32 */
-    {
-      read = fread ((fosfat_b0_t *) blk, 1, (size_t) FOSFAT_BLK, fosfat->dev)
-             == (size_t) FOSFAT_BLK;
-    }
+  for (r = 0; r < n; r++)
+    size += reqs[r].size;
 
-    if (read)
-      return blk;
+  FOSFAT_PROBE3 (fosfat, batch__start, block, n, size);
+  res = fosfat_io_batch (fosfat->dev, reqs, n);
+  FOSFAT_PROBE3 (fosfat, batch__done, block, n, res ? size : 0);
 
-    free (blk);
-    break;
-  }
+  if (!res)
+    return 0;
 
-  case B_BL:
+  for (r = 0; r < n; r++)
   {
-    fosfat_bl_t *blk;
-    int read = 0;
+    uint32_t key = (uint32_t) (reqs[r].offset / FOSFAT_BLK);
 
-    blk = malloc (sizeof (fosfat_bl_t));
-    if (!blk)
-      break;
+    for (i = 0; i < reqs[r].size / FOSFAT_BLK; i++)
+      fosfat_blkcache_put (fosfat->blkcache, key + i,
+                           (uint8_t *) reqs[r].buf + i * FOSFAT_BLK);
+  }
 
-#ifdef _WIN32
-    if (!fosfat->isfile)
+  return 1;
+}
+
+/*
+ * Read many runs of consecutive blocks.
+ *
+ * The blocks available in the block cache are copied, and each run of
+ * missing blocks is one request of a batch on the device. With io_uring,
+ * the requests of a batch are in flight at the same time.
+ *
+ * fosfat       handle
+ * runs         the runs of blocks
+ * count        number of runs
+ * type         type of the blocks (for the statistics)
+ * return a boolean (true for success)
+ */
+static int
+fosfat_read_runs (fosfat_t *fosfat, const fosfat_blkrun_t *runs,
+                  unsigned int count, fosfat_type_t type)
+{
+  unsigned int r, i, j, n = 0;
+  fosfat_io_req_t reqs[64];
+
+  for (r = 0; r < count; r++)
+  {
+    const fosfat_blkrun_t *run = &runs[r];
+
+    for (i = 0; i < run->nbs; i = j)
     {
-      read = w32disk_readsectors (fosfat->dev, buffer,
-                                  blk2sector (block, fosfat->fosboot), csector);
-      if (read)
+      uint32_t key = run->block + i + fosfat->fosboot;
+
+      if (fosfat_blkcache_get (fosfat->blkcache, key,
+                               run->data + i * FOSFAT_BLK))
       {
-        memcpy (blk, buffer + sec_offset (block, fosfat->fosboot),
-                (size_t) FOSFAT_BLK);
-        free (buffer);
+        fosfat_stats_add (fosfat->stats.blk_hits, 1);
+        j = i + 1;
+        continue;
       }
-    }
-    else
-#endif /* _WIN32 */
-    {
-      read = fread ((fosfat_bl_t *) blk, 1, (size_t) FOSFAT_BLK, fosfat->dev)
-             == (size_t)FOSFAT_BLK;
-    }
 
-    if (read)
-    {
-      blk->next_bl = NULL;
+      /* Search the end of the run of missing blocks */
+      for (j = i + 1; j < run->nbs; j++)
+      {
+        uint8_t *it = run->data + j * FOSFAT_BLK;
+        if (fosfat_blkcache_get (fosfat->blkcache, key + j - i, it))
+          break;
+      }
 
-      /* Check the CHK value */
-      if (!fosfat->foschk)
-        fosfat->foschk = c2l (blk->chk, sizeof (blk->chk));
-      if (fosfat->foschk == c2l (blk->chk, sizeof (blk->chk)))
-        return blk;
+      if (n == countof (reqs))
+      {
+        if (!fosfat_read_batch (fosfat, reqs, n))
+          return 0;
+        n = 0;
+      }
 
-      foslog (FOSLOG_ERROR, "bad FOSCHK for this BL (block:%li)", block);
+      reqs[n].offset = blk2add (run->block + i, fosfat->fosboot);
+      reqs[n].buf    = run->data + i * FOSFAT_BLK;
+      reqs[n].size   = (size_t) (j - i) * FOSFAT_BLK;
+      n++;
+
+      fosfat_stats_add (fosfat->stats.blk_misses, j - i);
+      fosfat_stats_blocks (fosfat, type, j - i);
+
+      /* The block at j (if any) is already copied from the cache */
+      if (j < run->nbs)
+      {
+        fosfat_stats_add (fosfat->stats.blk_hits, 1);
+        j++;
+      }
     }
-    free (blk);
-    break;
   }
 
-  case B_BD:
+  /* All blocks can be in the cache */
+  return !n || fosfat_read_batch (fosfat, reqs, n);
+}
+
+/*
+ * Read consecutive blocks.
+ *
+ * fosfat       handle
+ * block        first block position
+ * nbs          number of blocks
+ * data         where to copy the nbs * 256 bytes
+ * type         type of the blocks (for the statistics)
+ * return a boolean (true for success)
+ */
+static int
+fosfat_read_blocks (fosfat_t *fosfat, uint32_t block, unsigned int nbs,
+                    uint8_t *data, fosfat_type_t type)
+{
+  fosfat_blkrun_t run;
+
+  run.block = block;
+  run.nbs   = nbs;
+  run.data  = data;
+
+  return fosfat_read_runs (fosfat, &run, 1, type);
+}
+
+/*
+ * Check the FOSCHK of a BL or a BD.
+ *
+ * The CHK of the SYS_LIST is the reference for the whole disk. It is set
+ * by fosfat_open(); before (auto detection), all CHK are accepted.
+ *
+ * fosfat       handle
+ * chk          the CHK in the block
+ * return a boolean (true if the CHK is right)
+ */
+static inline int
+fosfat_check_chk (fosfat_t *fosfat, uint8_t chk[4])
+{
+  return !fosfat->foschk || fosfat->foschk == c2l (chk, 4);
+}
+
+/*
+ * Read a block defined by a type.
+ *
+ * This function read a block on the disk and return the structure in
+ * function of the type chosen. Each type use 256 bytes, but the structures
+ * are always bigger. The order of the attributes in each structures is
+ * very important, because the informations from the device are just copied
+ * directly without parsing.
+ *
+ * fosfat       handle
+ * block        block position
+ * type         type of this block (B_B0, B_BL, B_BD or B_DATA)
+ * return a pointer on the new block or NULL if broken
+ */
+static void *
+fosfat_read_type (fosfat_t *fosfat, uint32_t block, fosfat_type_t type)
+{
+  if (!fosfat || !fosfat->dev)
+    return NULL;
+
+  switch (type)
   {
-    fosfat_bd_t *blk;
-    int read = 0;
+  case B_B0:
+  {
+    fosfat_b0_t *blk;
 
-    blk = malloc (sizeof (fosfat_bd_t));
+    blk = malloc (sizeof (fosfat_b0_t));
     if (!blk)
       break;
 
-#ifdef _WIN32
-    if (!fosfat->isfile)
-    {
-      read = w32disk_readsectors (fosfat->dev, buffer,
-                                  blk2sector (block, fosfat->fosboot), csector);
-      if (read)
-      {
-        memcpy (blk, buffer + sec_offset (block, fosfat->fosboot),
-                (size_t) FOSFAT_BLK);
-        free (buffer);
-      }
-    }
-    else
-#endif /* _WIN32 */
+    fosfat_stats_add (fosfat->stats.allocs, 1);
+
+    if (fosfat_read_raw (fosfat, block, blk, type))
+      return blk;
+
+    free (blk);
+    break;
+  }
+
+  case B_BL:
+  {
+    fosfat_bl_t *blk;
+
+    blk = malloc (sizeof (fosfat_bl_t));
+    if (!blk)
+      break;
+
+    fosfat_stats_add (fosfat->stats.allocs, 1);
+
+    if (fosfat_read_raw (fosfat, block, blk, type))
     {
-      read = fread ((fosfat_bd_t *) blk, 1, (size_t) FOSFAT_BLK, fosfat->dev)
-             == (size_t) FOSFAT_BLK;
+      blk->next_bl = NULL;
+
+      /* Check the CHK value */
+      if (fosfat_check_chk (fosfat, blk->chk))
+        return blk;
+
+      foslog (FOSLOG_ERROR, "bad FOSCHK for this BL (block:%li)", block);
     }
+    free (blk);
+    break;
+  }
 
-    if (read)
+  case B_BD:
+  {
+    fosfat_bd_t *blk;
+
+    blk = malloc (sizeof (fosfat_bd_t));
+    if (!blk)
+      break;
+
+    fosfat_stats_add (fosfat->stats.allocs, 1);
+
+    if (fosfat_read_raw (fosfat, block, blk, type))
     {
       blk->next_bd = NULL;
       blk->first_bl = NULL;
 
       /* Check the CHK value */
-      if (!fosfat->foschk)
-        fosfat->foschk = c2l (blk->chk, sizeof (blk->chk));
-      if (fosfat->foschk == c2l (blk->chk, sizeof (blk->chk)))
+      if (fosfat_check_chk (fosfat, blk->chk))
         return blk;
 
       foslog (FOSLOG_ERROR, "bad FOSCHK for this BD (block:%li)", block);
@@ -796,32 +1001,14 @@ fosfat_read_b (fosfat_t *fosfat, uint32_t block, fosfat_type_t type)
   case B_DATA:
   {
     fosfat_data_t *blk;
-    int read = 0;
 
     blk = malloc (sizeof (fosfat_data_t));
     if (!blk)
       break;
 
-#ifdef _WIN32
-    if (!fosfat->isfile)
-    {
-      read = w32disk_readsectors (fosfat->dev, buffer,
-                                  blk2sector (block, fosfat->fosboot), csector);
-      if (read)
-      {
-        memcpy (blk, buffer + sec_offset (block, fosfat->fosboot),
-                (size_t) FOSFAT_BLK);
-        free (buffer);
-      }
-    }
-    else
-#endif /* _WIN32 */
-    {
-      read = fread ((fosfat_data_t *) blk, 1, (size_t) FOSFAT_BLK, fosfat->dev)
-             == (size_t) FOSFAT_BLK;
-    }
+    fosfat_stats_add (fosfat->stats.allocs, 1);
 
-    if (read)
+    if (fosfat_read_raw (fosfat, block, blk, type))
     {
       blk->next_data = NULL;
       return blk;
@@ -832,14 +1019,32 @@ fosfat_read_b (fosfat_t *fosfat, uint32_t block, fosfat_type_t type)
   }
   }
 
-#ifdef _WIN32
-  if (buffer)
-    free (buffer);
-#endif /* _WIN32 */
-
   return NULL;
 }
 
+/*
+ * Read a block defined by a type (see fosfat_read_type()).
+ *
+ * The probes read__start and read__done are around the read, with the
+ * block, the type and the size (0 if broken).
+ *
+ * fosfat       handle
+ * block        block position
+ * type         type of this block (B_B0, B_BL, B_BD or B_DATA)
+ * return a pointer on the new block or NULL if broken
+ */
+static void *
+fosfat_read_b (fosfat_t *fosfat, uint32_t block, fosfat_type_t type)
+{
+  void *blk;
+
+  FOSFAT_PROBE2 (fosfat, read__start, block, type);
+  blk = fosfat_read_type (fosfat, block, type);
+  FOSFAT_PROBE3 (fosfat, read__done, block, type, blk ? FOSFAT_BLK : 0);
+
+  return blk;
+}
+
 /*
  * Read the first useful block (0).
  *
@@ -906,74 +1111,185 @@ fosfat_read_bl (fosfat_t *fosfat, uint32_t block)
 }
 
 /*
- * Read data of some blocks and create linked list if necessary.
+ * Read a whole tranche.
  *
- * When a directory or a file is read, the content is shown as data. But
- * for a directory, really it is a BL. This function create the linked list
- * for a DATA block or a BL for a number of consecutive blocks.
+ * All consecutive blocks of a tranche are read in one contiguous buffer,
+ * with only one access on the device for the blocks which are not already
+ * in the block cache.
  *
  * fosfat       handle
- * block        the first block (start) for the linked list
+ * block        the first block of the tranche
  * nbs          number of consecutive blocks
- * type         type of this block (B_B0, B_BL, B_BD or B_DATA)
- * return the first block of the linked list created
+ * type         type of the blocks (for the statistics)
+ * return the buffer (nbs * 256 bytes) or NULL if broken
  */
-static void *
-fosfat_read_data (fosfat_t *fosfat, uint32_t block,
-                  uint8_t nbs, fosfat_type_t type)
+static uint8_t *
+fosfat_read_tranche (fosfat_t *fosfat, uint32_t block, unsigned int nbs,
+                     fosfat_type_t type)
 {
-  if (!fosfat)
+  uint8_t *buffer;
+
+  if (!fosfat || !fosfat->dev || !nbs)
     return NULL;
 
-  switch (type)
+  buffer = malloc ((size_t) nbs * FOSFAT_BLK);
+  if (!buffer)
+    return NULL;
+
+  fosfat_stats_add (fosfat->stats.allocs, 1);
+
+  if (fosfat_read_blocks (fosfat, block, nbs, buffer, type))
+    return buffer;
+
+  free (buffer);
+  return NULL;
+}
+
+/*
+ * Read blocks in the block cache for the readahead.
+ *
+ * It is called by the readahead worker. The blocks already in the cache
+ * are not read again.
+ *
+ * data         handle
+ * block        first block
+ * nbs          number of blocks
+ */
+static void
+fosfat_ra_fetch (void *data, uint32_t block, unsigned int nbs)
+{
+  uint8_t *buffer = fosfat_read_tranche (data, block, nbs, B_DATA);
+
+  free (buffer);
+}
+
+/*
+ * Read many runs of blocks in the block cache with only one batch.
+ *
+ * It is useful only when the batches are asynchronous (io_uring); the
+ * next reads of these blocks are served by the cache. The runs are
+ * truncated to the half of the block cache.
+ *
+ * fosfat       handle
+ * runs         the runs (the data pointers are set here)
+ * count        number of runs
+ * type         type of the blocks (for the statistics)
+ */
+static void
+fosfat_prefetch (fosfat_t *fosfat, fosfat_blkrun_t *runs, unsigned int count,
+                 fosfat_type_t type)
+{
+  unsigned int i, n, total = 0;
+  unsigned int max = fosfat_blkcache_blocks (fosfat->blkcache) / 2;
+  uint8_t *buffer;
+
+  for (n = 0; n < count && total < max; n++)
   {
-  case B_BL:
+    runs[n].nbs = MIN (runs[n].nbs, max - total);
+    total += runs[n].nbs;
+  }
+
+  /* Nothing to do in parallel */
+  if (n < 2)
+    return;
+
+  buffer = malloc ((size_t) total * FOSFAT_BLK);
+  if (!buffer)
+    return;
+
+  fosfat_stats_add (fosfat->stats.allocs, 1);
+
+  for (i = 0, total = 0; i < n; i++)
   {
-    int i;
-    fosfat_bl_t *block_list, *first_bl;
+    runs[i].data = buffer + (size_t) total * FOSFAT_BLK;
+    total += runs[i].nbs;
+  }
 
-    first_bl = fosfat_read_bl (fosfat, block);
-    if (!first_bl)
-      break;
+  fosfat_read_runs (fosfat, runs, n, type);
+  free (buffer);
+}
 
-    block_list = first_bl;
-    block_list->pt = block;
+/*
+ * Prefetch all tranches of a BD.
+ *
+ * fosfat       handle
+ * bd           the BD
+ * type         type of the blocks in the tranches
+ */
+static void
+fosfat_prefetch_bd (fosfat_t *fosfat, fosfat_bd_t *bd, fosfat_type_t type)
+{
+  unsigned int i, npt;
+  fosfat_blkrun_t runs[countof (bd->pts)];
 
-    for (i = 1; block_list && i < nbs; i++)
-    {
-      block_list->next_bl = fosfat_read_bl (fosfat, block + (uint32_t) i);
-      block_list = block_list->next_bl;
+  if (!fosfat_io_isasync (fosfat->dev))
+    return;
 
-      if (block_list)
-        block_list->pt = block + (uint32_t) i;
-    }
-    return first_bl;
+  npt = MIN (c2l (bd->npt, sizeof (bd->npt)), countof (bd->pts));
+  for (i = 0; i < npt; i++)
+  {
+    /* A tranche has at least one block */
+    runs[i].block = c2l (bd->pts[i], sizeof (bd->pts[i]));
+    runs[i].nbs   = bd->nbs[i] ? bd->nbs[i] : 1;
   }
 
-  case B_DATA:
+  fosfat_prefetch (fosfat, runs, npt, type);
+}
+
+/*
+ * Read the BL of a tranche and create the linked list.
+ *
+ * For a directory, the content of the tranches are BL. The tranche is read
+ * at once and the linked list stops on the first broken BL.
+ *
+ * fosfat       handle
+ * block        the first block (start) for the linked list
+ * nbs          number of consecutive blocks
+ * return the first BL of the linked list created
+ */
+static fosfat_bl_t *
+fosfat_read_data (fosfat_t *fosfat, uint32_t block, uint8_t nbs)
+{
+  unsigned int i;
+  uint8_t *buffer;
+  fosfat_bl_t *block_list = NULL, *first_bl = NULL;
+
+  /* A tranche has at least one block */
+  buffer = fosfat_read_tranche (fosfat, block, nbs ? nbs : 1, B_BL);
+  if (!buffer)
+    return NULL;
+
+  for (i = 0; i < (nbs ? nbs : 1u); i++)
   {
-    int i;
-    fosfat_data_t *block_data, *first_data;
+    fosfat_bl_t *blk;
 
-    first_data = fosfat_read_d (fosfat, block);
-    if (!first_data)
+    blk = malloc (sizeof (fosfat_bl_t));
+    if (!blk)
       break;
 
-    block_data = first_data;
+    fosfat_stats_add (fosfat->stats.allocs, 1);
+
+    memcpy (blk, buffer + i * FOSFAT_BLK, FOSFAT_BLK);
+    blk->next_bl = NULL;
+    blk->pt = block + (uint32_t) i;
 
-    for (i = 1; block_data && i < nbs; i++)
+    /* Check the CHK value */
+    if (!fosfat_check_chk (fosfat, blk->chk))
     {
-      block_data->next_data = fosfat_read_d (fosfat, block + (uint32_t) i);
-      block_data = block_data->next_data;
+      foslog (FOSLOG_ERROR, "bad FOSCHK for this BL (block:%li)", blk->pt);
+      free (blk);
+      break;
     }
-    return first_data;
-  }
 
-  default:
-    break;
+    if (block_list)
+      block_list->next_bl = blk;
+    else
+      first_bl = blk;
+    block_list = blk;
   }
 
-  return NULL;
+  free (buffer);
+  return first_bl;
 }
 
 /*
@@ -999,6 +1315,8 @@ fosfat_read_file (fosfat_t *fosfat, uint32_t block)
   if (!file_desc)
     return NULL;
 
+  fosfat_stats_add (fosfat->stats.bd_chains, 1);
+
   file_desc->next_bd = NULL;
   file_desc->first_bl = NULL;     /* Useless in this case */
   first_bd = file_desc;
@@ -1018,113 +1336,178 @@ fosfat_read_file (fosfat_t *fosfat, uint32_t block)
 }
 
 /*
- * Get a file and put this in a location on the PC or in a buffer.
+ * Number of bytes in the last block of a tranche.
+ *
+ * Only the last block of the last tranche in a BD is not always full.
+ *
+ * file         file description block
+ * i            tranche in the BD
+ * return the number of bytes
+ */
+static inline size_t
+fosfat_last_bytes (fosfat_bd_t *file, unsigned int i)
+{
+  size_t lst;
+
+  if (i != c2l (file->npt, sizeof (file->npt)) - 1)
+    return FOSFAT_BLK;
+
+  lst = c2l (file->lst, sizeof (file->lst));
+  return lst < FOSFAT_BLK ? lst : FOSFAT_BLK;
+}
+
+/*
+ * Create the extent index of a file.
+ *
+ * The index has one extent by tranche with the cumulative offset (in
+ * bytes) in the file. Only the BD are needed, no data block is read.
+ *
+ * file         file description block (first BD of the linked list)
+ * count        where to put the number of extents
+ * return the extents (must be freed) or NULL if empty
+ */
+static fosfat_extent_t *
+fosfat_extents (fosfat_bd_t *file, unsigned int *count)
+{
+  unsigned int i, n = 0;
+  uint32_t off = 0;
+  fosfat_bd_t *bd;
+  fosfat_extent_t *extents;
+
+  *count = 0;
+
+  for (bd = file; bd; bd = bd->next_bd)
+    n += MIN (c2l (bd->npt, sizeof (bd->npt)), countof (bd->pts));
+
+  if (!n)
+    return NULL;
+
+  extents = malloc (n * sizeof (fosfat_extent_t));
+  if (!extents)
+    return NULL;
+
+  for (bd = file; bd; bd = bd->next_bd)
+  {
+    unsigned int npt = MIN (c2l (bd->npt, sizeof (bd->npt)), countof (bd->pts));
+
+    for (i = 0; i < npt; i++)
+    {
+      fosfat_extent_t *ext = &extents[*count];
+
+      /* A tranche has at least one block */
+      ext->block = c2l (bd->pts[i], sizeof (bd->pts[i]));
+      ext->nbs   = bd->nbs[i] ? bd->nbs[i] : 1;
+      ext->off   = off;
+      ext->len   = (ext->nbs - 1) * FOSFAT_BLK + fosfat_last_bytes (bd, i);
+
+      off += ext->len;
+      (*count)++;
+    }
+  }
+
+  return extents;
+}
+
+/*
+ * Search the first extent which contains an offset.
+ *
+ * The extents are sorted by offset, then it is a binary search.
+ *
+ * extents      the extent index
+ * count        number of extents
+ * offset       byte in the file
+ * return the extent's index or count if the offset is after the end
+ */
+static unsigned int
+fosfat_extent_search (fosfat_extent_t *extents, unsigned int count,
+                      uint32_t offset)
+{
+  unsigned int lo = 0, hi = count;
+
+  while (lo < hi)
+  {
+    unsigned int mid = lo + (hi - lo) / 2;
+
+    if (extents[mid].off + extents[mid].len <= offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+/*
+ * Get a file and put this in a location on the PC.
  *
  * This function read all BD->DATA of a file BD, and write the data in a
  * new file on your disk. An output variable can be used to print the
  * current size for each PTS. The properties like "Creation Date" are not
  * saved in the new file. All Linux file system are the same attributes for
  * them files. And for example, ext2/3 have no "Creation Date".
- * The data can be saved in a buffer if the flag is used with an offset,
- * size and a buffer.
  *
  * fosfat       handle
  * file         file description block
  * dst          destination on your PC
  * output       TRUE to print the size
- * flag         use the optional arguments or not
- * ...          offset, size and buffer
  * return a boolean (true for success)
  */
 static int
-fosfat_get (fosfat_t *fosfat, fosfat_bd_t *file,
-            const char *dst, int output, int flag, ...)
-{
-  va_list pp;
-  int op_offset = 0;
-  int op_size = 0;
-  uint8_t *op_buffer = NULL;
-  int op_inoff = 0;
-  unsigned int i;
+fosfat_get (fosfat_t *fosfat, fosfat_bd_t *file, const char *dst, int output)
+{
+  unsigned int i, j, nbs;
+  uint32_t pt;
   int res = 1;
   size_t check_last;
   size_t size = 0;
-  FILE *f_dst = NULL;
-  fosfat_data_t *file_d, *first_d;
-
-  va_start (pp, flag);
-  if (flag)
-  {
-    op_offset = va_arg (pp, int);
-    op_size = va_arg (pp, int);
-    op_buffer = va_arg (pp, uint8_t *);
-  }
-  va_end(pp);
+  FILE *f_dst;
+  uint8_t *tranche;
 
   if (!fosfat || !file)
     return 0;
 
-  if (!flag)
-  {
-    f_dst = fopen (dst, "w");
-    if (!f_dst)
-      return 0;
-  }
+  f_dst = fopen (dst, "w");
+  if (!f_dst)
+    return 0;
 
   /* Loop for all BD */
   do
   {
+    fosfat_prefetch_bd (fosfat, file, B_DATA);
+
     /* Loop for all pointers */
     for (i = 0; res && i < c2l (file->npt, sizeof (file->npt)); i++)
     {
-      file_d = fosfat_read_data (fosfat, c2l (file->pts[i],
-                                 sizeof (file->pts[i])), file->nbs[i], B_DATA);
-      if (!file_d)
+      /* A tranche has at least one block */
+      nbs = file->nbs[i] ? file->nbs[i] : 1;
+
+      pt = c2l (file->pts[i], sizeof (file->pts[i]));
+
+      /* The offset of the extent in the file is the size already written */
+      FOSFAT_PROBE3 (fosfat, get__extent__start, pt, nbs, size);
+      tranche = fosfat_read_tranche (fosfat, pt, nbs, B_DATA);
+      FOSFAT_PROBE3 (fosfat, get__extent__done, pt, nbs,
+                     tranche ? nbs * FOSFAT_BLK : 0);
+      if (!tranche)
       {
         res = 0;
         break;
       }
 
-      first_d = file_d;
-
       /* Loop for all data blocks */
-      do
+      for (j = 0; res && j < nbs; j++)
       {
-        check_last = (i == c2l (file->npt, sizeof (file->npt)) - 1
-                      && !file_d->next_data)
-                      ? (size_t) c2l (file->lst, sizeof (file->lst))
-                      : (size_t) FOSFAT_BLK;
+        check_last = j == nbs - 1 ? fosfat_last_bytes (file, i) : FOSFAT_BLK;
 
-        /* When the result is written in a file */
-        if (!flag)
-        {
-          /* Write the block */
-          if (fwrite ((uint8_t *) file_d->data, 1, check_last, f_dst)
-              != check_last)
-            res = 0;
-        }
-        /* When the result is written in RAM (offset and size) */
-        else if (op_inoff || ((unsigned) op_offset >= size &&
-                              (unsigned) op_offset < size + check_last))
-        {
-          int first_pts = op_offset + op_inoff - (signed) size;
-          int cp = (op_size - op_inoff > (signed) check_last - first_pts)
-                   ? ((signed) check_last - first_pts)
-                   : (op_size - op_inoff);
-
-          /* Copy the tranche */
-          memcpy (op_buffer + op_inoff, file_d->data + first_pts, cp);
-          op_inoff += check_last - first_pts;
+        /* Write the block */
+        if (fwrite (tranche + j * FOSFAT_BLK, 1, check_last, f_dst)
+            != check_last)
+          res = 0;
 
-          if (op_size <= op_inoff)
-            res = 0;
-        }
         size += check_last;
       }
-      while (res && file_d->next_data && (file_d = file_d->next_data));
 
-      /* Freed all data */
-      fosfat_free_data (first_d);
+      free (tranche);
 
       if (res && output)
         fprintf (stdout, " %i bytes\n", (int) size);
@@ -1132,15 +1515,164 @@ fosfat_get (fosfat_t *fosfat, fosfat_bd_t *file,
   }
   while (res && file->next_bd && (file = file->next_bd));
 
-  if (!flag)
+  fclose (f_dst);
+
+  /* If fails then remove the incomplete file */
+  if (!res)
+    remove (dst);
+
+  return res;
+}
+
+/* Part of a range which is not a full block */
+typedef struct extent_part_s {
+  uint8_t *dst;                /* Where to copy in the range            */
+  uint32_t in;                 /* First byte in the block               */
+  uint32_t len;                /* Number of bytes                       */
+} extent_part_t;
+
+/*
+ * Read a range of a file with its extent index.
+ *
+ * The index is used in order to go directly to the first tranche of the
+ * range. Only the blocks which are overlapping the range are read. All
+ * runs of blocks of the range are read with only one batch; the partial
+ * blocks (at the beginning and at the end of the range or of a tranche)
+ * are read in a bounce buffer. If the batch fails, the runs are read one
+ * by one in order to return the bytes before the error.
+ *
+ * fosfat       handle
+ * extents      the extent index
+ * count        number of extents
+ * offset       start byte in the file
+ * size         number of bytes
+ * buffer       where to copy the data
+ * return the number of bytes copied
+ */
+static int
+fosfat_extent_read (fosfat_t *fosfat, fosfat_extent_t *extents,
+                    unsigned int count,
+                    uint32_t offset, uint32_t size, uint8_t *buffer)
+{
+  unsigned int i, first, last, n = 0, max;
+  uint32_t done = 0;
+  fosfat_blkrun_t srun[6], *runs = srun;
+  extent_part_t spart[countof (srun)], *parts = spart;
+  uint8_t sbounce[countof (srun) * FOSFAT_BLK], *bounce = sbounce;
+
+  first = fosfat_extent_search (extents, count, offset);
+  if (first >= count || !size)
+    return 0;
+
+  last = fosfat_extent_search (extents, count, offset + size - 1);
+  if (last >= count)
+    last = count - 1;
+
+  /* At most one partial block, the full blocks and a partial block */
+  max = 3 * (last - first + 1);
+  if (max > countof (srun))
+  {
+    runs = malloc (max * (sizeof (*runs) + sizeof (*parts) + FOSFAT_BLK));
+    if (!runs)
+      return 0;
+
+    fosfat_stats_add (fosfat->stats.allocs, 1);
+
+    parts  = (extent_part_t *) (runs + max);
+    bounce = (uint8_t *) (parts + max);
+  }
+
+  for (i = first; i <= last && done < size; i++)
   {
-    fclose (f_dst);
+    fosfat_extent_t *ext = &extents[i];
+    uint32_t start = offset + done - ext->off;
+    uint32_t end   = MIN (ext->len, start + (size - done));
+
+    while (start < end)
+    {
+      uint32_t blk = start / FOSFAT_BLK;
+      uint32_t in  = start % FOSFAT_BLK;
+      uint32_t cp;
+
+      runs[n].block = ext->block + blk;
 
-    /* If fails then remove the incomplete file */
-    if (!res)
-      remove (dst);
+      /* Full blocks are read directly in the buffer */
+      if (!in && end - start >= FOSFAT_BLK)
+      {
+        runs[n].nbs  = (end - start) / FOSFAT_BLK;
+        runs[n].data = buffer + done;
+        parts[n].dst = NULL;
+        cp = runs[n].nbs * FOSFAT_BLK;
+      }
+      /* Partial block at the beginning or at the end of the range */
+      else
+      {
+        runs[n].nbs  = 1;
+        runs[n].data = bounce + n * FOSFAT_BLK;
+        parts[n].dst = buffer + done;
+        parts[n].in  = in;
+        cp = MIN (FOSFAT_BLK - in, end - start);
+      }
+
+      parts[n].len = cp;
+      n++;
+
+      start += cp;
+      done  += cp;
+    }
   }
 
+  /* Only the runs before the first error are copied */
+  if (!fosfat_read_runs (fosfat, runs, n, B_DATA))
+    for (i = 0; i < n; i++)
+      if (!fosfat_read_runs (fosfat, &runs[i], 1, B_DATA))
+      {
+        n = i;
+        break;
+      }
+
+  for (done = 0, i = 0; i < n; i++)
+  {
+    if (parts[i].dst)
+      memcpy (parts[i].dst, runs[i].data + parts[i].in, parts[i].len);
+    done += parts[i].len;
+  }
+
+  if (runs != srun)
+    free (runs);
+  return (int) done;
+}
+
+/*
+ * Get a part of a file in a buffer.
+ *
+ * fosfat       handle
+ * file         file description block
+ * offset       start byte in the file
+ * size         number of bytes
+ * buffer       where to copy the data
+ * return the number of bytes copied
+ */
+static int
+fosfat_get_range (fosfat_t *fosfat, fosfat_bd_t *file,
+                  uint32_t offset, uint32_t size, uint8_t *buffer)
+{
+  int res;
+  unsigned int count;
+  fosfat_extent_t *extents;
+
+  if (!fosfat || !file || !buffer)
+    return 0;
+
+  extents = fosfat_extents (file, &count);
+  if (!extents)
+    return 0;
+
+  fosfat_stats_add (fosfat->stats.allocs, 1);
+
+  res = fosfat_extent_read (fosfat, extents, count, offset, size, buffer);
+
+  free (extents);
   return res;
 }
 
@@ -1174,16 +1706,21 @@ fosfat_read_dir (fosfat_t *fosfat, uint32_t block)
     return NULL;
   }
 
+  fosfat_stats_add (fosfat->stats.bd_chains, 1);
+
   dir_desc->next_bd = NULL;
   dir_desc->first_bl = NULL;
   first_bd = dir_desc;
 
   do
   {
+    /* All tranches are in flight at the same time with io_uring */
+    fosfat_prefetch_bd (fosfat, dir_desc, B_BL);
+
     /* Get the first pointer */
     dir_desc->first_bl =
-      fosfat_read_data (fosfat, c2l(dir_desc->pts[0],
-                        sizeof (dir_desc->pts[0])), dir_desc->nbs[0], B_BL);
+      fosfat_read_data (fosfat, c2l (dir_desc->pts[0],
+                        sizeof (dir_desc->pts[0])), dir_desc->nbs[0]);
     dir_list = dir_desc->first_bl;
 
     /* Go to the last BL */
@@ -1196,7 +1733,7 @@ fosfat_read_dir (fosfat_t *fosfat, uint32_t block)
     {
       dir_list->next_bl =
         fosfat_read_data (fosfat, c2l (dir_desc->pts[i],
-                          sizeof (dir_desc->pts[i])), dir_desc->nbs[i], B_BL);
+                          sizeof (dir_desc->pts[i])), dir_desc->nbs[i]);
       dir_list = dir_list->next_bl;
 
       /* Go to the last BL */
@@ -1219,299 +1756,1087 @@ fosfat_read_dir (fosfat_t *fosfat, uint32_t block)
 }
 
 /*
- * Test if two names are the same or not.
- *
- * This function must be used only for particular purpose, because that will
- * no test if it is a directory or not, but only the names. That is very
- * useful for fosfat_search_incache().
- *
- * realname     the name of the file in the FOS
- * searchname   the name in the path
- * return true if it seems to be a dir name
+ * Path index
+ * ~~~~~~~~~~
+ * All files and directories of the cache are indexed by their directory
+ * and their name (case-folded). The directories and the soft-links are
+ * indexed a second time without the ".dir" suffix. The entries are stored
+ * in one array and the buckets are chained by indexes.
  */
-static inline int
-fosfat_isdirname (const char *realname, const char *searchname)
-{
-      /* Test with a name as foobar.dir */
-  if ((
-        my_strcasestr (realname, ".dir")
-        && !strncasecmp (realname, searchname, strlen (realname) - 4)
-        && strlen (searchname) == strlen (realname) - 4
-      ) ||
-      /* Test with a name as sys_list (without .dir) */
-      (
-        !strncasecmp (realname, searchname, strlen (realname))
-        && strlen (searchname) == strlen (realname)
-      ))
-    return 1;
 
-  return 0;
-}
+#define PATHIDX_SIZE          256
 
-/*
- * Search a BD or a BLF from a location in the cache.
- *
- * The location must not be bigger than MAX_SPLIT /!\
- *
- * fosfat       handle
- * location     path to found the BD/BLF (foo/bar/file)
- * type         S_BD or S_BLF
- * return the BD, BLF or NULL is nothing found
- */
-static void *
-fosfat_search_incache (fosfat_t *fosfat, const char *location,
-                       fosfat_search_t type)
+static uint32_t
+fosfat_pathidx_hash (uint32_t parent, const char *name, size_t len)
 {
-  int i, nb = 0, ontop = 1, isdir = 0;
-  char *tmp, *path, *name = NULL;
-  char dir[MAX_SPLIT][FOSFAT_NAMELGT];
-  cachelist_t *list;
-  uint32_t bd_block = 0, bl_block = 0;
-  fosfat_bl_t *bl_found = NULL;
-  fosfat_blf_t *blf_found = NULL;
-  fosfat_bd_t *bd_found = NULL;
-
-  if (!fosfat || !location)
-    return NULL;
-
-  list = fosfat->cachelist;
-  path = strdup (location);
+  size_t i;
+  uint32_t hash = 2166136261U;
 
-  /* Split the path into a table */
-  if ((tmp = strtok ((char *) path, "/")))
+  for (i = 0; i < len; i++)
   {
-    snprintf (dir[nb], sizeof (dir[nb]), "%s", tmp);
-    while ((tmp = strtok (NULL, "/")) && nb < MAX_SPLIT - 1)
-      snprintf (dir[++nb], sizeof (dir[nb]), "%s", tmp);
+    hash ^= (uint8_t) tolower ((unsigned char) name[i]);
+    hash *= 16777619U;
   }
-  else
-    snprintf (dir[nb], sizeof (dir[nb]), "%s", path);
-  nb++;
-
-  /* Loop for all directories in the path */
-  for (i = 0; list && i < nb; i++)
-    do
-    {
-      ontop = 1;
 
-      /* test if the file is deleted or not */
-      if (!fosfat->viewdel && list->isdel)
-        continue;
+  return hash ^ (parent + 1) * 2654435761U;
+}
 
-      /* Test if it is a directory */
-      if (list->isdir && fosfat_isdirname (list->name, dir[i]))
-      {
-        bd_block = list->bd;
-        bl_block = list->bl;
+/*
+ * Initialize an empty path index.
+ *
+ * idx          the index
+ * return a boolean (true for success)
+ */
+static int
+fosfat_pathidx_init (pathidx_t *idx)
+{
+  memset (idx, 0, sizeof (*idx));
 
-        if (name)
-          free (name);
+  idx->mask    = PATHIDX_SIZE - 1;
+  idx->buckets = malloc (PATHIDX_SIZE * sizeof (*idx->buckets));
+  if (!idx->buckets)
+    return 0;
 
-        name = strdup (list->name);
+  memset (idx->buckets, 0xFF, PATHIDX_SIZE * sizeof (*idx->buckets));
+  return 1;
+}
 
-        /* Go to the next level */
-        list = list->sub;
-        ontop = 0;
-        isdir = 1;
-      }
-      /* Test if it is a file or a soft-link */
-      else if (!list->isdir
-               && (!strcasecmp (list->name, dir[i])
-                   || (list->islink
-                       && fosfat_isdirname (list->name, dir[i]))
-                  )
-              )
-      {
-        bd_block = list->bd;
-        bl_block = list->bl;
+/*
+ * Release the path index.
+ *
+ * idx          the index
+ */
+static void
+fosfat_pathidx_release (pathidx_t *idx)
+{
+  free (idx->buckets);
+  free (idx->entries);
+  memset (idx, 0, sizeof (*idx));
+}
 
-        if (name)
-          free (name);
+/*
+ * Double the number of buckets.
+ *
+ * idx          the index
+ */
+static void
+fosfat_pathidx_grow (pathidx_t *idx)
+{
+  uint32_t i, mask = idx->mask * 2 + 1;
+  uint32_t *buckets;
 
-        name = strdup (list->name);
-        ontop = 0;
-        isdir = 0;
-      }
-    }
-    while (ontop && list && (list = list->next));
+  buckets = malloc ((mask + 1) * sizeof (*buckets));
+  if (!buckets)
+    return; /* the chains are just longer */
 
-  free (path);
+  memset (buckets, 0xFF, (mask + 1) * sizeof (*buckets));
 
-  if (ontop)
+  for (i = 0; i < idx->count; i++)
   {
-    if (name)
-      free (name);
-    return NULL;
-  }
+    pathidx_entry_t *e = &idx->entries[i];
 
-  switch (type)
-  {
-  case S_BD:
-  {
-    if (name)
-      free (name);
+    e->next = buckets[e->hash & mask];
+    buckets[e->hash & mask] = i;
+  }
 
-    if (isdir)
-      bd_found = fosfat_read_dir (fosfat, bd_block);
-    else
-      bd_found = fosfat_read_file (fosfat, bd_block);
+  free (idx->buckets);
+  idx->buckets = buckets;
+  idx->mask    = mask;
+}
 
-    return bd_found;
-  }
+static void
+fosfat_pathidx_add (pathidx_t *idx, uint32_t parent, uint32_t node,
+                    const char *name, size_t len)
+{
+  pathidx_entry_t *e;
 
-  case S_BLF:
+  if (idx->count == idx->size)
   {
-    bl_found = fosfat_read_bl (fosfat, bl_block);
+    uint32_t size = idx->size ? idx->size * 2 : PATHIDX_SIZE;
 
-    for (i = 0; bl_found && i < FOSFAT_NBL; i++)
+    e = realloc (idx->entries, size * sizeof (*e));
+    if (!e)
     {
-      char name_r[FOSFAT_NAMELGT];
-      snprintf (name_r, FOSFAT_NAMELGT, "%s",
-                (char) bl_found->file[i].name[0]
-                ? (char *) bl_found->file[i].name
-                : (char *) bl_found->file[i].name + 1);
-
-      if (!strcasecmp (name_r, name))
-      {
-        free (name);
-
-        blf_found = malloc (sizeof (fosfat_blf_t));
-        if (blf_found)
-        {
-          memcpy (blf_found, &bl_found->file[i], sizeof (*blf_found));
-          free (bl_found);
-
-          return blf_found;
-        }
-      }
+      idx->error = 1;
+      return;
     }
-
-    if (bl_found)
-      free (bl_found);
-  }
+    idx->entries = e;
+    idx->size    = size;
   }
 
-  if (name)
-    free (name);
+  if (idx->count > idx->mask)
+    fosfat_pathidx_grow (idx);
 
-  return NULL;
+  e = &idx->entries[idx->count];
+  e->parent = parent;
+  e->node   = node;
+  e->len    = (uint32_t) len;
+  e->hash   = fosfat_pathidx_hash (parent, name, len);
+  e->next   = idx->buckets[e->hash & idx->mask];
+  idx->buckets[e->hash & idx->mask] = idx->count++;
 }
 
 /*
- * Search a BD or a BLF from a location in the first SYS_LIST.
- *
- * That uses fosfat_search_incache().
+ * Add a file or a directory in the path index.
  *
  * fosfat       handle
- * location     path to found the BD (foo/bar/file)
- * type         S_BD or S_BLF
- * return the BD, BLF or NULL is nothing found
+ * node         index of the node in the cache
  */
-static void *
-fosfat_search_insys (fosfat_t *fosfat, const char *location,
-                     fosfat_search_t type)
+static void
+fosfat_pathidx_insert (fosfat_t *fosfat, uint32_t node)
 {
-  fosfat_bd_t *syslist;
-  void *search = NULL;
-
-  if (!fosfat || !location)
-    return NULL;
+  size_t len;
+  const cachenode_t *it = &fosfat->cache.nodes[node];
 
-  if (type == S_BD && (*location == '\0' || !strcmp (location, "/")))
-  {
-    syslist = fosfat_read_dir (fosfat, FOSFAT_SYSLIST);
-    return syslist;
-  }
-
-  search = fosfat_search_incache (fosfat, location, type);
-  if (search)
-    return search;
-
-  foslog (FOSLOG_WARNING, "file or directory \"%s\" not found", location);
+  len = strlen (it->name);
+  fosfat_pathidx_add (&fosfat->pathidx, it->parent, node, it->name, len);
 
-  return NULL;
+  /* Name as foobar.dir can be found with foobar */
+  if ((it->isdir || it->islink) && my_strcasestr (it->name, ".dir"))
+    fosfat_pathidx_add (&fosfat->pathidx,
+                        it->parent, node, it->name, len - 4);
 }
 
 /*
- * Return the device or image type.
+ * Search a name in a directory.
  *
- * This function uses a string location.
+ * When the same name is found more than one time, the first one in the
+ * directory is returned. The content of a directory is contiguous in the
+ * cache, then the order of the indexes is the order in the directory.
  *
  * fosfat       handle
- * return the type
+ * parent       index of the directory
+ * name         the name (not necessarily terminated by '\0')
+ * len          length of the name
+ * from         only the entries at this index (or after) are tested
+ * return the index of the node or PATHIDX_NONE if not found
  */
-fosfat_disk_t fosfat_type (fosfat_t *fosfat)
+static uint32_t
+fosfat_pathidx_lookup (fosfat_t *fosfat, uint32_t parent,
+                       const char *name, size_t len, uint32_t from)
 {
-  if (!fosfat)
-    return FOSFAT_ED;
+  uint32_t hash, i;
+  uint32_t found = PATHIDX_NONE;
+  const pathidx_t *idx = &fosfat->pathidx;
 
-  switch (fosfat->fosboot)
+  if (!idx->buckets)
+    return PATHIDX_NONE;
+
+  hash = fosfat_pathidx_hash (parent, name, len);
+
+  for (i = idx->buckets[hash & idx->mask]; i != PATHIDX_NONE;
+       i = idx->entries[i].next)
   {
-  case FOSBOOT_FD:
-    return FOSFAT_FD;
-  case FOSBOOT_HD:
-    return FOSFAT_HD;
-  default:
-    return FOSFAT_ED;
-  }
-}
+    const pathidx_entry_t *e = &idx->entries[i];
+    const cachenode_t *node;
 
-/*
- * Test if the file is a directory.
- *
- * This function uses a string location.
- *
- * fosfat       handle
- * location     file in the path
- * return a boolean (true for success)
- */
-int
-fosfat_isdir (fosfat_t *fosfat, const char *location)
-{
-  if (!fosfat || !location)
-    return 0;
+    if (e->hash != hash || e->parent != parent || e->len != len
+        || e->node < from || e->node > found)
+      continue;
 
-  if (!strcmp (location, "/"))
-    return 1;
+    node = &fosfat->cache.nodes[e->node];
 
-  FOSFAT_IS_DIR (fosfat, location)
-}
+    /* test if the file is deleted or not */
+    if (!fosfat->viewdel && node->isdel)
+      continue;
 
-/*
- * Test if the file is a link.
- *
- * This function uses a string location.
- *
- * fosfat       handle
- * location     file in the path
- * return a boolean (true for success)
- */
-int
-fosfat_islink (fosfat_t *fosfat, const char *location)
-{
-  if (!fosfat || !location)
-    return 0;
+    if (!strncasecmp (node->name, name, len))
+      found = e->node;
+  }
 
-  FOSFAT_IS_LINK (fosfat, location)
+  return found;
 }
 
 /*
- * Test if the file is visible.
- *
- * This function uses a string location.
+ * Decode the useful attributes of a file.
  *
- * fosfat       handle
- * location     file in the path
- * return a boolean (true for success)
+ * file         BLF on the file
+ * stat         where to put the attributes
  */
-int
-fosfat_isvisible (fosfat_t *fosfat, const char *location)
+static void
+fosfat_stat_fill (fosfat_blf_t *file, fosfat_file_t *stat)
 {
-  if (!fosfat || !location)
-    return 0;
+  /* Size (bytes) */
+  stat->size = c2l (file->lgf, sizeof (file->lgf));
 
-  FOSFAT_IS_VISIBLE (fosfat, location)
-}
+  /* Attributes (field bits) */
+  stat->att.isdir     = !!fosfat_in_isdir (file);
+  stat->att.isvisible = !!fosfat_in_isvisible (file);
+  stat->att.isencoded = !!fosfat_in_isencoded (file);
+  stat->att.islink    = !!fosfat_in_islink (file);
+  stat->att.isdel     = !fosfat_in_isnotdel (file);
+
+  /* Creation date */
+  stat->time_c.year   = y2k (bcd2int (file->cd[2]));
+  stat->time_c.month  = bcd2int (file->cd[1]);
+  stat->time_c.day    = bcd2int (file->cd[0]);
+  stat->time_c.hour   = bcd2int (file->ch[0]);
+  stat->time_c.minute = bcd2int (file->ch[1]);
+  stat->time_c.second = bcd2int (file->ch[2]);
+  /* Writing date */
+  stat->time_w.year   = y2k (bcd2int (file->wd[2]));
+  stat->time_w.month  = bcd2int (file->wd[1]);
+  stat->time_w.day    = bcd2int (file->wd[0]);
+  stat->time_w.hour   = bcd2int (file->wh[0]);
+  stat->time_w.minute = bcd2int (file->wh[1]);
+  stat->time_w.second = bcd2int (file->wh[2]);
+  /* Use date */
+  stat->time_r.year   = y2k (bcd2int (file->rd[2]));
+  stat->time_r.month  = bcd2int (file->rd[1]);
+  stat->time_r.day    = bcd2int (file->rd[0]);
+  stat->time_r.hour   = bcd2int (file->rh[0]);
+  stat->time_r.minute = bcd2int (file->rh[1]);
+  stat->time_r.second = bcd2int (file->rh[2]);
+
+  /* Name */
+  if (stat->att.isdel)
+  {
+    strncpy (stat->name, (char *) file->name + 1, sizeof (stat->name));
+    stat->name[15] = '\0';
+  }
+  else
+    strncpy (stat->name, (char *) file->name, sizeof (stat->name));
+  lc (stat->name);
+
+  stat->next_file = NULL;
+}
+
+/*
+ * Put file information in a node of the cache.
+ *
+ * file         BLF element in the BL
+ * bl           BL block's number
+ * node         where to put the informations
+ */
+static void
+fosfat_cache_file (fosfat_blf_t *file, uint32_t bl, cachenode_t *node)
+{
+  size_t len = sizeof (file->name);
+  const char *name = (const char *) file->name;
+  fosfat_file_t stat;
+
+  memset (node, 0, sizeof (*node));
+
+  node->isdir    = !!fosfat_in_isdir (file);
+  node->islink   = !!fosfat_in_islink (file);
+  node->issystem = !!fosfat_in_issystem (file);
+
+  /* if the first char is NULL, then the file is deleted */
+  if ((char) file->name[0] == '\0')
+  {
+    node->isdel = 1;
+    name++;
+    len = sizeof (file->name) - 1;
+  }
+
+  memcpy (node->name, name, strnlen (name, len));
+
+  node->bl = bl;
+  node->bd = c2l (file->pt, sizeof (file->pt));
+
+  /* The name and the flags are already in the node */
+  fosfat_stat_fill (file, &stat);
+  node->attr.size      = stat.size;
+  node->attr.isvisible = !!stat.att.isvisible;
+  node->attr.isencoded = !!stat.att.isencoded;
+  node->attr.time_c    = stat.time_c;
+  node->attr.time_w    = stat.time_w;
+  node->attr.time_r    = stat.time_r;
+}
+
+/*
+ * Build the attributes of a node for the user.
+ *
+ * node         node of the cache
+ * stat         where to put the attributes
+ */
+static void
+fosfat_node_stat (const cachenode_t *node, fosfat_file_t *stat)
+{
+  memcpy (stat->name, node->name, sizeof (stat->name));
+  lc (stat->name);
+
+  stat->size          = node->attr.size;
+  stat->att.isdir     = node->isdir;
+  stat->att.isvisible = node->attr.isvisible;
+  stat->att.isencoded = node->attr.isencoded;
+  stat->att.islink    = node->islink;
+  stat->att.isdel     = node->isdel;
+  stat->time_c        = node->attr.time_c;
+  stat->time_w        = node->attr.time_w;
+  stat->time_r        = node->attr.time_r;
+  stat->next_file     = NULL;
+}
+
+/*
+ * Initialize the cache with only the root.
+ *
+ * cache        the cache
+ * return a boolean (true for success)
+ */
+static int
+fosfat_cache_init (fosfat_cache_t *cache)
+{
+  memset (cache, 0, sizeof (*cache));
+
+  cache->size  = 256;
+  cache->nodes = calloc (cache->size, sizeof (cachenode_t));
+  if (!cache->nodes)
+    return 0;
+
+  cache->nodes[CACHE_ROOT].isdir = 1;
+  cache->nodes[CACHE_ROOT].bd    = FOSFAT_SYSLIST;
+  cache->count = 1;
+  return 1;
+}
+
+/*
+ * Release the cache.
+ *
+ * cache        the cache
+ */
+static void
+fosfat_cache_release (fosfat_cache_t *cache)
+{
+  free (cache->nodes);
+  memset (cache, 0, sizeof (*cache));
+}
+
+/*
+ * Add the content of a directory in the cache.
+ *
+ * The nodes are copied at the end of the arena and added in the path
+ * index. The nodes in the cache can be moved by this function.
+ *
+ * fosfat       handle
+ * parent       index of the directory
+ * nodes        the content
+ * count        number of nodes
+ * return a boolean (true for success)
+ */
+static int
+fosfat_cache_attach (fosfat_t *fosfat, uint32_t parent,
+                     const cachenode_t *nodes, uint32_t count)
+{
+  uint32_t i;
+  fosfat_cache_t *cache = &fosfat->cache;
+
+  if (cache->count + count > cache->size)
+  {
+    uint32_t size = cache->size;
+    cachenode_t *it;
+
+    while (cache->count + count > size)
+      size *= 2;
+
+    it = realloc (cache->nodes, size * sizeof (*it));
+    if (!it)
+    {
+      cache->error = 1;
+      return 0;
+    }
+
+    fosfat_stats_add (fosfat->stats.allocs, 1);
+    cache->nodes = it;
+    cache->size  = size;
+  }
+
+  memcpy (&cache->nodes[cache->count], nodes, count * sizeof (*nodes));
+  cache->nodes[parent].first  = cache->count;
+  cache->nodes[parent].count  = count;
+  cache->nodes[parent].loaded = 1;
+
+  for (i = cache->count; i < cache->count + count; i++)
+    cache->nodes[i].parent = parent;
+
+  cache->count += count;
+
+  for (i = cache->nodes[parent].first; i < cache->count; i++)
+    fosfat_pathidx_insert (fosfat, i);
+
+  return 1;
+}
+
+/*
+ * Read the content of one directory for the cache.
+ *
+ * The sub-directories are not loaded, they are marked as not loaded (the
+ * system directories are never loaded).
+ *
+ * fosfat       handle
+ * pt           block's number of the BD
+ * count        where to put the number of nodes
+ * return the nodes (must be freed) or NULL if the directory is empty
+ */
+static cachenode_t *
+fosfat_cache_level (fosfat_t *fosfat, uint32_t pt, uint32_t *count)
+{
+  int i;
+  uint32_t size = 0;
+  fosfat_bd_t *dir = NULL;
+  fosfat_bl_t *files;
+  cachenode_t *nodes = NULL;
+
+  *count = 0;
+
+  FOSFAT_PROBE1 (fosfat, cache__dir__start, pt);
+
+  dir = fosfat_read_dir (fosfat, pt);
+  if (!dir)
+    goto out;
+
+  for (files = dir->first_bl; files; files = files->next_bl)
+    size += FOSFAT_NBL;
+
+  if (!size)
+    goto out;
+
+  nodes = malloc (size * sizeof (cachenode_t));
+  if (!nodes)
+    goto out;
+
+  fosfat_stats_add (fosfat->stats.allocs, 1);
+
+  /* Check all files in the BL */
+  for (files = dir->first_bl; files; files = files->next_bl)
+    for (i = 0; i < FOSFAT_NBL; i++)
+    {
+      cachenode_t *node;
+
+      if (!fosfat_in_isopenexm (&files->file[i]))
+        continue;
+
+      if (!fosfat->viewdel && !fosfat_in_isnotdel (&files->file[i]))
+        continue;
+
+      node = &nodes[(*count)++];
+      fosfat_cache_file (&files->file[i], files->pt, node);
+      node->loaded = !fosfat_in_isdir (&files->file[i])
+                     || fosfat_in_issystem (&files->file[i]);
+    }
+
+  if (!*count)
+  {
+    foslog (FOSLOG_ERROR, "cache to block %i not correctly loaded", pt);
+    free (nodes);
+    nodes = NULL;
+  }
+
+ out:
+  fosfat_free_dir (dir);
+
+  FOSFAT_PROBE2 (fosfat, cache__dir__done, pt, *count);
+  return nodes;
+}
+
+/*
+ * Prefetch the first BD of all sub-directories.
+ *
+ * fosfat       handle
+ * parent       index of the directory in the cache
+ */
+static void
+fosfat_prefetch_dirs (fosfat_t *fosfat, uint32_t parent)
+{
+  uint32_t i, n = 0;
+  const cachenode_t *dir = &fosfat->cache.nodes[parent];
+  fosfat_blkrun_t *runs;
+
+  if (!fosfat_io_isasync (fosfat->dev) || dir->count < 2)
+    return;
+
+  runs = malloc (dir->count * sizeof (*runs));
+  if (!runs)
+    return;
+
+  fosfat_stats_add (fosfat->stats.allocs, 1);
+
+  for (i = dir->first; i < dir->first + dir->count; i++)
+  {
+    if (fosfat->cache.nodes[i].loaded)
+      continue;
+
+    runs[n].block = fosfat->cache.nodes[i].bd;
+    runs[n].nbs   = 1;
+    n++;
+  }
+
+  fosfat_prefetch (fosfat, runs, n, B_BD);
+  free (runs);
+}
+
+/*
+ * Load the content of a directory in the cache.
+ *
+ * This function is recursive! Each file is added in the path index. With
+ * the lazy mode, the sub-directories are not loaded; they are loaded by
+ * fosfat_search_incache() when needed.
+ *
+ * fosfat       handle
+ * parent       index of the directory in the cache
+ */
+static void
+fosfat_cache_dir (fosfat_t *fosfat, uint32_t parent)
+{
+  uint32_t i, count;
+  cachenode_t *nodes;
+
+  nodes = fosfat_cache_level (fosfat, fosfat->cache.nodes[parent].bd, &count);
+  if (!nodes)
+  {
+    fosfat->cache.nodes[parent].loaded = 1;
+    return;
+  }
+
+  if (!fosfat_cache_attach (fosfat, parent, nodes, count))
+  {
+    free (nodes);
+    return;
+  }
+
+  free (nodes);
+
+  if (!fosfat->lazy)
+    fosfat_prefetch_dirs (fosfat, parent);
+
+  /* If the file is a directory, then do a recursive cache */
+  for (i = 0; i < count && !fosfat->lazy; i++)
+  {
+    uint32_t node = fosfat->cache.nodes[parent].first + i;
+
+    if (!fosfat->cache.nodes[node].loaded)
+      fosfat_cache_dir (fosfat, node);
+  }
+}
+
+#ifndef _WIN32
+
+/* Shared states of the workers for the parallel scan */
+typedef struct cache_scan_s {
+  fosfat_t        *fosfat;
+  pthread_mutex_t  mutex;
+  pthread_cond_t   cond;
+  uint32_t        *queue;      /* Directories to load                   */
+  size_t           head;       /* Next directory for a worker           */
+  size_t           count;      /* Number of directories in the queue    */
+  size_t           size;       /* Size of the queue                     */
+  unsigned int     active;     /* Number of directories in progress     */
+  int              error;      /* The queue cannot grow                 */
+} cache_scan_t;
+
+/*
+ * Add the sub-directories of a directory in the queue (the lock must be
+ * held).
+ */
+static void
+fosfat_cache_scan_push (cache_scan_t *scan, uint32_t parent)
+{
+  uint32_t i;
+  const cachenode_t *dir = &scan->fosfat->cache.nodes[parent];
+
+  for (i = dir->first; i < dir->first + dir->count; i++)
+  {
+    if (scan->fosfat->cache.nodes[i].loaded)
+      continue;
+
+    if (scan->count == scan->size)
+    {
+      size_t size = scan->size ? scan->size * 2 : 64;
+      uint32_t *queue = realloc (scan->queue, size * sizeof (*queue));
+      if (!queue)
+      {
+        scan->error = 1;
+        return;
+      }
+      scan->queue = queue;
+      scan->size  = size;
+    }
+
+    scan->queue[scan->count++] = i;
+  }
+}
+
+/*
+ * Worker for the parallel scan.
+ *
+ * Each worker reads one directory at a time. The content is added in the
+ * cache and in the path index while the lock is held, and the
+ * sub-directories are added in the queue for the other workers.
+ */
+static void *
+fosfat_cache_scan_worker (void *data)
+{
+  cache_scan_t *scan = data;
+  fosfat_t *fosfat = scan->fosfat;
+
+  pthread_mutex_lock (&scan->mutex);
+
+  for (;;)
+  {
+    uint32_t dir, bd, count;
+    cachenode_t *nodes;
+
+    while (scan->head == scan->count && scan->active)
+      pthread_cond_wait (&scan->cond, &scan->mutex);
+
+    if (scan->head == scan->count)
+      break;
+
+    dir = scan->queue[scan->head++];
+    bd  = fosfat->cache.nodes[dir].bd;
+    scan->active++;
+    pthread_mutex_unlock (&scan->mutex);
+
+    nodes = fosfat_cache_level (fosfat, bd, &count);
+
+    pthread_mutex_lock (&scan->mutex);
+    if (!nodes)
+      fosfat->cache.nodes[dir].loaded = 1;
+    else if (fosfat_cache_attach (fosfat, dir, nodes, count))
+      fosfat_cache_scan_push (scan, dir);
+    free (nodes);
+    scan->active--;
+
+    /* New directories or the end of the scan */
+    pthread_cond_broadcast (&scan->cond);
+  }
+
+  pthread_mutex_unlock (&scan->mutex);
+  return NULL;
+}
+
+/*
+ * Load all directories with a pool of workers.
+ *
+ * The directories are read concurrently. The content of each directory is
+ * contiguous, then only the indexes in the cache can be different than
+ * with fosfat_cache_dir(), never the result of a search. The calling
+ * thread is a worker too.
+ *
+ * fosfat       handle
+ */
+static void
+fosfat_cache_scan (fosfat_t *fosfat)
+{
+  long cpus;
+  unsigned int i, nb = 0;
+  uint32_t count;
+  pthread_t threads[FOSFAT_SCAN_WORKERS];
+  cachenode_t *nodes;
+  cache_scan_t scan;
+
+  /* Only the root here, the workers are loading the directories */
+  nodes = fosfat_cache_level (fosfat, FOSFAT_SYSLIST, &count);
+  if (!nodes)
+    return;
+
+  if (!fosfat_cache_attach (fosfat, CACHE_ROOT, nodes, count))
+  {
+    free (nodes);
+    return;
+  }
+  free (nodes);
+
+  memset (&scan, 0, sizeof (scan));
+  scan.fosfat = fosfat;
+  pthread_mutex_init (&scan.mutex, NULL);
+  pthread_cond_init (&scan.cond, NULL);
+
+  fosfat_cache_scan_push (&scan, CACHE_ROOT);
+
+  /* The reads are waiting on the device, then more workers than cpus */
+  cpus = sysconf (_SC_NPROCESSORS_ONLN);
+  cpus = cpus > 0 ? cpus * 2 : 2;
+
+  for (i = 1; i < FOSFAT_SCAN_WORKERS && i < (unsigned long) cpus; i++)
+  {
+    if (pthread_create (&threads[nb], NULL, fosfat_cache_scan_worker, &scan))
+      break;
+    nb++;
+  }
+
+  foslog (FOSLOG_NOTICE, "parallel scan with %u workers", nb + 1);
+
+  fosfat_cache_scan_worker (&scan);
+
+  for (i = 0; i < nb; i++)
+    pthread_join (threads[i], NULL);
+
+  if (scan.error)
+    fosfat->cache.error = 1;
+
+  free (scan.queue);
+  pthread_cond_destroy (&scan.cond);
+  pthread_mutex_destroy (&scan.mutex);
+}
+
+#endif /* !_WIN32 */
+
+/*
+ * Get the next name in a path.
+ *
+ * path         the path (foo/bar/file)
+ * len          where to put the length of the name
+ * return the first char of the name or NULL if there is no name
+ */
+static inline const char *
+fosfat_path_next (const char *path, size_t *len)
+{
+  while (*path == '/')
+    path++;
+
+  if (!*path)
+    return NULL;
+
+  *len = strcspn (path, "/");
+  return path;
+}
+
+/*
+ * Search a file or a directory in the cache.
+ *
+ * Each name of the location is searched in the path index, then the cost
+ * depends only of the depth. Only the MAX_SPLIT first names are used.
+ * There is no access on the device, excepted for loading a directory with
+ * the lazy mode. The probes lookup__start and lookup__done are around the
+ * search, with the location, the depth and the BD (0 if not found).
+ *
+ * fosfat       handle
+ * location     path to found the node (foo/bar/file)
+ * found        where to copy the node
+ * return the index of the node or PATHIDX_NONE if not found
+ */
+static uint32_t
+fosfat_search_node (fosfat_t *fosfat, const char *location,
+                    cachenode_t *found)
+{
+  int i;
+  size_t len;
+  uint32_t from = 0;
+  uint32_t parent = CACHE_ROOT, node = PATHIDX_NONE;
+  const char *it;
+
+  if (!fosfat || !location)
+    return PATHIDX_NONE;
+
+  it = fosfat_path_next (location, &len);
+  if (!it)
+  {
+    it = location;
+    len = strlen (location);
+  }
+
+  fosfat_stats_add (fosfat->stats.lookups, 1);
+  FOSFAT_PROBE1 (fosfat, lookup__start, location);
+
+  /* The cache can grow (and move) while an other thread is searching */
+  if (fosfat->lazy)
+    fosfat_mutex_lock (&fosfat->cachelock);
+
+  /* Loop for all names in the path */
+  for (i = 0; it && i < MAX_SPLIT; i++)
+  {
+    cachenode_t *n;
+
+    /* The names are limited like in the FOS */
+    node = fosfat_pathidx_lookup (fosfat, parent, it,
+                                  MIN (len, FOSFAT_NAMELGT - 1), from);
+    if (node == PATHIDX_NONE)
+      break;
+
+    n = &fosfat->cache.nodes[node];
+
+    /* Go to the next level */
+    if (n->isdir)
+    {
+      /* Load the directory on demand */
+      if (!n->loaded)
+      {
+        fosfat_cache_dir (fosfat, node);
+        n = &fosfat->cache.nodes[node];
+      }
+
+      if (!n->count)
+        break;
+
+      parent = node;
+      from = 0;
+    }
+    /* A file or a soft-link stays in the same level */
+    else
+      from = node;
+
+    it = it[len] ? fosfat_path_next (it + len, &len) : NULL;
+  }
+
+  if (node != PATHIDX_NONE)
+    *found = fosfat->cache.nodes[node];
+
+  if (fosfat->lazy)
+    fosfat_mutex_unlock (&fosfat->cachelock);
+
+  if (node != PATHIDX_NONE)
+    fosfat_stats_add (fosfat->stats.lookup_hits, 1);
+  else
+    fosfat_stats_add (fosfat->stats.lookup_misses, 1);
+
+  fosfat_stats_add (fosfat->stats.depth, i);
+  fosfat_stats_max (&fosfat->stats.depth_max, i);
+
+  FOSFAT_PROBE3 (fosfat, lookup__done, location, i,
+                 node != PATHIDX_NONE ? found->bd : 0);
+  return node;
+}
+
+/*
+ * Search a BD or a BLF from a location in the cache.
+ *
+ * That uses fosfat_search_node().
+ *
+ * fosfat       handle
+ * location     path to found the BD/BLF (foo/bar/file)
+ * type         S_BD or S_BLF
+ * return the BD, BLF or NULL is nothing found
+ */
+static void *
+fosfat_search_incache (fosfat_t *fosfat, const char *location,
+                       fosfat_search_t type)
+{
+  int i;
+  cachenode_t found;
+  fosfat_bl_t *bl_found = NULL;
+  fosfat_blf_t *blf_found = NULL;
+  fosfat_bd_t *bd_found = NULL;
+
+  if (fosfat_search_node (fosfat, location, &found) == PATHIDX_NONE)
+    return NULL;
+
+  switch (type)
+  {
+  case S_BD:
+  {
+    if (found.isdir)
+      bd_found = fosfat_read_dir (fosfat, found.bd);
+    else
+      bd_found = fosfat_read_file (fosfat, found.bd);
+
+    return bd_found;
+  }
+
+  case S_BLF:
+  {
+    bl_found = fosfat_read_bl (fosfat, found.bl);
+
+    for (i = 0; bl_found && i < FOSFAT_NBL; i++)
+    {
+      char name_r[FOSFAT_NAMELGT];
+      snprintf (name_r, FOSFAT_NAMELGT, "%s",
+                (char) bl_found->file[i].name[0]
+                ? (char *) bl_found->file[i].name
+                : (char *) bl_found->file[i].name + 1);
+
+      if (!strcasecmp (name_r, found.name))
+      {
+        blf_found = malloc (sizeof (fosfat_blf_t));
+        if (blf_found)
+        {
+          fosfat_stats_add (fosfat->stats.allocs, 1);
+          memcpy (blf_found, &bl_found->file[i], sizeof (*blf_found));
+          free (bl_found);
+
+          return blf_found;
+        }
+      }
+    }
+
+    if (bl_found)
+      free (bl_found);
+  }
+  }
+
+  return NULL;
+}
+
+/*
+ * Search a BD or a BLF from a location in the first SYS_LIST.
+ *
+ * That uses fosfat_search_incache().
+ *
+ * fosfat       handle
+ * location     path to found the BD (foo/bar/file)
+ * type         S_BD or S_BLF
+ * return the BD, BLF or NULL is nothing found
+ */
+static void *
+fosfat_search_insys (fosfat_t *fosfat, const char *location,
+                     fosfat_search_t type)
+{
+  fosfat_bd_t *syslist;
+  void *search = NULL;
+
+  if (!fosfat || !location)
+    return NULL;
+
+  if (type == S_BD && (*location == '\0' || !strcmp (location, "/")))
+  {
+    syslist = fosfat_read_dir (fosfat, FOSFAT_SYSLIST);
+    return syslist;
+  }
+
+  search = fosfat_search_incache (fosfat, location, type);
+  if (search)
+    return search;
+
+  foslog (FOSLOG_WARNING, "file or directory \"%s\" not found", location);
+
+  return NULL;
+}
+
+/*
+ * Search the decoded attributes of a file or a directory.
+ *
+ * The attributes are in the cache, then the device is not read.
+ *
+ * fosfat       handle
+ * location     path to found the file (foo/bar/file)
+ * stat         where to copy the attributes
+ * bd           where to copy the BD block's number (or NULL)
+ * return a boolean (true if found)
+ */
+static int
+fosfat_search_stat (fosfat_t *fosfat, const char *location,
+                    fosfat_file_t *stat, uint32_t *bd)
+{
+  cachenode_t found;
+
+  if (fosfat_search_node (fosfat, location, &found) == PATHIDX_NONE)
+  {
+    foslog (FOSLOG_WARNING, "file or directory \"%s\" not found", location);
+    return 0;
+  }
+
+  fosfat_node_stat (&found, stat);
+  if (bd)
+    *bd = found.bd;
+  return 1;
+}
+
+/*
+ * Return the device or image type.
+ *
+ * This function uses a string location.
+ *
+ * fosfat       handle
+ * return the type
+ */
+fosfat_disk_t fosfat_type (fosfat_t *fosfat)
+{
+  if (!fosfat)
+    return FOSFAT_ED;
+
+  switch (fosfat->fosboot)
+  {
+  case FOSBOOT_FD:
+    return FOSFAT_FD;
+  case FOSBOOT_HD:
+    return FOSFAT_HD;
+  default:
+    return FOSFAT_ED;
+  }
+}
+
+/*
+ * Get all attributes of a file.
+ *
+ * The attributes are in the cache, then the device is not read.
+ *
+ * fosfat       handle
+ * location     file in the path
+ * info         where to put the attributes
+ * return a boolean (true if found)
+ */
+int
+fosfat_lookup (fosfat_t *fosfat, const char *location, fosfat_info_t *info)
+{
+  fosfat_file_t stat;
+
+  if (!fosfat || !location || !info)
+    return 0;
+
+  memset (info, 0, sizeof (*info));
+
+  /* The root is only a directory */
+  if (!strcmp (location, "/"))
+  {
+    info->att.isdir = 1;
+    info->bd        = FOSFAT_SYSLIST;
+    return 1;
+  }
+
+  if (!fosfat_search_stat (fosfat, location, &stat, &info->bd))
+    return 0;
+
+  /* Only the files with OPENEX or MULTIPLE are in the cache */
+  info->size      = stat.size;
+  info->att       = stat.att;
+  info->isopenexm = 1;
+
+  return 1;
+}
+
+/*
+ * Test if the file is a directory.
+ *
+ * This function uses a string location.
+ *
+ * fosfat       handle
+ * location     file in the path
+ * return a boolean (true for success)
+ */
+int
+fosfat_isdir (fosfat_t *fosfat, const char *location)
+{
+  if (!fosfat || !location)
+    return 0;
+
+  FOSFAT_IS_DIR (fosfat, location)
+}
+
+/*
+ * Test if the file is a link.
+ *
+ * This function uses a string location.
+ *
+ * fosfat       handle
+ * location     file in the path
+ * return a boolean (true for success)
+ */
+int
+fosfat_islink (fosfat_t *fosfat, const char *location)
+{
+  if (!fosfat || !location)
+    return 0;
+
+  FOSFAT_IS_LINK (fosfat, location)
+}
+
+/*
+ * Test if the file is visible.
+ *
+ * This function uses a string location.
+ *
+ * fosfat       handle
+ * location     file in the path
+ * return a boolean (true for success)
+ */
+int
+fosfat_isvisible (fosfat_t *fosfat, const char *location)
+{
+  if (!fosfat || !location)
+    return 0;
+
+  FOSFAT_IS_VISIBLE (fosfat, location)
+}
 
 /*
  * Test if the file is encoded.
@@ -1562,16 +2887,17 @@ fosfat_isopenexm (fosfat_t *fosfat, const char *location)
 static char *
 fosfat_get_link (fosfat_t *fosfat, fosfat_bd_t *file)
 {
-  fosfat_data_t *data;
+  uint8_t *data;
   char *path = NULL;
   char *start, *it;
 
-  data = fosfat_read_data (fosfat, c2l (file->pts[0], sizeof (file->pts[0])),
-                           file->nbs[0], B_DATA);
+  data = fosfat_read_tranche (fosfat, c2l (file->pts[0],
+                              sizeof (file->pts[0])),
+                              file->nbs[0] ? file->nbs[0] : 1, B_DATA);
   if (!data)
     return NULL;
 
-  start = (char *) data->data + 3;
+  start = (char *) data + 3;
 
   while ((it = my_strnchr (start, strlen (start), ':')))
     *it = '/';
@@ -1582,9 +2908,12 @@ fosfat_get_link (fosfat_t *fosfat, fosfat_bd_t *file)
 
   path = strdup (start);
   if (path)
+  {
+    fosfat_stats_add (fosfat->stats.allocs, 1);
     lc (path);
+  }
 
-  fosfat_free_data (data);
+  free (data);
 
   return path;
 }
@@ -1629,60 +2958,18 @@ fosfat_symlink (fosfat_t *fosfat, const char *location)
  * return the stat
  */
 static fosfat_file_t *
-fosfat_stat (fosfat_blf_t *file)
-{
-  fosfat_file_t *stat = NULL;
-
-  if (!file)
-    return NULL;
-
-  stat = malloc (sizeof (fosfat_file_t));
-  if (!stat)
-    return NULL;
-
-  /* Size (bytes) */
-  stat->size = c2l (file->lgf, sizeof (file->lgf));
-
-  /* Attributes (field bits) */
-  stat->att.isdir     = !!fosfat_in_isdir (file);
-  stat->att.isvisible = !!fosfat_in_isvisible (file);
-  stat->att.isencoded = !!fosfat_in_isencoded (file);
-  stat->att.islink    = !!fosfat_in_islink (file);
-  stat->att.isdel     = !fosfat_in_isnotdel (file);
-
-  /* Creation date */
-  stat->time_c.year   = y2k (bcd2int (file->cd[2]));
-  stat->time_c.month  = bcd2int (file->cd[1]);
-  stat->time_c.day    = bcd2int (file->cd[0]);
-  stat->time_c.hour   = bcd2int (file->ch[0]);
-  stat->time_c.minute = bcd2int (file->ch[1]);
-  stat->time_c.second = bcd2int (file->ch[2]);
-  /* Writing date */
-  stat->time_w.year   = y2k (bcd2int (file->wd[2]));
-  stat->time_w.month  = bcd2int (file->wd[1]);
-  stat->time_w.day    = bcd2int (file->wd[0]);
-  stat->time_w.hour   = bcd2int (file->wh[0]);
-  stat->time_w.minute = bcd2int (file->wh[1]);
-  stat->time_w.second = bcd2int (file->wh[2]);
-  /* Use date */
-  stat->time_r.year   = y2k (bcd2int (file->rd[2]));
-  stat->time_r.month  = bcd2int (file->rd[1]);
-  stat->time_r.day    = bcd2int (file->rd[0]);
-  stat->time_r.hour   = bcd2int (file->rh[0]);
-  stat->time_r.minute = bcd2int (file->rh[1]);
-  stat->time_r.second = bcd2int (file->rh[2]);
+fosfat_stat (fosfat_blf_t *file)
+{
+  fosfat_file_t *stat = NULL;
 
-  /* Name */
-  if (stat->att.isdel)
-  {
-    strncpy (stat->name, (char *) file->name + 1, sizeof (stat->name));
-    stat->name[15] = '\0';
-  }
-  else
-    strncpy (stat->name, (char *) file->name, sizeof (stat->name));
-  lc (stat->name);
+  if (!file)
+    return NULL;
 
-  stat->next_file = NULL;
+  stat = malloc (sizeof (fosfat_file_t));
+  if (!stat)
+    return NULL;
+
+  fosfat_stat_fill (file, stat);
 
   return stat;
 }
@@ -1699,17 +2986,18 @@ fosfat_stat (fosfat_blf_t *file)
 fosfat_file_t *
 fosfat_get_stat (fosfat_t *fosfat, const char *location)
 {
-  fosfat_blf_t *entry;
   fosfat_file_t *stat = NULL;
 
   if (!fosfat || !location)
     return NULL;
 
-  entry = fosfat_search_insys (fosfat, location, S_BLF);
-  if (entry)
+  stat = malloc (sizeof (fosfat_file_t));
+  if (stat)
+    fosfat_stats_add (fosfat->stats.allocs, 1);
+  if (stat && !fosfat_search_stat (fosfat, location, stat, NULL))
   {
-    stat = fosfat_stat (entry);
-    free (entry);
+    free (stat);
+    stat = NULL;
   }
 
   if (!stat)
@@ -1731,6 +3019,7 @@ fosfat_file_t *
 fosfat_list_dir (fosfat_t *fosfat, const char *location)
 {
   int i;
+  fosfat_info_t info;
   fosfat_bd_t *dir;
   fosfat_bl_t *files;
   fosfat_file_t *sysdir = NULL;
@@ -1741,13 +3030,13 @@ fosfat_list_dir (fosfat_t *fosfat, const char *location)
   if (!fosfat || !location)
     return NULL;
 
-  if (!fosfat_isdir (fosfat, location))
+  if (!fosfat_lookup (fosfat, location, &info) || !info.att.isdir)
   {
     foslog (FOSLOG_WARNING, "directory \"%s\" is unknown", location);
     return NULL;
   }
 
-  dir = fosfat_search_insys (fosfat, location, S_BD);
+  dir = fosfat_read_dir (fosfat, info.bd);
   if (!dir)
     return NULL;
 
@@ -1768,6 +3057,9 @@ fosfat_list_dir (fosfat_t *fosfat, const char *location)
         if (!strcasecmp ((char *) files->file[i].name, "sys_list"))
         {
           sysdir = fosfat_stat (&files->file[i]);
+          if (!sysdir)
+            continue;
+          fosfat_stats_add (fosfat->stats.allocs, 1);
           strcpy (sysdir->name, "..dir");
         }
         continue;
@@ -1782,86 +3074,536 @@ fosfat_list_dir (fosfat_t *fosfat, const char *location)
         if (listdir)
         {
           listdir->next_file = fosfat_stat (&files->file[i]);
+          if (!listdir->next_file)
+            continue;
           listdir = listdir->next_file;
         }
         else
         {
           firstfile = fosfat_stat (&files->file[i]);
+          if (!firstfile)
+            continue;
           listdir = firstfile;
         }
+        fosfat_stats_add (fosfat->stats.allocs, 1);
       }
     }
     files = files->next_bl;
   }
   while (files);
 
-  fosfat_free_dir (dir);
+  fosfat_free_dir (dir);
+
+  if (sysdir)
+  {
+    sysdir->next_file = firstfile;
+    res = sysdir;
+  }
+  else
+    res = firstfile;
+
+  if (res)
+    foslog (FOSLOG_NOTICE, "directory \"%s\" is read successfully", location);
+
+  return res;
+}
+
+/*
+ * Open a directory stream.
+ *
+ * The entries are the same than with fosfat_list_dir(), but they are
+ * read in the cache one by one.
+ *
+ * fosfat       handle
+ * location     directory in the path
+ * return the stream
+ */
+fosfat_dir_t *
+fosfat_opendir (fosfat_t *fosfat, const char *location)
+{
+  uint32_t i, node = CACHE_ROOT;
+  cachenode_t found;
+  fosfat_dir_t *dir;
+
+  if (!fosfat || !location)
+    return NULL;
+
+  if (strcmp (location, "/"))
+    node = fosfat_search_node (fosfat, location, &found);
+
+  if (node == PATHIDX_NONE || (node != CACHE_ROOT && !found.isdir))
+  {
+    foslog (FOSLOG_WARNING, "directory \"%s\" is unknown", location);
+    return NULL;
+  }
+
+  dir = malloc (sizeof (fosfat_dir_t));
+  if (!dir)
+    return NULL;
+
+  fosfat_stats_add (fosfat->stats.allocs, 1);
+
+  if (fosfat->lazy)
+    fosfat_mutex_lock (&fosfat->cachelock);
+
+  dir->fosfat = fosfat;
+  dir->first  = fosfat->cache.nodes[node].first;
+  dir->count  = fosfat->cache.nodes[node].count;
+  dir->pos    = 0;
+  dir->sysdir = PATHIDX_NONE;
+
+  /* The SYS_LIST is the parent directory, always given first */
+  for (i = dir->first; i < dir->first + dir->count; i++)
+  {
+    const cachenode_t *it = &fosfat->cache.nodes[i];
+
+    if (it->issystem && !it->isdel && !strcasecmp (it->name, "sys_list"))
+      dir->sysdir = i;
+  }
+
+  if (fosfat->lazy)
+    fosfat_mutex_unlock (&fosfat->cachelock);
+
+  return dir;
+}
+
+/*
+ * Read the next entry of a directory stream.
+ *
+ * There is no allocation and no access on the device.
+ *
+ * dir          the stream
+ * entry        where to copy the entry
+ * return a boolean (false at the end of the directory)
+ */
+int
+fosfat_readdir (fosfat_dir_t *dir, fosfat_file_t *entry)
+{
+  int res = 0;
+  fosfat_t *fosfat;
+
+  if (!dir || !entry)
+    return 0;
+
+  fosfat = dir->fosfat;
+
+  if (fosfat->lazy)
+    fosfat_mutex_lock (&fosfat->cachelock);
+
+  if (dir->sysdir != PATHIDX_NONE)
+  {
+    fosfat_node_stat (&fosfat->cache.nodes[dir->sysdir], entry);
+    strcpy (entry->name, "..dir");
+    dir->sysdir = PATHIDX_NONE;
+    res = 1;
+  }
+
+  /* The system files are not listed */
+  for (; !res && dir->pos < dir->count; dir->pos++)
+  {
+    const cachenode_t *it = &fosfat->cache.nodes[dir->first + dir->pos];
+
+    if (it->issystem)
+      continue;
+
+    fosfat_node_stat (it, entry);
+    res = 1;
+  }
+
+  if (fosfat->lazy)
+    fosfat_mutex_unlock (&fosfat->cachelock);
+
+  if (res)
+    entry->next_file = NULL;
+
+  return res;
+}
+
+/*
+ * Close a directory stream.
+ *
+ * dir          the stream
+ */
+void
+fosfat_closedir (fosfat_dir_t *dir)
+{
+  free (dir);
+}
+
+/*
+ * Get a file and put this in a location on the PC.
+ *
+ * This function create a copy from src to dst. An output variable can be
+ * used to print the current size for each PTS.
+ *
+ * fosfat       handle
+ * src          source on the Smaky disk
+ * dst          destination on your PC
+ * output       TRUE to print the size
+ * return a boolean (true for success)
+ */
+int
+fosfat_get_file (fosfat_t *fosfat, const char *src,
+                 const char *dst, int output)
+{
+  int res = 0;
+  fosfat_blf_t *file;
+  fosfat_bd_t *file2;
+
+  if (!fosfat || !src || !dst)
+    return 0;
+
+  file = fosfat_search_insys (fosfat, src, S_BLF);
+  if (file)
+  {
+    if (!fosfat_in_isdir (file))
+    {
+      file2 = fosfat_read_file (fosfat, c2l (file->pt, sizeof (file->pt)));
+
+      if (file2 && fosfat_get (fosfat, file2, dst, output))
+        res = 1;
+
+      fosfat_free_file (file2);
+    }
+
+    free (file);
+  }
+
+  if (!res)
+    foslog (FOSLOG_WARNING, "file \"%s\" cannot be copied", src);
+  else
+    foslog (FOSLOG_NOTICE, "get file \"%s\" and save to \"%s\"", src, dst);
+
+  return res;
+}
+
+/*
+ * Read a part of a file in a buffer provided by the caller.
+ *
+ * fosfat       handle
+ * path         source on the Smaky disk
+ * offset       start byte in the file
+ * size         number of bytes to read
+ * dst          where to copy the data (at least size bytes)
+ * return the number of bytes read or -1 on error
+ */
+int
+fosfat_read_into (fosfat_t *fosfat, const char *path,
+                  int offset, int size, uint8_t *dst)
+{
+  int res = -1;
+  fosfat_blf_t *file;
+  fosfat_bd_t *file2;
+
+  if (!fosfat || !path || !dst || offset < 0 || size < 0)
+    return -1;
+
+  file = fosfat_search_insys (fosfat, path, S_BLF);
+  if (file && !fosfat_in_isdir (file))
+  {
+    file2 = fosfat_read_file (fosfat, c2l (file->pt, sizeof (file->pt)));
+    if (file2)
+    {
+      res = fosfat_get_range (fosfat, file2, offset, size, dst);
+      fosfat_free_file (file2);
+    }
+  }
+
+  if (file)
+    free (file);
+
+  if (res < 0)
+    foslog (FOSLOG_ERROR, "data (offset:%i size:%i) of \"%s\" not read",
+            offset, size, path);
+  else
+    foslog (FOSLOG_NOTICE, "data (offset:%i size:%i) of \"%s\" correctly read",
+            offset, size, path);
+
+  return res;
+}
+
+/*
+ * Open a file for reading.
+ *
+ * The BD are read only here and the extent index is kept with the handle.
+ *
+ * fosfat       handle
+ * path         source on the Smaky disk
+ * return the file handle or NULL on error
+ */
+fosfat_fh_t *
+fosfat_fopen (fosfat_t *fosfat, const char *path)
+{
+  fosfat_info_t info;
+  fosfat_bd_t *file;
+  fosfat_fh_t *fh;
+
+  if (!fosfat || !path)
+    return NULL;
+
+  if (!fosfat_lookup (fosfat, path, &info) || info.att.isdir)
+  {
+    foslog (FOSLOG_WARNING, "file \"%s\" cannot be opened", path);
+    return NULL;
+  }
+
+  fh = calloc (1, sizeof (fosfat_fh_t));
+  if (!fh)
+    return NULL;
+
+  fosfat_stats_add (fosfat->stats.allocs, 1);
+
+  file = fosfat_read_file (fosfat, info.bd);
+  if (!file)
+  {
+    foslog (FOSLOG_ERROR, "BD of \"%s\" not read", path);
+    free (fh);
+    return NULL;
+  }
+
+  fosfat_mutex_init (&fh->lock);
+
+  /* An empty file has no extent */
+  fh->fosfat  = fosfat;
+  fh->extents = fosfat_extents (file, &fh->count);
+  if (fh->extents)
+    fosfat_stats_add (fosfat->stats.allocs, 1);
+  if (fh->count)
+    fh->size = fh->extents[fh->count - 1].off + fh->extents[fh->count - 1].len;
+
+  fosfat_free_file (file);
+  return fh;
+}
+
+/*
+ * Detect the sequential reads and prefetch the next tranches.
+ *
+ * The window is doubled with each read which follows the previous one,
+ * and it is dropped with a random access. New tranches are pushed only
+ * when less than the half of the window is already prefetched.
+ *
+ * fh           file handle
+ * offset       start byte of the read
+ * size         number of bytes of the read
+ */
+static void
+fosfat_fh_readahead (fosfat_fh_t *fh, uint32_t offset, uint32_t size)
+{
+  unsigned int i;
+  int sequential;
+  uint32_t start, stop, max, end = offset + size;
+  fosfat_t *fosfat = fh->fosfat;
+
+  /* The prefetched blocks must stay in the cache until they are read */
+  max = MIN (fosfat->ra_max, fosfat_blkcache_blocks (fosfat->blkcache) / 2);
+  if (!max || !fosfat->readahead)
+    return;
+
+  fosfat_mutex_lock (&fh->lock);
+
+  sequential = offset == fh->ra_next;
+  if (sequential)
+    fh->ra_window = fh->ra_window ? MIN (fh->ra_window * 2, max)
+                                  : MIN (fosfat->ra_min, max);
+  else
+  {
+    fh->ra_window = 0;
+    fh->ra_end    = 0;
+  }
+
+  fh->ra_next = end;
+
+  start = MAX (end, fh->ra_end);
+  stop  = MIN (fh->size, end + fh->ra_window * FOSFAT_BLK);
+
+  if (!fh->ra_window || start >= stop
+      || start - end > fh->ra_window * FOSFAT_BLK / 2)
+    stop = start;
+  else
+    fh->ra_end = stop;
+
+  fosfat_mutex_unlock (&fh->lock);
+
+  fosfat_ra_account (fosfat->readahead, sequential);
+
+  /* Push the blocks of each tranche which overlaps the new range */
+  for (i = fosfat_extent_search (fh->extents, fh->count, start);
+       i < fh->count && start < stop; i++)
+  {
+    fosfat_extent_t *ext = &fh->extents[i];
+    uint32_t first, last;
+
+    /* A BD (not the last) can end with an empty tranche */
+    if (!ext->len)
+      continue;
+
+    first = (start - ext->off) / FOSFAT_BLK;
+    last  = (MIN (stop, ext->off + ext->len) - 1 - ext->off) / FOSFAT_BLK;
+
+    fosfat_ra_push (fosfat->readahead, ext->block + first, last - first + 1);
+    start = ext->off + ext->len;
+  }
+}
+
+/*
+ * Wait for the blocks of a range which are prefetched by the worker.
+ *
+ * Without that, a sequential reader and the worker are both missing the
+ * cache and both are reading the same blocks on the device.
+ *
+ * fh           file handle
+ * offset       start byte in the file
+ * size         number of bytes
+ */
+static void
+fosfat_fh_wait (fosfat_fh_t *fh, uint32_t offset, uint32_t size)
+{
+  unsigned int i;
+  uint32_t end = offset + size;
+  fosfat_ra_t *ra = fh->fosfat->readahead;
+
+  if (!ra || !size)
+    return;
+
+  for (i = fosfat_extent_search (fh->extents, fh->count, offset);
+       i < fh->count && offset < end; i++)
+  {
+    fosfat_extent_t *ext = &fh->extents[i];
+    uint32_t first, last;
+
+    if (!ext->len)
+      continue;
+
+    first = (offset - ext->off) / FOSFAT_BLK;
+    last  = (MIN (end, ext->off + ext->len) - 1 - ext->off) / FOSFAT_BLK;
+
+    fosfat_ra_wait_range (ra, ext->block + first, last - first + 1);
+    offset = ext->off + ext->len;
+  }
+}
+
+/*
+ * Read at an offset without to change the position.
+ *
+ * fh           file handle
+ * dst          where to copy the data (at least size bytes)
+ * size         number of bytes to read
+ * offset       start byte in the file
+ * return the number of bytes read or -1 on error
+ */
+int
+fosfat_fpread (fosfat_fh_t *fh, uint8_t *dst, int size, int offset)
+{
+  int res;
+
+  if (!fh || !dst || offset < 0 || size < 0)
+    return -1;
 
-  if (sysdir)
+  if ((uint32_t) offset >= fh->size)
+    return 0;
+
+  size = (int) MIN ((uint32_t) size, fh->size - (uint32_t) offset);
+  fosfat_fh_readahead (fh, (uint32_t) offset, (uint32_t) size);
+  fosfat_fh_wait (fh, (uint32_t) offset, (uint32_t) size);
+
+  res = fosfat_extent_read (fh->fosfat, fh->extents, fh->count,
+                            (uint32_t) offset, (uint32_t) size, dst);
+
+  /* The blocks are in the extents, a short read is an I/O error */
+  if (res < size)
   {
-    sysdir->next_file = firstfile;
-    res = sysdir;
+    foslog (FOSLOG_ERROR, "data (offset:%i size:%i) not read", offset, size);
+    return -1;
   }
-  else
-    res = firstfile;
-
-  if (res)
-    foslog (FOSLOG_NOTICE, "directory \"%s\" is read successfully", location);
 
   return res;
 }
 
 /*
- * Get a file and put this in a location on the PC.
+ * Read at the current position and move the position.
  *
- * This function create a copy from src to dst. An output variable can be
- * used to print the current size for each PTS.
+ * fh           file handle
+ * dst          where to copy the data (at least size bytes)
+ * size         number of bytes to read
+ * return the number of bytes read or -1 on error
+ */
+int
+fosfat_fread (fosfat_fh_t *fh, uint8_t *dst, int size)
+{
+  int res;
+
+  if (!fh || fh->pos > INT_MAX)
+    return -1;
+
+  res = fosfat_fpread (fh, dst, size, (int) fh->pos);
+  if (res > 0)
+    fh->pos += res;
+
+  return res;
+}
+
+/*
+ * Change the position.
  *
- * fosfat       handle
- * src          source on the Smaky disk
- * dst          destination on your PC
- * output       TRUE to print the size
- * return a boolean (true for success)
+ * fh           file handle
+ * offset       number of bytes
+ * whence       SEEK_SET, SEEK_CUR or SEEK_END
+ * return the new position or -1 on error
  */
 int
-fosfat_get_file (fosfat_t *fosfat, const char *src,
-                 const char *dst, int output)
+fosfat_fseek (fosfat_fh_t *fh, int offset, int whence)
 {
-  int res = 0;
-  fosfat_blf_t *file;
-  fosfat_bd_t *file2;
+  int64_t pos;
 
-  if (!fosfat || !src || !dst)
-    return 0;
+  if (!fh)
+    return -1;
 
-  file = fosfat_search_insys (fosfat, src, S_BLF);
-  if (file)
+  switch (whence)
   {
-    if (!fosfat_in_isdir (file))
-    {
-      file2 = fosfat_read_file (fosfat, c2l (file->pt, sizeof (file->pt)));
+  case SEEK_SET:
+    pos = offset;
+    break;
 
-      if (file2 && fosfat_get (fosfat, file2, dst, output, 0))
-        res = 1;
+  case SEEK_CUR:
+    pos = (int64_t) fh->pos + offset;
+    break;
 
-      fosfat_free_file (file2);
-    }
+  case SEEK_END:
+    pos = (int64_t) fh->size + offset;
+    break;
 
-    free (file);
+  default:
+    return -1;
   }
 
-  if (!res)
-    foslog (FOSLOG_WARNING, "file \"%s\" cannot be copied", src);
-  else
-    foslog (FOSLOG_NOTICE, "get file \"%s\" and save to \"%s\"", src, dst);
+  if (pos < 0 || pos > INT_MAX)
+    return -1;
 
-  return res;
+  fh->pos = (uint32_t) pos;
+  return (int) pos;
+}
+
+/*
+ * Close a file handle.
+ *
+ * fh           file handle
+ */
+void
+fosfat_fclose (fosfat_fh_t *fh)
+{
+  if (!fh)
+    return;
+
+  fosfat_mutex_destroy (&fh->lock);
+  free (fh->extents);
+  free (fh);
 }
 
 /*
  * Get a buffer from a file in the FOS.
  *
  * The buffer can be selected with an offset in the file and with a size.
+ * The bytes after the end of the file are zeroed.
  *
  * fosfat       handle
  * path         source on the Smaky disk
@@ -1872,44 +3614,23 @@ fosfat_get_file (fosfat_t *fosfat, const char *src,
 uint8_t *
 fosfat_get_buffer (fosfat_t *fosfat, const char *path, int offset, int size)
 {
-  uint8_t *buffer = NULL;
-  fosfat_blf_t *file;
-  fosfat_bd_t *file2;
+  uint8_t *buffer;
 
-  if (!fosfat || !path)
+  if (!fosfat || !path || size < 0)
     return NULL;
 
-  file = fosfat_search_insys (fosfat, path, S_BLF);
-  if (file && !fosfat_in_isdir (file))
-  {
-    buffer = calloc (1, size);
-
-    if (buffer)
-    {
-      file2 = fosfat_read_file (fosfat, c2l (file->pt, sizeof (file->pt)));
-
-      if (file2)
-        fosfat_get (fosfat, file2, NULL, 0, 1, offset, size, buffer);
-      else
-      {
-        free (buffer);
-        buffer = NULL;
-      }
+  buffer = calloc (1, size);
+  if (!buffer)
+    return NULL;
 
-      free (file);
+  fosfat_stats_add (fosfat->stats.allocs, 1);
 
-      if (file2)
-        fosfat_free_file (file2);
-    }
+  if (fosfat_read_into (fosfat, path, offset, size, buffer) < 0)
+  {
+    free (buffer);
+    return NULL;
   }
 
-  if (!buffer)
-    foslog (FOSLOG_ERROR, "data (offset:%i size:%i) of \"%s\" not read",
-            offset, size, path);
-  else
-    foslog (FOSLOG_NOTICE, "data (offset:%i size:%i) of \"%s\" correctly read",
-            offset, size, path);
-
   return buffer;
 }
 
@@ -1933,6 +3654,8 @@ fosfat_diskname (fosfat_t *fosfat)
   {
     const char *nlo = (char *) block0->nlo;
     name = strdup (nlo[0] == (char) 0xFF ? "" : nlo);
+    if (name)
+      fosfat_stats_add (fosfat->stats.allocs, 1);
     free (block0);
   }
 
@@ -1945,143 +3668,232 @@ fosfat_diskname (fosfat_t *fosfat)
 }
 
 /*
- * Put file information in the cache list structure.
+ * Checksums of the block 0 and of the SYS_LIST.
  *
- * file         BLF element in the BL
- * bl           BL block's number
- * return the cache for a file
+ * These blocks are changed by the FOS with each write on the disk, then
+ * they are used to know if a sidecar index is always valid.
+ *
+ * fosfat       handle
+ * info         where to put the checksums
+ * return a boolean (true for success)
  */
-static cachelist_t *
-fosfat_cache_file (fosfat_blf_t *file, uint32_t bl)
+static int
+fosfat_sidecar_digest (fosfat_t *fosfat, fosfat_sidecar_info_t *info)
 {
-  cachelist_t *cachefile = NULL;
+  uint8_t block[FOSFAT_BLK];
 
-  if (!file)
-    return NULL;
+  if (!fosfat_read_raw (fosfat, FOSFAT_BLOCK0, block, B_B0))
+    return 0;
+  info->chk0 = fosfat_checksum (block, sizeof (block));
 
-  cachefile = malloc (sizeof (cachelist_t));
-  if (!cachefile)
-    return NULL;
+  if (!fosfat_read_raw (fosfat, FOSFAT_SYSLIST, block, B_BD))
+    return 0;
+  info->chksys = fosfat_checksum (block, sizeof (block));
 
-  cachefile->next   = NULL;
-  cachefile->sub    = NULL;
-  cachefile->isdir  = !!fosfat_in_isdir (file);
-  cachefile->islink = !!fosfat_in_islink (file);
+  return 1;
+}
 
-  /* if the first char is NULL, then the file is deleted */
-  if ((char) file->name[0] == '\0')
-  {
-    cachefile->isdel = 1;
-    cachefile->name =
-      my_strndup ((char *) file->name + 1, sizeof (file->name - 1));
-  }
-  else
+/*
+ * Write the sidecar index of the device.
+ *
+ * Only a fully loaded cache is saved. The nodes are saved in the order of
+ * the cache (without the root), then the content of each directory stays
+ * contiguous.
+ *
+ * fosfat       handle
+ * dev          the device name
+ */
+static void
+fosfat_cache_save (fosfat_t *fosfat, const char *dev)
+{
+  uint32_t i, count = fosfat->cache.count - 1;
+  size_t nlen = 0;
+  char *names;
+  fosfat_sidecar_info_t info;
+  fosfat_sidecar_entry_t *entries;
+
+  info.fosboot = fosfat->fosboot;
+  info.foschk  = fosfat->foschk;
+  info.viewdel = fosfat->viewdel;
+
+  if (!count || !fosfat_sidecar_digest (fosfat, &info))
+    return;
+
+  entries = calloc (count, sizeof (*entries));
+  names   = malloc ((size_t) count * FOSFAT_NAMELGT);
+  if (!entries || !names)
+    goto out;
+
+  fosfat_stats_add (fosfat->stats.allocs, 2);
+
+  for (i = 0; i < count; i++)
   {
-    cachefile->isdel = 0;
-    cachefile->name = strdup ((char *) file->name);
+    const cachenode_t *it = &fosfat->cache.nodes[i + 1];
+    fosfat_sidecar_entry_t *e = &entries[i];
+    size_t len = strlen (it->name) + 1;
+
+    e->parent = it->parent == CACHE_ROOT
+                ? FOSFAT_SIDECAR_ROOT : it->parent - 1;
+    e->name   = (uint32_t) nlen;
+    e->bl     = it->bl;
+    e->bd     = it->bd;
+    e->flags  = (it->isdir    ? SIDECAR_F_DIR    : 0)
+              | (it->islink   ? SIDECAR_F_LINK   : 0)
+              | (it->isdel    ? SIDECAR_F_DEL    : 0)
+              | (it->loaded   ? SIDECAR_F_LOADED : 0)
+              | (it->issystem ? SIDECAR_F_SYSTEM : 0)
+              | (it->attr.isvisible ? SIDECAR_F_VISIBLE : 0)
+              | (it->attr.isencoded ? SIDECAR_F_ENCODED : 0);
+    e->size   = it->attr.size;
+    e->time_c = it->attr.time_c;
+    e->time_w = it->attr.time_w;
+    e->time_r = it->attr.time_r;
+
+    memcpy (names + nlen, it->name, len);
+    nlen += len;
   }
 
-  cachefile->bl = bl;
-  cachefile->bd = c2l (file->pt, sizeof (file->pt));
+  fosfat_sidecar_save (dev, &info, entries, count, names, nlen);
 
-  return cachefile;
+ out:
+  free (entries);
+  free (names);
 }
 
 /*
- * List all files on the disk to fill the global cache list.
+ * Rebuild the cache from a sidecar index.
  *
- * This function is recursive!
+ * The sidecar is used only if it matches the disk (the checksums of the
+ * block 0 and of the SYS_LIST) and the options of the handle.
  *
  * fosfat       handle
- * pt           block's number of the BD
- * return the first element of the cache list.
+ * sc           the sidecar
+ * disk         disk type (FOSFAT_AD for auto-detection)
+ * return a boolean (true if the cache is loaded)
  */
-static cachelist_t *
-fosfat_cache_dir (fosfat_t *fosfat, uint32_t pt)
+static int
+fosfat_cache_restore (fosfat_t *fosfat, fosfat_sidecar_t *sc,
+                      fosfat_disk_t disk)
 {
-  int i;
-  fosfat_bd_t *dir = NULL;
-  fosfat_bl_t *files;
-  cachelist_t *firstfile = NULL;
-  cachelist_t *list = NULL;
+  uint32_t i, count;
+  fosfat_sidecar_info_t digest;
+  fosfat_cache_t *cache = &fosfat->cache;
+  const fosfat_sidecar_info_t *info = fosfat_sidecar_info (sc);
+  const fosfat_sidecar_entry_t *entries;
 
-  if (!fosfat)
-    return NULL;
+  if (!info || info->viewdel != fosfat->viewdel)
+    return 0;
 
-  dir = fosfat_read_dir (fosfat, pt);
-  if (!dir)
-    return NULL;
+  if (info->fosboot != FOSBOOT_FD && info->fosboot != FOSBOOT_HD)
+    return 0;
 
-  files = dir->first_bl;
-  if (!files)
+  if ((disk == FOSFAT_FD && info->fosboot != FOSBOOT_FD)
+      || (disk == FOSFAT_HD && info->fosboot != FOSBOOT_HD))
+    return 0;
+
+  fosfat->fosboot = info->fosboot;
+  if (!fosfat_sidecar_digest (fosfat, &digest)
+      || digest.chk0 != info->chk0 || digest.chksys != info->chksys)
   {
-    fosfat_free_dir (dir);
-    return NULL;
+    fosfat->fosboot = -1;
+    return 0;
   }
 
-  do
-  {
-    /* Check all files in the BL */
-    for (i = 0; i < FOSFAT_NBL; i++)
-    {
-      if (!fosfat_in_isopenexm (&files->file[i]))
-        continue;
+  entries = fosfat_sidecar_entries (sc, &count);
 
-      if (fosfat->viewdel || fosfat_in_isnotdel(&files->file[i]))
-      {
-        /* Complete the linked list with all files */
-        if (list)
-        {
-          list->next = fosfat_cache_file (&files->file[i], files->pt);
-          list = list->next;
-        }
-        else
-        {
-          firstfile = fosfat_cache_file (&files->file[i], files->pt);
-          list = firstfile;
-        }
+  /* All nodes in one allocation */
+  if (count + 1 > cache->size)
+  {
+    cachenode_t *nodes;
+
+    nodes = realloc (cache->nodes, (count + 1) * sizeof (cachenode_t));
+    if (!nodes)
+      goto err;
+    fosfat_stats_add (fosfat->stats.allocs, 1);
+    cache->nodes = nodes;
+    cache->size  = count + 1;
+  }
+  cache->nodes[CACHE_ROOT].loaded = 1;
 
-        /* If the file is a directory, then do a recursive cache */
-        if (list && fosfat_in_isdir (&files->file[i])
-            && !fosfat_in_issystem (&files->file[i]))
-          list->sub = fosfat_cache_dir (fosfat, list->bd);
-      }
-    }
-    files = files->next_bl;
+  /* The parents are always before their content */
+  for (i = 0; i < count; i++)
+  {
+    const fosfat_sidecar_entry_t *e = &entries[i];
+    cachenode_t *node = &cache->nodes[i + 1], *parent;
+
+    memset (node, 0, sizeof (*node));
+    snprintf (node->name, sizeof (node->name),
+              "%s", fosfat_sidecar_name (sc, e));
+
+    node->parent = e->parent == FOSFAT_SIDECAR_ROOT ? CACHE_ROOT
+                                                    : e->parent + 1;
+    node->bl       = e->bl;
+    node->bd       = e->bd;
+    node->isdir    = !!(e->flags & SIDECAR_F_DIR);
+    node->islink   = !!(e->flags & SIDECAR_F_LINK);
+    node->isdel    = !!(e->flags & SIDECAR_F_DEL);
+    node->loaded   = !!(e->flags & SIDECAR_F_LOADED);
+    node->issystem = !!(e->flags & SIDECAR_F_SYSTEM);
+
+    node->attr.size      = e->size;
+    node->attr.isvisible = !!(e->flags & SIDECAR_F_VISIBLE);
+    node->attr.isencoded = !!(e->flags & SIDECAR_F_ENCODED);
+    node->attr.time_c    = e->time_c;
+    node->attr.time_w    = e->time_w;
+    node->attr.time_r    = e->time_r;
+
+    /* The content of a directory must be contiguous */
+    parent = &cache->nodes[node->parent];
+    if (!parent->count)
+      parent->first = i + 1;
+    else if (parent->first + parent->count != i + 1)
+      goto err;
+    parent->count++;
+    cache->count++;
+
+    fosfat_pathidx_insert (fosfat, i + 1);
   }
-  while (files);
 
-  fosfat_free_dir (dir);
+  if (fosfat->pathidx.error)
+    goto err;
 
-  if (!firstfile)
-    foslog (FOSLOG_ERROR, "cache to block %i not correctly loaded", pt);
+  fosfat->foschk = info->foschk;
+  return 1;
 
-  return firstfile;
+ err:
+  fosfat_cache_release (cache);
+  fosfat_pathidx_release (&fosfat->pathidx);
+  fosfat_cache_init (cache);
+  fosfat_pathidx_init (&fosfat->pathidx);
+  fosfat->fosboot = -1;
+  return 0;
 }
 
 /*
- * Unload the cache.
+ * Load the cache from the sidecar index of the device.
  *
- * This function releases all the cache when the device is closed.
- *
- * cache        the first element of the cache list
+ * fosfat       handle
+ * dev          the device name
+ * disk         disk type (FOSFAT_AD for auto-detection)
+ * return a boolean (true if the cache is loaded)
  */
-static void
-fosfat_cache_unloader (cachelist_t *cache)
+static int
+fosfat_cache_load (fosfat_t *fosfat, const char *dev, fosfat_disk_t disk)
 {
-  cachelist_t *it, *tofree;
+  int res;
+  fosfat_sidecar_t *sc;
 
-  it = cache;
-  while (it)
-  {
-    if (it->sub)
-      fosfat_cache_unloader (it->sub);
+  sc = fosfat_sidecar_load (dev);
+  if (!sc)
+    return 0;
 
-    tofree = it;
-    it = it->next;
-    free (tofree->name);
-    free (tofree);
-  }
+  res = fosfat_cache_restore (fosfat, sc, disk);
+  fosfat_sidecar_close (sc);
+
+  if (!res)
+    foslog (FOSLOG_NOTICE, "sidecar index of %s is outdated", dev);
+
+  return res;
 }
 
 /*
@@ -2113,9 +3925,7 @@ fosfat_diskauto (fosfat_t *fosfat)
   for (i = 0; loop && i < 2; i++)
   {
     sys_list = fosfat_read_bd (fosfat, FOSFAT_SYSLIST);
-    fosfat->foschk = 0;
     first_bl = fosfat_read_bl (fosfat, FOSFAT_SYSLIST + 1);
-    fosfat->foschk = 0;
 
     if (sys_list && first_bl
         && !strncmp ((char *) sys_list->chk, (char *) first_bl->chk,
@@ -2158,48 +3968,67 @@ fosfat_diskauto (fosfat_t *fosfat)
 }
 
 /*
- * Open the device.
+ * Create the handle on an opened device and load the cache.
  *
- * That hides the fopen processing. A device can be read like a file.
- * But for Win32, the w32disk library is used for Win9x and WinNT low
- * level access on the disk.
+ * The device I/O is owned by the handle, it is closed on error.
  *
- * dev          the device name
+ * io           the device I/O
+ * dev          the device name or NULL with a backend (no sidecar)
  * disk         disk type
- * flag         F_UNDELETE or 0 for nothing
+ * flag         F_UNDELETE, F_LAZY, F_SIDECAR, F_PARALLEL or 0 for nothing
  * return the device handle
  */
-fosfat_t *
-fosfat_open (const char *dev, fosfat_disk_t disk, unsigned int flag)
+static fosfat_t *
+fosfat_open_io (fosfat_io_t *io, const char *dev,
+                fosfat_disk_t disk, unsigned int flag)
 {
   fosfat_disk_t fboot;
   fosfat_t *fosfat = NULL;
+  fosfat_bd_t *sys_list;
 
-  if (!dev)
+  if (!io)
     return NULL;
 
   fosfat = calloc (1, sizeof (fosfat_t));
   if (!fosfat)
+  {
+    fosfat_io_close (io);
     return NULL;
+  }
+
+  fosfat->dev       = io;
 
   fosfat->fosboot   = -1;
   fosfat->foschk    = 0;
   fosfat->viewdel   = (flag & F_UNDELETE) == F_UNDELETE;
-  fosfat->cachelist = NULL;
+  fosfat->lazy      = (flag & F_LAZY) == F_LAZY;
   fosfat->isfile    = 1;
+  fosfat->blkcache  = fosfat_blkcache_new (FOSFAT_BLKCACHE_DEFAULT);
+  fosfat->readahead = fosfat_ra_new (fosfat_ra_fetch, fosfat);
+  fosfat_io_cache (io, fosfat->blkcache);
+  fosfat->ra_min    = FOSFAT_READAHEAD_MIN;
+  fosfat->ra_max    = FOSFAT_READAHEAD_MAX;
+  fosfat_mutex_init (&fosfat->cachelock);
+
+  if (!fosfat_cache_init (&fosfat->cache)
+      || !fosfat_pathidx_init (&fosfat->pathidx))
+    goto err;
 
 #ifdef _WIN32
-  fosfat->isfile = strlen (dev) > 1;
-  fosfat->dev = fosfat->isfile ? fopen (dev, "rb") : (void *) w32disk_new (*dev - 'a');
-#else
-  fosfat->dev = fopen (dev, "r");
-#endif /* !_WIN32 */
-  if (!fosfat->dev)
-    goto err_dev;
+  if (dev)
+    fosfat->isfile = strlen (dev) > 1;
+#endif /* _WIN32 */
 
   /* Open the device */
-  foslog (FOSLOG_NOTICE,
-          "%s is opening ...", fosfat->isfile ? "file" : "device");
+  foslog (FOSLOG_NOTICE, "%s is opening ...",
+          !dev ? "backend" : fosfat->isfile ? "file" : "device");
+
+  /* The whole cache is available without walking the disk */
+  if (dev && (flag & F_SIDECAR) && fosfat_cache_load (fosfat, dev, disk))
+  {
+    foslog (FOSLOG_NOTICE, "cache file loaded from the sidecar index");
+    goto ready;
+  }
 
   if (disk == FOSFAT_AD)
   {
@@ -2230,41 +4059,106 @@ fosfat_open (const char *dev, fosfat_disk_t disk, unsigned int flag)
   case FOSFAT_ED:
     foslog (FOSLOG_ERROR,
             "disk auto detection for \"%s\" has failed; you can try to specify"
-            " (force) the disk type", dev);
+            " (force) the disk type", dev ? dev : "backend");
 
   default:
     goto err;
   }
 
+  /*
+   * The CHK of the SYS_LIST is the reference for the whole disk. It is
+   * never changed after, then the handle can be shared between threads.
+   */
+  sys_list = fosfat_read_bd (fosfat, FOSFAT_SYSLIST);
+  if (!sys_list)
+    goto err;
+
+  fosfat->foschk = c2l (sys_list->chk, sizeof (sys_list->chk));
+  free (sys_list);
+
   foslog (FOSLOG_NOTICE, "cache file is loading ...");
 
-  fosfat->cachelist = fosfat_cache_dir (fosfat, FOSFAT_SYSLIST);
-  if (!fosfat->cachelist)
+#ifndef _WIN32
+  if ((flag & F_PARALLEL) && !fosfat->lazy)
+    fosfat_cache_scan (fosfat);
+  else
+#endif /* !_WIN32 */
+    fosfat_cache_dir (fosfat, CACHE_ROOT);
+  if (!fosfat->cache.nodes[CACHE_ROOT].count
+      || fosfat->cache.error || fosfat->pathidx.error)
     goto err;
 
+  /* Only a full cache can be saved */
+  if (dev && (flag & F_SIDECAR) && !fosfat->lazy)
+    fosfat_cache_save (fosfat, dev);
+
+ ready:
   foslog (FOSLOG_NOTICE, "fosfat is ready");
 
   return fosfat;
 
  err:
-#ifdef _WIN32
-  if (fosfat->isfile)
-    fclose (fosfat->dev);
-  else
-    w32disk_free (fosfat->dev);
-#else
-  fclose (fosfat->dev);
-#endif /* !_WIN32 */
- err_dev:
+  fosfat_io_close (fosfat->dev);
+  fosfat_cache_release (&fosfat->cache);
+  fosfat_pathidx_release (&fosfat->pathidx);
+  fosfat_ra_free (fosfat->readahead);
+  fosfat_blkcache_free (fosfat->blkcache);
+  fosfat_mutex_destroy (&fosfat->cachelock);
   free (fosfat);
   return NULL;
 }
 
+/*
+ * Open the device.
+ *
+ * That hides the device I/O processing. A device can be read like a file.
+ * But for Win32, the w32disk library is used for Win9x and WinNT low
+ * level access on the disk.
+ *
+ * dev          the device name
+ * disk         disk type
+ * flag         F_UNDELETE, F_MMAP, F_LAZY, F_SIDECAR, F_PARALLEL, F_URING,
+ *              F_DIRECT or 0 for nothing
+ * return the device handle
+ */
+fosfat_t *
+fosfat_open (const char *dev, fosfat_disk_t disk, unsigned int flag)
+{
+  if (!dev)
+    return NULL;
+
+  return fosfat_open_io (fosfat_io_open (dev, flag), dev, disk, flag);
+}
+
+/*
+ * Open a disk provided by a backend.
+ *
+ * The blocks are read with the functions of the backend instead of a
+ * device (an image in memory, a container, ...). The sidecar index is
+ * not available because there is no file name.
+ *
+ * backend      the functions of the backend
+ * data         user data passed to the functions (closed with the handle)
+ * disk         disk type
+ * flag         F_UNDELETE, F_LAZY, F_PARALLEL or 0 for nothing
+ * return the device handle
+ */
+fosfat_t *
+fosfat_open_backend (const fosfat_backend_t *backend, void *data,
+                     fosfat_disk_t disk, unsigned int flag)
+{
+  if (!backend || !backend->read)
+    return NULL;
+
+  return fosfat_open_io (fosfat_io_backend (backend, data), NULL, disk,
+                         flag & (F_UNDELETE | F_LAZY | F_PARALLEL));
+}
+
 /*
  * Close the device.
  *
- * That hides the fclose processing. And it uses the w32disk library with
- * Win9x and WinNT.
+ * That hides the device I/O processing. And it uses the w32disk library
+ * with Win9x and WinNT.
  *
  * fosfat       handle
  */
@@ -2274,27 +4168,37 @@ fosfat_close (fosfat_t *fosfat)
   if (!fosfat)
     return;
 
-  /* Unload the cache if is loaded */
-  if (fosfat->cachelist)
+  /* Unload the cache */
+  foslog (FOSLOG_NOTICE, "cache file is unloading ...");
+  fosfat_cache_release (&fosfat->cache);
+  fosfat_pathidx_release (&fosfat->pathidx);
+  fosfat_mutex_destroy (&fosfat->cachelock);
+
+  /* The worker is stopped before to release the cache and the device */
+  if (fosfat->readahead)
   {
-    foslog (FOSLOG_NOTICE, "cache file is unloading ...");
-    fosfat_cache_unloader (fosfat->cachelist);
-  }
+    fosfat_ra_stats_t stats;
 
-  foslog (FOSLOG_NOTICE, "device is closing ...");
+    fosfat_ra_counters (fosfat->readahead, &stats);
+    foslog (FOSLOG_NOTICE, "readahead: %lu sequential, %lu random, "
+            "%lu blocks prefetched", stats.sequential, stats.random,
+            stats.blocks);
+    fosfat_ra_free (fosfat->readahead);
+  }
 
-  if (fosfat->dev)
+  if (fosfat->blkcache)
   {
-#ifdef _WIN32
-    if (fosfat->isfile)
-      fclose (fosfat->dev);
-    else
-      w32disk_free (fosfat->dev);
-#else
-    fclose (fosfat->dev);
-#endif /* !_WIN32 */
+    unsigned long hits, misses;
+
+    fosfat_blkcache_counters (fosfat->blkcache, &hits, &misses);
+    foslog (FOSLOG_NOTICE, "block cache: %lu hits, %lu misses", hits, misses);
+    fosfat_blkcache_free (fosfat->blkcache);
   }
 
+  foslog (FOSLOG_NOTICE, "device is closing ...");
+
+  fosfat_io_close (fosfat->dev);
+
   free (fosfat);
 }
 
@@ -29,6 +29,12 @@
  * \file fosfat.h
  *
  * libfosfat public API header.
+ *
+ * All functions which are reading a disk can be called concurrently on the
+ * same handle (fosfat_t) from many threads. Only fosfat_open(),
+ * fosfat_close(), fosfat_logger(), fosfat_blkcache_size() and
+ * fosfat_readahead_size() must not run at the same time than an other
+ * call on the same handle.
  */
 
 #ifdef __cplusplus
@@ -55,11 +61,25 @@ extern "C" {
 #define LIBFOSFAT_VERSION_STR FF_TOSTRING(LIBFOSFAT_VERSION)
 #define LIBFOSFAT_BUILD       LIBFOSFAT_VERSION_INT
 
+#include <stddef.h>
 #include <inttypes.h>
 
 #define FOSFAT_NAMELGT  17
 
 #define F_UNDELETE      (1 << 0)
+#define F_MMAP          (1 << 1)
+#define F_LAZY          (1 << 2)
+#define F_SIDECAR       (1 << 3)
+#define F_PARALLEL      (1 << 4)
+#define F_URING         (1 << 5)
+#define F_DIRECT        (1 << 6)
+
+/** Default number of blocks (256 bytes) in the block cache. */
+#define FOSFAT_BLKCACHE_DEFAULT  1024
+
+/** Default readahead windows (in blocks of 256 bytes). */
+#define FOSFAT_READAHEAD_MIN     32
+#define FOSFAT_READAHEAD_MAX     512
 
 /** Disk types. */
 typedef enum disk_type {
@@ -100,9 +120,67 @@ typedef struct file_info_s {
   struct file_info_s *next_file;
 } fosfat_file_t;
 
+/** Attributes of a file (or dir) found by fosfat_lookup(). */
+typedef struct lookup_info_s {
+  int size;                   /*!< File size.             */
+  fosfat_att_t att;           /*!< File attributes.       */
+  int isopenexm;              /*!< Open exclusif/multiple.*/
+  uint32_t bd;                /*!< BD block's number.     */
+} fosfat_info_t;
+
 /** Fosfat handle on a disk. */
 typedef struct fosfat_s fosfat_t;
 
+/** Directory stream (see fosfat_opendir()). */
+typedef struct fosfat_dir_s fosfat_dir_t;
+
+/** Open file (see fosfat_fopen()). */
+typedef struct fosfat_fh_s fosfat_fh_t;
+
+/** Readahead counters (see fosfat_readahead_stats()). */
+typedef struct ra_stats_s {
+  unsigned long sequential;   /*!< Reads after the previous one.  */
+  unsigned long random;       /*!< Reads which reset the window.  */
+  unsigned long requests;     /*!< Tranches queued for prefetch.  */
+  unsigned long blocks;       /*!< Blocks queued for prefetch.    */
+  unsigned long dropped;      /*!< Tranches dropped (queue full). */
+} fosfat_ra_stats_t;
+
+/** I/O and cache counters of a handle (see fosfat_get_stats()). */
+typedef struct stats_s {
+  uint64_t b0;                /*!< B0 blocks read on the device.        */
+  uint64_t bl;                /*!< BL blocks read on the device.        */
+  uint64_t bd;                /*!< BD blocks read on the device.        */
+  uint64_t data;              /*!< DATA blocks read on the device.      */
+  uint64_t bytes;             /*!< Bytes read on the device.            */
+  uint64_t syscalls;          /*!< System calls for the reads.          */
+  uint64_t blk_hits;          /*!< Blocks found in the block cache.     */
+  uint64_t blk_misses;        /*!< Blocks not in the block cache.       */
+  uint64_t lookups;           /*!< Paths searched in the cache.         */
+  uint64_t lookup_hits;       /*!< Paths found.                         */
+  uint64_t lookup_misses;     /*!< Paths not found.                     */
+  uint64_t depth;             /*!< Names resolved by all the lookups.   */
+  uint64_t depth_max;         /*!< Names resolved by the deepest one.   */
+  uint64_t bd_chains;         /*!< Linked lists of BD rebuilt.          */
+  uint64_t allocs;            /*!< Allocations for the handle.          */
+} fosfat_stats_t;
+
+/** Functions of a block-device backend. */
+typedef struct backend_s {
+  /** Read size bytes at offset (in bytes); return a boolean. */
+  int      (*read)  (void *data, uint64_t offset, void *buf, size_t size);
+  /** Size of the device in bytes, 0 if unknown (can be NULL). */
+  uint64_t (*size)  (void *data);
+  /** Release the user data (can be NULL). */
+  void     (*close) (void *data);
+} fosfat_backend_t;
+
+/** Image in memory for fosfat_backend_memory(). */
+typedef struct memory_s {
+  const uint8_t *buf;         /*!< Whole image (not copied).      */
+  uint64_t       size;        /*!< Size of the image in bytes.    */
+} fosfat_memory_t;
+
 
 /**
  * \brief Load a device compatible Smaky FOS.
@@ -115,13 +193,81 @@ typedef struct fosfat_s fosfat_t;
  * Window$ : specify the device with 'a' for diskette, 'c' for the first hard
  *           disk, etc,...
  *
+ * The blocks are read with pread(). With F_MMAP, the whole image is mapped
+ * read-only in memory instead (POSIX only); it falls back to pread() if
+ * the device cannot be mapped.
+ *
+ * All directories are loaded in the cache when the device is opened. With
+ * F_LAZY, only the root is loaded and each directory is loaded the first
+ * time that a path is going into it. It is faster when only a few files
+ * are read.
+ *
+ * With F_PARALLEL (POSIX only), the directories are loaded by a pool of
+ * threads, then several reads are in flight on the device. The cache is
+ * the same than with a serial load. This flag is ignored with F_LAZY.
+ *
+ * With F_SIDECAR (POSIX only), the cache is saved in a sidecar index next
+ * to the image (foo.img.fosidx) or in $XDG_CACHE_HOME/fosfat when the
+ * image's directory is read-only. The next opens load the cache from the
+ * sidecar without walking the disk, as long as the image is not changed
+ * (size, mtime, block 0 and SYS_LIST). The sidecar is never written by a
+ * lazy open, and it is ignored for the devices.
+ *
+ * With F_URING (Linux only), the tranches of a directory, the BD of the
+ * sub-directories and the tranches of a file range are submitted at once
+ * in an io_uring. It falls back to pread() if io_uring is not available
+ * and it is ignored when the image is mapped with F_MMAP.
+ *
+ * With F_DIRECT (POSIX only), the device is opened with O_DIRECT in order
+ * to bypass the page cache of the system; only the block cache of the
+ * handle keeps the data. The reads are done by aligned windows of 4 KiB
+ * sectors; the blocks asked are copied and the other blocks of the window
+ * are put in the block cache for the next reads. F_MMAP and F_URING are
+ * ignored with this flag.
+ *
  * \param[in] dev        device or location.
  * \param[in] disk       type of disk, use FOSFAT_AD for auto-detection.
- * \param[in] flag       use F_UNDELETE to load deleted files or 0 for normal.
+ * \param[in] flag       F_UNDELETE to load deleted files, F_MMAP to map the
+ *                       image in memory, F_LAZY to load the directories on
+ *                       demand, F_SIDECAR to use a sidecar index,
+ *                       F_PARALLEL to load the directories with threads,
+ *                       F_URING to read with io_uring, F_DIRECT to bypass
+ *                       the page cache, or 0 for normal.
  * \return NULL if error or return the disk handle.
  */
 fosfat_t *fosfat_open (const char *dev, fosfat_disk_t disk, unsigned int flag);
 
+/**
+ * \brief Load a disk compatible Smaky FOS from a backend.
+ *
+ * The blocks are read with the functions of the backend instead of a
+ * device; for example an image already in memory (see
+ * fosfat_backend_memory()) or a container. The functions must accept
+ * concurrent reads if the handle is shared between threads.
+ *
+ * The close function of the backend is called with fosfat_close(), or
+ * immediately if the disk cannot be loaded. The sidecar index is not
+ * available and F_MMAP, F_SIDECAR, F_URING and F_DIRECT are ignored.
+ *
+ * \param[in] backend    functions of the backend.
+ * \param[in] data       user data passed to the functions.
+ * \param[in] disk       type of disk, use FOSFAT_AD for auto-detection.
+ * \param[in] flag       F_UNDELETE, F_LAZY, F_PARALLEL or 0 for normal.
+ * \return NULL if error or return the disk handle.
+ */
+fosfat_t *fosfat_open_backend (const fosfat_backend_t *backend, void *data,
+                               fosfat_disk_t disk, unsigned int flag);
+
+/**
+ * \brief Backend for an image in memory.
+ *
+ * The user data is a fosfat_memory_t which must be valid until the disk
+ * is closed. The buffer is not copied and it is never released.
+ *
+ * \return the functions of the backend.
+ */
+const fosfat_backend_t *fosfat_backend_memory (void);
+
 /**
  * \brief Free the memory and close the device properly.
  *
@@ -134,12 +280,76 @@ void fosfat_close (fosfat_t *fosfat);
  *
  * By default, the internal logger is disabled. Use this function to enable
  * or disable the verbosity. The logger is enabled or disabled for all
- * devices loaded.
+ * devices loaded. Each message is written on stderr with only one call,
+ * then the lines of concurrent calls are not mixed.
  *
  * \param[in] state      boolean, 0 to disable the logger.
  */
 void fosfat_logger (int state);
 
+/**
+ * \brief Change the size of the block cache.
+ *
+ * Each handle keeps the most recently read blocks (BL, BD and DATA) in a
+ * LRU cache of FOSFAT_BLKCACHE_DEFAULT blocks. Use this function to resize
+ * the cache; the blocks already cached are dropped. It must not be called
+ * while an other thread is using the handle.
+ *
+ * \param[in] fosfat     disk handle.
+ * \param[in] blocks     number of blocks in the cache, 0 to disable.
+ * \return a boolean, 0 for error.
+ */
+int fosfat_blkcache_size (fosfat_t *fosfat, unsigned int blocks);
+
+/**
+ * \brief Change the readahead windows.
+ *
+ * The file handles (fosfat_fopen()) are detecting the sequential reads
+ * and the next blocks are read in the block cache by a background
+ * thread. The window starts with \p min blocks, it is doubled with each
+ * sequential read up to \p max blocks and it is dropped with a random
+ * access. The window is never bigger than the half of the block cache.
+ * It must not be called while an other thread is using the handle.
+ *
+ * \param[in] fosfat     disk handle.
+ * \param[in] min        first window in blocks.
+ * \param[in] max        biggest window in blocks, 0 to disable.
+ * \return a boolean, 0 for error.
+ */
+int fosfat_readahead_size (fosfat_t *fosfat,
+                           unsigned int min, unsigned int max);
+
+/**
+ * \brief Get the I/O and cache counters.
+ *
+ * The counters are updated by all functions (and threads) on the handle
+ * since fosfat_open() or the last fosfat_reset_stats(). A block is counted
+ * with its type only when it is read on the device. The bytes are the
+ * bytes really transferred: with F_DIRECT, the whole aligned windows are
+ * counted. With a user backend, each call on the read function is counted
+ * as one system call, and with a compressed container the bytes are
+ * counted after inflate.
+ *
+ * \param[in] fosfat     disk handle.
+ * \param[out] stats     where to copy the counters.
+ */
+void fosfat_get_stats (fosfat_t *fosfat, fosfat_stats_t *stats);
+
+/**
+ * \brief Reset the I/O and cache counters.
+ *
+ * \param[in] fosfat     disk handle.
+ */
+void fosfat_reset_stats (fosfat_t *fosfat);
+
+/**
+ * \brief Get the readahead counters.
+ *
+ * \param[in] fosfat     disk handle.
+ * \param[out] stats     where to copy the counters.
+ */
+void fosfat_readahead_stats (fosfat_t *fosfat, fosfat_ra_stats_t *stats);
+
 /**
  * \brief Get the disk's name of a specific device.
  *
@@ -169,6 +379,38 @@ fosfat_file_t *fosfat_list_dir (fosfat_t *fosfat, const char *location);
  */
 void fosfat_free_listdir (fosfat_file_t *var);
 
+/**
+ * \brief Open a directory stream.
+ *
+ * The entries are the same than with fosfat_list_dir() but they are given
+ * one by one with fosfat_readdir(), directly from the cache. When the
+ * stream is no longer used, fosfat_closedir() must always be called.
+ *
+ * \param[in] fosfat     disk handle.
+ * \param[in] location   directory to list.
+ * \return NULL if error or return the stream.
+ */
+fosfat_dir_t *fosfat_opendir (fosfat_t *fosfat, const char *location);
+
+/**
+ * \brief Read the next entry of a directory stream.
+ *
+ * The entry is copied in the structure provided by the caller (the field
+ * next_file is always NULL). There is no allocation.
+ *
+ * \param[in] dir        directory stream.
+ * \param[out] entry     where to put the entry.
+ * \return a boolean, 0 at the end of the directory.
+ */
+int fosfat_readdir (fosfat_dir_t *dir, fosfat_file_t *entry);
+
+/**
+ * \brief Close a directory stream.
+ *
+ * \param[in] dir        directory stream.
+ */
+void fosfat_closedir (fosfat_dir_t *dir);
+
 /**
  * \brief Get the disk type.
  *
@@ -180,6 +422,21 @@ void fosfat_free_listdir (fosfat_file_t *var);
  */
 fosfat_disk_t fosfat_type (fosfat_t *fosfat);
 
+/**
+ * \brief Get all attributes of a specific file or folder.
+ *
+ * The location is resolved only one time and all attributes are copied
+ * in the structure provided by the caller. The fosfat_is*() functions are
+ * using this function. "/" is the root directory.
+ *
+ * \param[in] fosfat     disk handle.
+ * \param[in] location   file or directory.
+ * \param[out] info      where to put the attributes.
+ * \return a boolean, 0 if the location is not found.
+ */
+int fosfat_lookup (fosfat_t *fosfat, const char *location,
+                   fosfat_info_t *info);
+
 /**
  * \brief Get boolean information on a specific file or folder.
  *
@@ -292,6 +549,84 @@ int fosfat_get_file (fosfat_t *fosfat,
 uint8_t *fosfat_get_buffer (fosfat_t *fosfat,
                             const char *path, int offset, int size);
 
+/**
+ * \brief Read a part of a file in a buffer provided by the caller.
+ *
+ * Like fosfat_get_buffer() but nothing is allocated, the data are written
+ * directly in \p dst. Less bytes than \p size are read when the range is
+ * going after the end of the file.
+ *
+ * \param[in] fosfat     disk handle.
+ * \param[in] path       file where get data.
+ * \param[in] offset     from where (in bytes) in the data.
+ * \param[in] size       how many bytes.
+ * \param[out] dst       buffer of at least \p size bytes.
+ * \return the number of bytes read, -1 on error.
+ */
+int fosfat_read_into (fosfat_t *fosfat,
+                      const char *path, int offset, int size, uint8_t *dst);
+
+/**
+ * \brief Open a file for reading.
+ *
+ * The file is resolved only one time and its BD are read only here. Then
+ * the reads with the handle are going directly to the data blocks. The
+ * handle has a position for fosfat_fread() and fosfat_fseek().
+ * fosfat_fclose() must always be called when the handle is no longer used.
+ * The handle must be closed before the disk.
+ *
+ * \param[in] fosfat     disk handle.
+ * \param[in] path       file on the Smaky disk.
+ * \return the handle, NULL if not found or if it is a directory.
+ */
+fosfat_fh_t *fosfat_fopen (fosfat_t *fosfat, const char *path);
+
+/**
+ * \brief Read at the current position and move the position.
+ *
+ * The position is not protected, a handle must not be used by two
+ * threads at the same time with this function.
+ *
+ * \param[in] fh         file handle.
+ * \param[out] dst       buffer of at least \p size bytes.
+ * \param[in] size       how many bytes.
+ * \return the number of bytes read (0 at the end), -1 on error.
+ */
+int fosfat_fread (fosfat_fh_t *fh, uint8_t *dst, int size);
+
+/**
+ * \brief Read at an offset without to change the position.
+ *
+ * The same handle can be used by several threads with this function.
+ *
+ * \param[in] fh         file handle.
+ * \param[out] dst       buffer of at least \p size bytes.
+ * \param[in] size       how many bytes.
+ * \param[in] offset     from where (in bytes) in the data.
+ * \return the number of bytes read (0 at the end), -1 on error.
+ */
+int fosfat_fpread (fosfat_fh_t *fh, uint8_t *dst, int size, int offset);
+
+/**
+ * \brief Change the position.
+ *
+ * The position can be after the end of the file, then fosfat_fread()
+ * returns 0.
+ *
+ * \param[in] fh         file handle.
+ * \param[in] offset     number of bytes.
+ * \param[in] whence     SEEK_SET, SEEK_CUR or SEEK_END.
+ * \return the new position, -1 on error.
+ */
+int fosfat_fseek (fosfat_fh_t *fh, int offset, int whence);
+
+/**
+ * \brief Close a file handle.
+ *
+ * \param[in] fh         file handle.
+ */
+void fosfat_fclose (fosfat_fh_t *fh);
+
 /******************************************************************************/
 
 #define MOSFAT_NAMELGT  12
@@ -336,6 +671,17 @@ typedef struct mosfat_s mosfat_t;
  */
 mosfat_t *mosfat_open (const char *dev);
 
+/**
+ * \brief Load a disk compatible Smaky SAMOS from a backend.
+ *
+ * Like fosfat_open_backend() but for a SAMOS disk.
+ *
+ * \param[in] backend    functions of the backend.
+ * \param[in] data       user data passed to the functions.
+ * \return NULL if error or return the disk handle.
+ */
+mosfat_t *mosfat_open_backend (const fosfat_backend_t *backend, void *data);
+
 /**
  * \brief Free the memory and close the device properly.
  *
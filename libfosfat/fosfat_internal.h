@@ -44,6 +44,88 @@ typedef struct block_data_s {
   struct  block_data_s *next_data;
 } fosfat_data_t;
 
+#define FOSFAT_BLOCK0         0x00
+#define FOSFAT_SYSLIST        0x01
+
+#define FOSBOOT_FD            0x10
+#define FOSBOOT_HD            0x20
+
+/* FOS attributes and type */
+#define FOSFAT_ATT_OPENEX     (1 <<  0)
+#define FOSFAT_ATT_MULTIPLE   (1 <<  1)
+#define FOSFAT_ATT_DIR        (1 << 12)
+#define FOSFAT_ATT_VISIBLE    (1 << 13)
+#define FOSFAT_ATT_ENCODED    (1 << 17)
+#define FOSFAT_ATT_LINK       (1 << 24)
+#define FOSFAT_TYPE_SYSTEM    0xF8
+
+/* Block 0 (256 bytes) */
+typedef struct block_0_s {
+  uint8_t sys[44];             /* SYSTEM folder                         */
+  int8_t  nlo[16];             /* Disk name                             */
+  uint8_t chk[4];              /* Check control                         */
+  uint8_t mes[172];            /* Message                               */
+  uint8_t change;              /* Need of change the CHK number         */
+  uint8_t bonchk;              /* New format                            */
+  uint8_t oldchk[4];           /* Old CHK value                         */
+  uint8_t newchk[4];           /* New CHK value                         */
+  uint8_t reserve[10];         /* Unused                                */
+} fosfat_b0_t;
+
+/* File in a Block List (60 bytes) */
+typedef struct block_listf_s {
+  int8_t  name[16];            /* Filename                              */
+  uint8_t typ;                 /* Filetype                              */
+  uint8_t ope;                 /* Open counter                          */
+  uint8_t att[4];              /* Attributes                            */
+  uint8_t lg[4];               /* Length in blocks                      */
+  uint8_t lgb[2];              /* Number of bytes in the last block     */
+  uint8_t cd[3];               /* Date of Creation                      */
+  uint8_t ch[3];               /* Hour of Creation                      */
+  uint8_t wd[3];               /* Date of the last Write                */
+  uint8_t wh[3];               /* Hour of the last Write                */
+  uint8_t rd[3];               /* Date of the last Read                 */
+  uint8_t rh[3];               /* Hour of the last Read                 */
+  uint8_t secid[3];            /* Security ID                           */
+  uint8_t clope;               /* Open mode before CLOSE                */
+  uint8_t pt[4];               /* Pointer on the BD                     */
+  uint8_t lgf[4];              /* File size in bytes                    */
+  uint8_t code[2];             /* Code control                          */
+} fosfat_blf_t;
+
+/* Block List (256 bytes) */
+typedef struct block_list_s {
+  fosfat_blf_t file[4];        /* 4 BL files (240 bytes)                */
+  uint8_t      next[4];        /* Next BL                               */
+  uint8_t      chk[4];         /* Check control                         */
+  uint8_t      prev[4];        /* Previous BL                           */
+  uint8_t      reserve[4];     /* Unused                                */
+  /* Not in the block */
+  uint32_t     pt;             /* Block's number of this BL             */
+  /* Linked list */
+  struct       block_list_s *next_bl;
+} fosfat_bl_t;
+
+/* Block Description (256 bytes) */
+typedef struct block_desc_s {
+  uint8_t next[4];             /* Next BD                               */
+  uint8_t prev[4];             /* Previous BD                           */
+  uint8_t npt[2];              /* Number of tranches in the BD          */
+  uint8_t pts[42][4];          /* Pointers on the tranches (max 42)     */
+  int8_t  name[16];            /* Filename                              */
+  uint8_t nbs[42];             /* Length (in blocks) of each tranches   */
+  uint8_t reserve[4];          /* Unused                                */
+  uint8_t lst[2];              /* Number of byte in the last tranche    */
+  uint8_t hac[2];              /* Hashing function if LIST              */
+  uint8_t nbl[2];              /* Number of BL used if LIST             */
+  uint8_t chk[4];              /* Check control                         */
+  uint8_t off[4];              /* Offset (in blocks) of all previous BD */
+  uint8_t free[2];             /* Unused                                */
+  /* Linked list */
+  struct  block_desc_s *next_bd;
+  struct  block_list_s *first_bl;
+} fosfat_bd_t;
+
 /* foslog type */
 typedef enum foslog {
   FOSLOG_ERROR,                /* Error log                             */
@@ -51,12 +133,201 @@ typedef enum foslog {
   FOSLOG_NOTICE                /* Notice log                            */
 } foslog_t;
 
+/* Block cache */
+typedef struct blkcache_s fosfat_blkcache_t;
+
+/* Device I/O */
+typedef struct fosfat_io_s fosfat_io_t;
+
+/* One read of a batch on the device */
+typedef struct io_req_s {
+  uint64_t offset;             /* Address on the device (in bytes)      */
+  void    *buf;                /* Where to copy the data                */
+  size_t   size;               /* Number of bytes                       */
+} fosfat_io_req_t;
+
+/* Sidecar index */
+typedef struct sidecar_s fosfat_sidecar_t;
+
+/* Compressed container in writing */
+typedef struct container_writer_s fosfat_cwriter_t;
+
+/* Default size of the chunks of a container (64 KiB) */
+#define FOSFAT_CONTAINER_CHUNK  (64 * 1024)
+
+/* Options of the image generator */
+typedef struct gen_opt_s {
+  fosfat_disk_t disk;          /* FOSFAT_FD or FOSFAT_HD                */
+  const char   *name;          /* Disk name                             */
+  uint32_t      chk;           /* FOSCHK                                */
+  uint32_t      seed;          /* Seed for the content                  */
+  unsigned int  depth;         /* Depth of the tree                     */
+  unsigned int  dirs;          /* Sub-directories by directory          */
+  unsigned int  files;         /* Files by directory                    */
+  unsigned int  deleted;       /* Deleted files by directory            */
+  unsigned int  links;         /* Soft-links by directory               */
+  unsigned int  images;        /* .image and .color files by directory  */
+  uint32_t      size_min;      /* Min size of a file (bytes)            */
+  uint32_t      size_max;      /* Max size of a file (bytes)            */
+  unsigned int  fragment;      /* Max blocks by tranche (0 for 255)     */
+  unsigned int  tranches;      /* Max tranches by BD (1 to 42)          */
+} fosfat_gen_t;
+
+/* Counters of a generated image */
+typedef struct gen_info_s {
+  unsigned long dirs;          /* Directories (with the root)           */
+  unsigned long files;         /* Regular files                         */
+  unsigned long deleted;       /* Deleted files                         */
+  unsigned long links;         /* Soft-links                            */
+  unsigned long images;        /* .image and .color files               */
+  unsigned long tranches;      /* Tranches of the files                 */
+  unsigned long bds;           /* BD of the files                       */
+  unsigned long blocks_data;   /* DATA blocks                           */
+  unsigned long blocks_list;   /* BL blocks                             */
+  unsigned long blocks;        /* Size of the disk (with the holes)     */
+} fosfat_gen_info_t;
+
+/* Readahead queue */
+typedef struct readahead_s fosfat_ra_t;
+typedef void (*fosfat_ra_fetch_t) (void *data, uint32_t block, unsigned int nbs);
+
+#define FOSFAT_SIDECAR_ROOT   UINT32_MAX
+
+#define SIDECAR_F_DIR         (1 << 0)
+#define SIDECAR_F_LINK        (1 << 1)
+#define SIDECAR_F_DEL         (1 << 2)
+#define SIDECAR_F_VISIBLE     (1 << 3)
+#define SIDECAR_F_ENCODED     (1 << 4)
+#define SIDECAR_F_LOADED      (1 << 5)
+#define SIDECAR_F_SYSTEM      (1 << 6)
+
+/* Disk attributes saved in the sidecar */
+typedef struct sidecar_info_s {
+  int32_t  fosboot;            /* FOSBOOT address                       */
+  uint32_t foschk;             /* CHK of the disk                       */
+  int      viewdel;            /* Deleted files are in the entries      */
+  uint64_t chk0;               /* Checksum of the block 0               */
+  uint64_t chksys;             /* Checksum of the SYS_LIST              */
+} fosfat_sidecar_info_t;
+
+/* One node of the cache in the sidecar (60 bytes) */
+typedef struct sidecar_entry_s {
+  uint32_t parent;             /* Index of the directory or ROOT        */
+  uint32_t name;               /* Offset in the string table            */
+  uint32_t bl;                 /* BL block                              */
+  uint32_t bd;                 /* BD block (first BD of a directory)    */
+  uint32_t flags;              /* SIDECAR_F_*                           */
+  int32_t  size;               /* Size of the file                      */
+  fosfat_time_t time_c;        /* Creation date                         */
+  fosfat_time_t time_w;        /* Writing date                          */
+  fosfat_time_t time_r;        /* Use date                              */
+} fosfat_sidecar_entry_t;
+
 #define countof(array) (sizeof (array) / sizeof (array[0]))
 
+/* Mutex for the shared states of a handle */
+#ifdef _WIN32
+#include <windows.h>
+typedef CRITICAL_SECTION fosfat_mutex_t;
+#define fosfat_mutex_init(m)    InitializeCriticalSection (m)
+#define fosfat_mutex_destroy(m) DeleteCriticalSection (m)
+#define fosfat_mutex_lock(m)    EnterCriticalSection (m)
+#define fosfat_mutex_unlock(m)  LeaveCriticalSection (m)
+#else
+#include <pthread.h>
+typedef pthread_mutex_t fosfat_mutex_t;
+#define fosfat_mutex_init(m)    pthread_mutex_init (m, NULL)
+#define fosfat_mutex_destroy(m) pthread_mutex_destroy (m)
+#define fosfat_mutex_lock(m)    pthread_mutex_lock (m)
+#define fosfat_mutex_unlock(m)  pthread_mutex_unlock (m)
+#endif /* !_WIN32 */
+
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif /* MIN */
+
+#ifndef MAX
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#endif /* MAX */
+
+/* Counter updated by many threads (see fosfat_get_stats()) */
+#define fosfat_stats_add(var, n) \
+  __atomic_fetch_add (&(var), (n), __ATOMIC_RELAXED)
+
+/* Static probes for bpftrace, perf or SystemTap (provider, name, args) */
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define FOSFAT_PROBE1(p, n, a)          DTRACE_PROBE1 (p, n, a)
+#define FOSFAT_PROBE2(p, n, a, b)       DTRACE_PROBE2 (p, n, a, b)
+#define FOSFAT_PROBE3(p, n, a, b, c)    DTRACE_PROBE3 (p, n, a, b, c)
+#define FOSFAT_PROBE4(p, n, a, b, c, d) DTRACE_PROBE4 (p, n, a, b, c, d)
+#else
+/* The arguments are not evaluated, but they are not unused variables */
+#define FOSFAT_PROBE1(p, n, a) \
+  do { (void) sizeof (a); } while (0)
+#define FOSFAT_PROBE2(p, n, a, b) \
+  do { (void) sizeof (a); (void) sizeof (b); } while (0)
+#define FOSFAT_PROBE3(p, n, a, b, c) \
+  do { (void) sizeof (a); (void) sizeof (b); (void) sizeof (c); } while (0)
+#define FOSFAT_PROBE4(p, n, a, b, c, d) \
+  do { (void) sizeof (a); (void) sizeof (b); (void) sizeof (c); \
+       (void) sizeof (d); } while (0)
+#endif /* HAVE_SYS_SDT_H */
+
 
 fosfat_data_t *fosfat_read_d (fosfat_t *fosfat, uint32_t block);
 void foslog (foslog_t type, const char *msg, ...);
 
+fosfat_blkcache_t *fosfat_blkcache_new (unsigned int size);
+void fosfat_blkcache_free (fosfat_blkcache_t *cache);
+int fosfat_blkcache_get (fosfat_blkcache_t *cache, uint32_t key, void *data);
+void fosfat_blkcache_put (fosfat_blkcache_t *cache,
+                          uint32_t key, const void *data);
+void fosfat_blkcache_counters (fosfat_blkcache_t *cache,
+                               unsigned long *hits, unsigned long *misses);
+unsigned int fosfat_blkcache_blocks (fosfat_blkcache_t *cache);
+
+fosfat_io_t *fosfat_io_open (const char *dev, unsigned int flag);
+fosfat_io_t *fosfat_io_backend (const fosfat_backend_t *backend, void *data);
+int fosfat_io_read (fosfat_io_t *io, uint64_t offset, void *buf, size_t size);
+int fosfat_io_batch (fosfat_io_t *io, const fosfat_io_req_t *reqs,
+                     unsigned int count);
+int fosfat_io_isasync (fosfat_io_t *io);
+void fosfat_io_cache (fosfat_io_t *io, fosfat_blkcache_t *cache);
+void fosfat_io_stats (fosfat_io_t *io, uint64_t *bytes, uint64_t *syscalls);
+void fosfat_io_reset (fosfat_io_t *io);
+void fosfat_io_close (fosfat_io_t *io);
+
+fosfat_ra_t *fosfat_ra_new (fosfat_ra_fetch_t fetch, void *data);
+void fosfat_ra_free (fosfat_ra_t *ra);
+int fosfat_ra_push (fosfat_ra_t *ra, uint32_t block, unsigned int nbs);
+void fosfat_ra_wait (fosfat_ra_t *ra);
+void fosfat_ra_wait_range (fosfat_ra_t *ra, uint32_t block, unsigned int nbs);
+void fosfat_ra_account (fosfat_ra_t *ra, int sequential);
+void fosfat_ra_counters (fosfat_ra_t *ra, fosfat_ra_stats_t *stats);
+
+int fosfat_container_probe (fosfat_io_t *io);
+fosfat_io_t *fosfat_container_open (fosfat_io_t *raw);
+fosfat_cwriter_t *fosfat_container_create (const char *file, uint32_t chunk);
+int fosfat_container_write (fosfat_cwriter_t *w, const void *data, size_t size);
+int fosfat_container_close (fosfat_cwriter_t *w);
+
+void fosfat_gen_defaults (fosfat_gen_t *gen);
+int fosfat_gen_image (const char *file, const fosfat_gen_t *gen,
+                      fosfat_gen_info_t *info);
+
+uint64_t fosfat_checksum (const void *data, size_t size);
+fosfat_sidecar_t *fosfat_sidecar_load (const char *dev);
+void fosfat_sidecar_close (fosfat_sidecar_t *sc);
+int fosfat_sidecar_save (const char *dev, const fosfat_sidecar_info_t *info,
+                         const fosfat_sidecar_entry_t *entries,
+                         uint32_t count, const char *names, size_t nsize);
+const fosfat_sidecar_info_t *fosfat_sidecar_info (fosfat_sidecar_t *sc);
+const fosfat_sidecar_entry_t *fosfat_sidecar_entries (fosfat_sidecar_t *sc,
+                                                      uint32_t *count);
+const char *fosfat_sidecar_name (fosfat_sidecar_t *sc,
+                                 const fosfat_sidecar_entry_t *entry);
+
 /*
  * Hex (BCD) to dec convertion.
  *
@@ -0,0 +1,666 @@
+/*
+ * FOS libfosfat: API for Smaky file system
+ * Copyright (C) 2025 Mathieu Schroeter <mathieu@schroetersa.ch>
+ *
+ * This file is part of Fosfat.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/types.h>
+
+#include "fosfat.h"
+#include "fosfat_internal.h"
+
+/*
+ * Image generator
+ * ~~~~~~~~~~~~~~~
+ * A synthetic disk is written with the same structures than a real one:
+ * the block 0, the SYS_LIST (BD at the block 1 and first BL at the block
+ * 2) and a tree of directories. The blocks are allocated forward; for
+ * each directory, the BD and the BL are reserved first, then the content
+ * is written, and the BL are filled at the end.
+ *
+ * A file is a chain of BD (gen->tranches per BD) and its data are split
+ * in tranches of 1 to gen->fragment blocks with a free block between two
+ * tranches (or in tranches of 255 blocks when the fragmentation is
+ * disabled). The content is pseudo-random (from gen->seed), then the same
+ * options give always the same image.
+ *
+ * The blocks are written directly at their place in the image; only the
+ * BL of the directories in progress are kept in memory.
+ */
+
+#define GEN_NBS               255   /* Max blocks in a tranche          */
+#define GEN_PTS               42    /* Max tranches in a BD             */
+#define GEN_NBL               4     /* Files in a BL                    */
+#define GEN_DEPTH             256   /* Max depth of the tree            */
+#define GEN_ENTRIES           (GEN_PTS * GEN_NBS * GEN_NBL)
+
+/* Content of a file */
+typedef enum gen_kind {
+  GEN_BINARY,                  /* Pseudo-random bytes                   */
+  GEN_TEXT                     /* Lines of ASCII                        */
+} gen_kind_t;
+
+/* States of the generator */
+typedef struct gen_s {
+  const fosfat_gen_t *opt;     /* Options                               */
+  fosfat_gen_info_t  *info;    /* Counters                              */
+  FILE               *fp;      /* Image                                 */
+  int                 fosboot; /* FOSBOOT address                       */
+  uint32_t            next;    /* Next free block                       */
+  uint32_t            rnd;     /* State of the PRNG                     */
+  uint8_t             chk[4];  /* FOSCHK                                */
+  int                 error;   /* A write has failed                    */
+} gen_t;
+
+
+static void
+put_be16 (uint8_t *it, uint32_t v)
+{
+  it[0] = v >> 8;
+  it[1] = v;
+}
+
+static void
+put_be32 (uint8_t *it, uint32_t v)
+{
+  it[0] = v >> 24;
+  it[1] = v >> 16;
+  it[2] = v >> 8;
+  it[3] = v;
+}
+
+static uint8_t
+int2bcd (unsigned int v)
+{
+  return (uint8_t) ((v / 10 % 10) << 4 | v % 10);
+}
+
+/* xorshift32 */
+static uint32_t
+gen_rand (gen_t *g)
+{
+  g->rnd ^= g->rnd << 13;
+  g->rnd ^= g->rnd >> 17;
+  g->rnd ^= g->rnd << 5;
+  return g->rnd;
+}
+
+static uint32_t
+gen_range (gen_t *g, uint32_t min, uint32_t max)
+{
+  if (max <= min)
+    return min;
+
+  return min + gen_rand (g) % (max - min + 1);
+}
+
+static uint32_t
+gen_alloc (gen_t *g, uint32_t nbs)
+{
+  uint32_t block = g->next;
+
+  g->next += nbs;
+  return block;
+}
+
+/*
+ * Write consecutive blocks at their place in the image.
+ *
+ * g            generator
+ * block        first block
+ * data         the blocks
+ * nbs          number of blocks
+ */
+static void
+gen_write (gen_t *g, uint32_t block, const void *data, uint32_t nbs)
+{
+  uint64_t offset = ((uint64_t) block + g->fosboot) * FOSFAT_BLK;
+  size_t size = (size_t) nbs * FOSFAT_BLK;
+
+  if (g->error)
+    return;
+
+#ifdef _WIN32
+  if (fseeko64 (g->fp, (off64_t) offset, SEEK_SET)
+#else
+  if (fseeko (g->fp, (off_t) offset, SEEK_SET)
+#endif /* !_WIN32 */
+      || fwrite (data, 1, size, g->fp) != size)
+    g->error = 1;
+}
+
+/*
+ * Fill the content of a file.
+ *
+ * The text is a function of the position, then a file can be written by
+ * parts.
+ *
+ * g            generator
+ * kind         binary or text
+ * buf          where to write
+ * pos          position in the file
+ * size         number of bytes
+ */
+static void
+gen_content (gen_t *g, gen_kind_t kind, uint8_t *buf,
+             uint32_t pos, uint32_t size)
+{
+  uint32_t i;
+
+  for (i = 0; i < size; i++, pos++)
+  {
+    if (kind == GEN_BINARY)
+    {
+      buf[i] = (uint8_t) gen_rand (g);
+      continue;
+    }
+
+    /* 64 characters by line */
+    switch (pos % 64)
+    {
+    case 0: case 1: case 2: case 3: case 4: case 5:
+      buf[i] = "/* l. "[pos % 64];
+      break;
+    case 6: case 7: case 8: case 9: case 10: case 11:
+    {
+      static const uint32_t pow10[] = { 100000, 10000, 1000, 100, 10, 1 };
+      buf[i] = (uint8_t) ('0' + pos / 64 / pow10[pos % 64 - 6] % 10);
+      break;
+    }
+    case 60: case 61: case 62:
+      buf[i] = " */"[pos % 64 - 60];
+      break;
+    case 63:
+      buf[i] = '\n';
+      break;
+    default:
+      buf[i] = (uint8_t) ('a' + (pos / 64 + pos % 64) % 26);
+    }
+  }
+}
+
+/*
+ * Fill an entry of a BL.
+ *
+ * g            generator
+ * file         the entry
+ * name         file name
+ * typ          file type
+ * att          attributes
+ * bd           first BD
+ * size         size in bytes
+ */
+static void
+gen_blf (gen_t *g, fosfat_blf_t *file, const char *name, uint8_t typ,
+         uint32_t att, uint32_t bd, uint32_t size)
+{
+  unsigned int day   = gen_range (g, 1, 28);
+  unsigned int month = gen_range (g, 1, 12);
+  unsigned int year  = gen_range (g, 80, 99);
+
+  memset (file, 0, sizeof (*file));
+  strncpy ((char *) file->name, name, sizeof (file->name) - 1);
+  file->typ = typ;
+  put_be32 (file->att, att);
+  put_be32 (file->lg, (size + FOSFAT_BLK - 1) / FOSFAT_BLK);
+  put_be16 (file->lgb, size % FOSFAT_BLK);
+
+  file->cd[0] = int2bcd (day);
+  file->cd[1] = int2bcd (month);
+  file->cd[2] = int2bcd (year);
+  file->ch[0] = int2bcd (gen_range (g, 0, 23));
+  file->ch[1] = int2bcd (gen_range (g, 0, 59));
+  file->ch[2] = int2bcd (gen_range (g, 0, 59));
+  memcpy (file->wd, file->cd, sizeof (file->wd));
+  memcpy (file->wh, file->ch, sizeof (file->wh));
+  memcpy (file->rd, file->cd, sizeof (file->rd));
+  memcpy (file->rh, file->ch, sizeof (file->rh));
+
+  put_be32 (file->pt, bd);
+  put_be32 (file->lgf, size);
+}
+
+/* Entry of a directory in its BL */
+static fosfat_blf_t *
+gen_entry (uint8_t *bls, unsigned int n)
+{
+  return (fosfat_blf_t *) (bls + n / GEN_NBL * FOSFAT_BLK) + n % GEN_NBL;
+}
+
+/*
+ * Write a file (data and BD).
+ *
+ * g            generator
+ * name         file name (for the BD)
+ * kind         content of the file
+ * head         first bytes of the file (or NULL)
+ * hsize        number of bytes in head
+ * size         size of the file
+ * return the first BD
+ */
+static uint32_t
+gen_file (gen_t *g, const char *name, gen_kind_t kind,
+          const uint8_t *head, uint32_t hsize, uint32_t size)
+{
+  uint32_t i, j, ntr = 0, nbd, bd, pos = 0, off = 0;
+  uint32_t left = size ? (size + FOSFAT_BLK - 1) / FOSFAT_BLK : 1;
+  uint32_t (*trs)[2];
+  uint8_t *buf;
+  unsigned int per = g->opt->tranches;
+
+  trs = malloc ((left + 1) * sizeof (*trs));
+  buf = malloc (GEN_NBS * FOSFAT_BLK);
+  if (!trs || !buf)
+  {
+    g->error = 1;
+    free (trs);
+    free (buf);
+    return 0;
+  }
+
+  /* Data */
+  while (left)
+  {
+    uint32_t nbs = g->opt->fragment
+                 ? gen_range (g, 1, g->opt->fragment) : GEN_NBS;
+    uint32_t len;
+
+    nbs = MIN (nbs, left);
+    len = MIN (nbs * FOSFAT_BLK, size - pos);
+
+    memset (buf, 0, nbs * FOSFAT_BLK);
+    for (i = 0; i < len; i++)
+      if (pos + i < hsize)
+        buf[i] = head[pos + i];
+      else
+        break;
+    gen_content (g, kind, buf + i, pos + i, len - i);
+
+    trs[ntr][0] = gen_alloc (g, nbs);
+    trs[ntr][1] = nbs;
+    gen_write (g, trs[ntr][0], buf, nbs);
+    ntr++;
+
+    /* A hole between the tranches */
+    if (g->opt->fragment)
+      gen_alloc (g, 1);
+
+    pos  += len;
+    left -= nbs;
+  }
+
+  /* BD chain */
+  nbd = (ntr + per - 1) / per;
+  bd  = gen_alloc (g, nbd);
+
+  for (i = 0; i < nbd; i++)
+  {
+    fosfat_bd_t desc;
+    uint32_t first = i * per;
+    uint32_t npt = MIN (per, ntr - first);
+
+    memset (&desc, 0, sizeof (desc));
+    put_be32 (desc.next, i + 1 < nbd ? bd + i + 1 : 0);
+    put_be32 (desc.prev, i ? bd + i - 1 : 0);
+    put_be16 (desc.npt, npt);
+    strncpy ((char *) desc.name, name, sizeof (desc.name) - 1);
+
+    for (j = 0; j < npt; j++)
+    {
+      put_be32 (desc.pts[j], trs[first + j][0]);
+      desc.nbs[j] = (uint8_t) trs[first + j][1];
+    }
+
+    /* Only the last block of the file is not always full */
+    put_be16 (desc.lst, i + 1 < nbd ? FOSFAT_BLK
+                        : size % FOSFAT_BLK
+                          ? size % FOSFAT_BLK : size ? FOSFAT_BLK : 0);
+    memcpy (desc.chk, g->chk, sizeof (desc.chk));
+    put_be32 (desc.off, off);
+
+    for (j = 0; j < npt; j++)
+      off += trs[first + j][1];
+
+    gen_write (g, bd + i, &desc, 1);
+  }
+
+  g->info->blocks_data += pos ? (pos + FOSFAT_BLK - 1) / FOSFAT_BLK : 1;
+  g->info->tranches    += ntr;
+  g->info->bds         += nbd;
+
+  free (trs);
+  free (buf);
+  return bd;
+}
+
+/*
+ * Write an .image (1 bit per pixel) or a .color (4 bits per pixel) file.
+ *
+ * g            generator
+ * name         file name
+ * color        true for .color
+ * size         where to put the size of the file
+ * return the first BD
+ */
+static uint32_t
+gen_image (gen_t *g, const char *name, int color, uint32_t *size)
+{
+  unsigned int i;
+  uint8_t head[32 + 192];
+  uint32_t hsize = 32;
+  uint32_t dlx = 8 * gen_range (g, 4, 64);
+  uint32_t dly = gen_range (g, 16, 256);
+  uint32_t nbb = color ? dlx / 2 * dly : dlx / 8 * dly;
+
+  memset (head, 0, sizeof (head));
+  head[0] = color ? 0x82 : 0x81;  /* .COLOR or .IMAGE */
+  head[1] = 0x00;                 /* Uncoded          */
+  head[2] = color ? 0x04 : 0x01;  /* Bits per pixel   */
+  head[3] = 0x02;                 /* X-Y like screen  */
+  put_be16 (head + 4, dlx);
+  put_be16 (head + 6, dly);
+  put_be32 (head + 8, nbb);
+
+  /* Color map: 16 entries (index, red, green, blue) */
+  if (color)
+  {
+    uint8_t *map = head + hsize;
+
+    map[0]  = 0x90;
+    map[12] = 0xa0;
+    map[15] = 0x10;
+    map[31] = 0x24;
+    for (i = 0; i < 16; i++)
+    {
+      uint8_t *it = map + 32 + i * 10;
+
+      put_be32 (it, i);
+      it[4] = (uint8_t) (i * 17);
+      it[6] = (uint8_t) (255 - i * 17);
+      it[8] = (uint8_t) (i * 97);
+    }
+    hsize += 192;
+  }
+
+  *size = hsize + nbb;
+  return gen_file (g, name, GEN_BINARY, head, hsize, *size);
+}
+
+/*
+ * Write a soft-link.
+ *
+ * The target is saved like FOS (with ':' as separator) after 3 bytes.
+ *
+ * g            generator
+ * name         file name
+ * target       target path (with ':')
+ * size         where to put the size of the file
+ * return the first BD
+ */
+static uint32_t
+gen_link (gen_t *g, const char *name, const char *target, uint32_t *size)
+{
+  uint8_t head[FOSFAT_BLK];
+  size_t len = MIN (strlen (target), sizeof (head) - 4);
+
+  memset (head, 0, sizeof (head));
+  memcpy (head + 3, target, len);
+
+  *size = (uint32_t) len + 4;
+  return gen_file (g, name, GEN_BINARY, head, *size, *size);
+}
+
+/*
+ * Write a directory and all its content (recursive).
+ *
+ * g            generator
+ * level        depth of the directory (0 for the root)
+ * path         location of the directory (with ':', empty for the root)
+ * name         name of the directory (for the BD)
+ * size         where to put the size of the directory
+ * return the BD of the directory
+ */
+static uint32_t
+gen_dir (gen_t *g, unsigned int level, const char *path,
+         const char *name, uint32_t *size)
+{
+  const fosfat_gen_t *opt = g->opt;
+  unsigned int i, n = 0, count, nbl, ntr;
+  unsigned int subdirs = level < opt->depth ? opt->dirs : 0;
+  uint32_t bd, bl;
+  fosfat_bd_t desc;
+  uint8_t *bls;
+  char *sub;
+
+  count = 1 + opt->files + opt->deleted + opt->links + opt->images + subdirs;
+  count = MIN (count, GEN_ENTRIES);
+  nbl = (count + GEN_NBL - 1) / GEN_NBL;
+  ntr = (nbl + GEN_NBS - 1) / GEN_NBS;
+
+  bd = gen_alloc (g, 1);
+  bl = gen_alloc (g, nbl);
+
+  /* The last BL is accessed with fosfat_bl_t which is bigger */
+  bls = calloc (1, nbl * FOSFAT_BLK + sizeof (fosfat_bl_t));
+  sub = malloc (strlen (path) + 32);
+  if (!bls || !sub)
+  {
+    g->error = 1;
+    free (bls);
+    free (sub);
+    return 0;
+  }
+
+  *size = nbl * FOSFAT_BLK;
+  gen_blf (g, gen_entry (bls, n++), "sys_list", FOSFAT_TYPE_SYSTEM,
+           FOSFAT_ATT_OPENEX | FOSFAT_ATT_DIR, bd, *size);
+
+  for (i = 0; i < opt->files && n < count; i++)
+  {
+    char fname[32];
+    uint32_t fsize = gen_range (g, opt->size_min, opt->size_max);
+    gen_kind_t kind = i % 3 ? GEN_BINARY : GEN_TEXT;
+    uint32_t att = FOSFAT_ATT_OPENEX | (i % 5 != 4 ? FOSFAT_ATT_VISIBLE : 0);
+
+    snprintf (fname, sizeof (fname),
+              kind == GEN_TEXT ? "f%u.c" : "file%u", i);
+    gen_blf (g, gen_entry (bls, n++), fname, 0, att,
+             gen_file (g, fname, kind, NULL, 0, fsize), fsize);
+    g->info->files++;
+  }
+
+  /* The deleted files are still on the disk (for F_UNDELETE) */
+  for (i = 0; i < opt->deleted && n < count; i++)
+  {
+    char fname[32];
+    uint32_t fsize = gen_range (g, opt->size_min, opt->size_max);
+    fosfat_blf_t *file = gen_entry (bls, n++);
+
+    snprintf (fname, sizeof (fname), "del%u", i);
+    gen_blf (g, file, fname, 0, FOSFAT_ATT_OPENEX | FOSFAT_ATT_VISIBLE,
+             gen_file (g, fname, GEN_BINARY, NULL, 0, fsize), fsize);
+    memmove (file->name + 1, file->name, sizeof (file->name) - 1);
+    file->name[0] = '\0';
+    g->info->deleted++;
+  }
+
+  for (i = 0; i < opt->images && n < count; i++)
+  {
+    char fname[32];
+    uint32_t fsize, fbd;
+
+    snprintf (fname, sizeof (fname), i % 2 ? "pic%u.color" : "pic%u.image", i);
+    fbd = gen_image (g, fname, i % 2, &fsize);
+    gen_blf (g, gen_entry (bls, n++), fname, 0,
+             FOSFAT_ATT_OPENEX | FOSFAT_ATT_VISIBLE, fbd, fsize);
+    g->info->images++;
+  }
+
+  /* The links are on the first text file (or on the directory) */
+  for (i = 0; i < opt->links && n < count; i++)
+  {
+    char fname[32];
+    uint32_t fsize, fbd;
+
+    snprintf (fname, sizeof (fname), "lnk%u.dir", i);
+    sprintf (sub, opt->files ? "%sf0.c:" : "%s", path);
+    fbd = gen_link (g, fname, sub, &fsize);
+    gen_blf (g, gen_entry (bls, n++), fname, 0, FOSFAT_ATT_OPENEX
+             | FOSFAT_ATT_VISIBLE | FOSFAT_ATT_LINK, fbd, fsize);
+    g->info->links++;
+  }
+
+  for (i = 0; i < subdirs && n < count && !g->error; i++)
+  {
+    char fname[32];
+    uint32_t fsize, fbd;
+
+    snprintf (fname, sizeof (fname), "d%u.dir", i);
+    sprintf (sub, "%sd%u:", path, i);
+    fbd = gen_dir (g, level + 1, sub, fname, &fsize);
+    gen_blf (g, gen_entry (bls, n++), fname, 0, FOSFAT_ATT_OPENEX
+             | FOSFAT_ATT_VISIBLE | FOSFAT_ATT_DIR, fbd, fsize);
+  }
+
+  /* BL */
+  for (i = 0; i < nbl; i++)
+  {
+    fosfat_bl_t *it = (fosfat_bl_t *) (bls + i * FOSFAT_BLK);
+
+    put_be32 (it->next, i + 1 < nbl ? bl + i + 1 : 0);
+    put_be32 (it->prev, i ? bl + i - 1 : 0);
+    memcpy (it->chk, g->chk, sizeof (it->chk));
+  }
+  gen_write (g, bl, bls, nbl);
+
+  /* BD */
+  memset (&desc, 0, sizeof (desc));
+  put_be16 (desc.npt, ntr);
+  strncpy ((char *) desc.name, name, sizeof (desc.name) - 1);
+  for (i = 0; i < ntr; i++)
+  {
+    put_be32 (desc.pts[i], bl + i * GEN_NBS);
+    desc.nbs[i] = (uint8_t) MIN (GEN_NBS, nbl - i * GEN_NBS);
+  }
+  put_be16 (desc.lst, FOSFAT_BLK);
+  put_be16 (desc.nbl, nbl);
+  memcpy (desc.chk, g->chk, sizeof (desc.chk));
+  gen_write (g, bd, &desc, 1);
+
+  g->info->dirs++;
+  g->info->blocks_list += nbl;
+
+  free (bls);
+  free (sub);
+  return bd;
+}
+
+/*
+ * Default options of the generator.
+ *
+ * gen          where to put the options
+ */
+void
+fosfat_gen_defaults (fosfat_gen_t *gen)
+{
+  memset (gen, 0, sizeof (*gen));
+
+  gen->disk     = FOSFAT_FD;
+  gen->name     = "FOSGEN";
+  gen->chk      = 0x5A4D4B31;
+  gen->seed     = 1;
+  gen->depth    = 2;
+  gen->dirs     = 2;
+  gen->files    = 16;
+  gen->deleted  = 1;
+  gen->links    = 1;
+  gen->images   = 2;
+  gen->size_min = 0;
+  gen->size_max = 64 * 1024;
+  gen->fragment = 0;
+  gen->tranches = GEN_PTS;
+}
+
+/*
+ * Write a synthetic disk image.
+ *
+ * file         location of the image (overwritten)
+ * gen          options
+ * info         where to put the counters (can be NULL)
+ * return a boolean
+ */
+int
+fosfat_gen_image (const char *file, const fosfat_gen_t *gen,
+                  fosfat_gen_info_t *info)
+{
+  gen_t g;
+  fosfat_gen_t opt;
+  fosfat_gen_info_t dummy;
+  fosfat_b0_t b0;
+  uint32_t size;
+  int res;
+
+  if (!file || !gen)
+    return 0;
+
+  if (gen->disk != FOSFAT_FD && gen->disk != FOSFAT_HD)
+  {
+    foslog (FOSLOG_ERROR, "only floppy and hard disks can be generated");
+    return 0;
+  }
+
+  opt = *gen;
+  if (!opt.tranches || opt.tranches > GEN_PTS)
+    opt.tranches = GEN_PTS;
+  opt.fragment = MIN (opt.fragment, GEN_NBS);
+  opt.depth    = MIN (opt.depth, GEN_DEPTH);
+  opt.size_max = MAX (opt.size_min, opt.size_max);
+
+  memset (&g, 0, sizeof (g));
+  g.opt     = &opt;
+  g.info    = info ? info : &dummy;
+  g.fosboot = gen->disk == FOSFAT_FD ? FOSBOOT_FD : FOSBOOT_HD;
+  g.next    = FOSFAT_SYSLIST;
+  g.rnd     = gen->seed ? gen->seed : 1;
+  put_be32 (g.chk, gen->chk);
+  memset (g.info, 0, sizeof (*g.info));
+
+  g.fp = fopen (file, "wb");
+  if (!g.fp)
+    return 0;
+
+  memset (&b0, 0, sizeof (b0));
+  strncpy ((char *) b0.nlo, gen->name ? gen->name : "", sizeof (b0.nlo) - 1);
+  memcpy (b0.chk, g.chk, sizeof (b0.chk));
+  gen_write (&g, FOSFAT_BLOCK0, &b0, 1);
+
+  /* The SYS_LIST is always the first BD */
+  gen_dir (&g, 0, "", "SYS_LIST", &size);
+
+  g.info->blocks = g.next;
+
+  res = !g.error;
+  if (fclose (g.fp))
+    res = 0;
+
+  return res;
+}
@@ -28,8 +28,6 @@
 #include "fosfat_internal.h"
 
 
-#define MOSFAT_DEV            void
-
 /*
  * File entry size : 24 bytes
  *
@@ -76,7 +74,7 @@ typedef struct mosfat_dr_s {
 
 /* Main mosfat structure */
 struct mosfat_s {
-  MOSFAT_DEV *dev;            /* file disk image or physical device    */
+  fosfat_io_t *dev;           /* file disk image or physical device    */
   int         isfile;         /* if it's a file                        */
 };
 
@@ -102,17 +100,12 @@ mosfat_read_dr (mosfat_t *mosfat, uint16_t block)
   if (!mosfat || !mosfat->dev)
     return NULL;
 
-  /* Move the pointer on the block */
-  if (fseek (mosfat->dev, blk2add (block), SEEK_SET))
-    return NULL;
-
   dr = malloc (sizeof (mosfat_dr_t));
   if (!dr)
     return NULL;
 
-  read = fread ((mosfat_dr_t *) dr,
-                1, (size_t) sizeof (mosfat_dr_t), mosfat->dev)
-         == (size_t) sizeof (mosfat_dr_t);
+  read = fosfat_io_read (mosfat->dev, blk2add (block),
+                         dr, sizeof (mosfat_dr_t));
   if (read)
     return dr;
 
@@ -129,16 +122,11 @@ mosfat_read_data (mosfat_t *mosfat, uint16_t block, size_t size)
   if (!mosfat || !mosfat->dev)
     return NULL;
 
-  /* Move the pointer on the block */
-  if (fseek (mosfat->dev, blk2add (block), SEEK_SET))
-    return NULL;
-
   data = calloc (1, size);
   if (!data)
     return NULL;
 
-  read = fread ((uint8_t *) data, 1, (size_t) size, mosfat->dev)
-         == (size_t) size;
+  read = fosfat_io_read (mosfat->dev, blk2add (block), data, size);
   if (read)
     return data;
 
@@ -366,43 +354,70 @@ mosfat_isdir (mosfat_t *mosfat, const char *location)
 }
 
 /*
- * Open the device.
+ * Create the handle on an opened device.
  *
- * That hides the fopen processing.
+ * The device I/O is owned by the handle, it is closed on error.
  *
- * dev          the device name
+ * io           the device I/O
  * return the device handle
  */
-mosfat_t *
-mosfat_open (const char *dev)
+static mosfat_t *
+mosfat_open_io (fosfat_io_t *io)
 {
   mosfat_t *mosfat = NULL;
 
-  if (!dev)
+  if (!io)
     return NULL;
 
   mosfat = calloc (1, sizeof (mosfat_t));
   if (!mosfat)
+  {
+    fosfat_io_close (io);
     return NULL;
+  }
 
   mosfat->isfile = 1;
-  mosfat->dev = fopen (dev, "rb");
-  if (!mosfat->dev)
-    goto err_dev;
+  mosfat->dev = io;
 
   foslog (FOSLOG_NOTICE, "mosfat is ready");
 
   return mosfat;
+}
 
- err_dev:
-  free (mosfat);
-  return NULL;
+/*
+ * Open the device.
+ *
+ * That hides the device I/O processing.
+ *
+ * dev          the device name
+ * return the device handle
+ */
+mosfat_t *
+mosfat_open (const char *dev)
+{
+  if (!dev)
+    return NULL;
+
+  return mosfat_open_io (fosfat_io_open (dev, 0));
+}
+
+/*
+ * Open a disk provided by a backend.
+ *
+ * backend      the functions of the backend
+ * data         user data passed to the functions (closed with the handle)
+ * return the device handle
+ */
+mosfat_t *
+mosfat_open_backend (const fosfat_backend_t *backend, void *data)
+{
+  return mosfat_open_io (fosfat_io_backend (backend, data));
 }
 
 /*
  * Close the device.
  *
- * That hides the fclose processing.
+ * That hides the device I/O processing.
  *
  * mosfat       handle
  */
@@ -414,8 +429,7 @@ mosfat_close(mosfat_t *mosfat)
 
   foslog (FOSLOG_NOTICE, "device is closing ...");
 
-  if (mosfat->dev)
-    fclose (mosfat->dev);
+  fosfat_io_close (mosfat->dev);
 
   free (mosfat);
 }
@@ -0,0 +1,333 @@
+/*
+ * FOS libfosfat: API for Smaky file system
+ * Copyright (C) 2025 Mathieu Schroeter <mathieu@schroetersa.ch>
+ *
+ * This file is part of Fosfat.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "fosfat.h"
+#include "fosfat_internal.h"
+
+/*
+ * Readahead
+ * ~~~~~~~~~
+ * The file handles are detecting the sequential reads and are pushing
+ * the next tranches in a small queue. A worker thread (started with the
+ * first request) fetches these blocks in the block cache, then the next
+ * reads of the file are served by the cache.
+ *
+ * The queue is bounded; when it is full, the request is dropped because
+ * the reader will read these blocks itself. A reader which needs blocks
+ * queued or in flight waits for the worker instead of reading the same
+ * blocks on the device. With Window$ there is no
+ * worker and the blocks are fetched immediately by the reader (only one
+ * bigger access on the device).
+ */
+
+#define READAHEAD_QUEUE       32
+
+/* One request (a run of consecutive blocks) */
+typedef struct readahead_req_s {
+  uint32_t     block;          /* First block                           */
+  unsigned int nbs;            /* Number of blocks                      */
+} readahead_req_t;
+
+/* Main readahead structure */
+struct readahead_s {
+  fosfat_ra_fetch_t fetch;     /* Read the blocks in the cache          */
+  void            *data;       /* User data for fetch                   */
+  readahead_req_t  queue[READAHEAD_QUEUE]; /* Ring of pending requests  */
+  unsigned int     head;       /* Next request for the worker           */
+  unsigned int     pending;    /* Number of requests in the ring        */
+  int              busy;       /* The worker is fetching a request      */
+  readahead_req_t  current;    /* Request fetched by the worker         */
+  fosfat_ra_stats_t stats;     /* Counters                              */
+  fosfat_mutex_t   mutex;      /* Lock for all states                   */
+#ifndef _WIN32
+  pthread_cond_t   cond;       /* Signal a new request or the stop      */
+  pthread_cond_t   idle;       /* Signal the end of a request           */
+  pthread_t        thread;     /* Worker                                */
+  int              started;    /* The worker is running                 */
+  int              stop;       /* The worker must exit                  */
+#endif /* !_WIN32 */
+};
+
+
+#ifndef _WIN32
+
+static void *
+readahead_worker (void *data)
+{
+  fosfat_ra_t *ra = data;
+
+  fosfat_mutex_lock (&ra->mutex);
+
+  for (;;)
+  {
+    readahead_req_t req;
+
+    while (!ra->pending && !ra->stop)
+      pthread_cond_wait (&ra->cond, &ra->mutex);
+
+    if (ra->stop)
+      break;
+
+    req = ra->queue[ra->head];
+    ra->head = (ra->head + 1) % READAHEAD_QUEUE;
+    ra->pending--;
+    ra->busy    = 1;
+    ra->current = req;
+
+    fosfat_mutex_unlock (&ra->mutex);
+    ra->fetch (ra->data, req.block, req.nbs);
+    fosfat_mutex_lock (&ra->mutex);
+
+    ra->busy = 0;
+    pthread_cond_broadcast (&ra->idle);
+  }
+
+  fosfat_mutex_unlock (&ra->mutex);
+  return NULL;
+}
+
+/*
+ * Test if a run of blocks overlaps a request queued or in flight (the
+ * lock must be held).
+ */
+static int
+readahead_overlap (fosfat_ra_t *ra, uint32_t block, unsigned int nbs)
+{
+  unsigned int i;
+
+  if (ra->busy
+      && block < ra->current.block + ra->current.nbs
+      && ra->current.block < block + nbs)
+    return 1;
+
+  for (i = 0; i < ra->pending; i++)
+  {
+    const readahead_req_t *req = &ra->queue[(ra->head + i) % READAHEAD_QUEUE];
+
+    if (block < req->block + req->nbs && req->block < block + nbs)
+      return 1;
+  }
+
+  return 0;
+}
+
+#endif /* !_WIN32 */
+
+/*
+ * Create a readahead queue.
+ *
+ * The worker is not started here but only with the first request.
+ *
+ * fetch        function which reads the blocks in the block cache
+ * data         user data for fetch
+ * return the queue or NULL on error
+ */
+fosfat_ra_t *
+fosfat_ra_new (fosfat_ra_fetch_t fetch, void *data)
+{
+  fosfat_ra_t *ra;
+
+  if (!fetch)
+    return NULL;
+
+  ra = calloc (1, sizeof (fosfat_ra_t));
+  if (!ra)
+    return NULL;
+
+  ra->fetch = fetch;
+  ra->data  = data;
+  fosfat_mutex_init (&ra->mutex);
+#ifndef _WIN32
+  pthread_cond_init (&ra->cond, NULL);
+  pthread_cond_init (&ra->idle, NULL);
+#endif /* !_WIN32 */
+
+  return ra;
+}
+
+/*
+ * Stop the worker and release the queue.
+ *
+ * The pending requests are dropped.
+ *
+ * ra           the readahead queue
+ */
+void
+fosfat_ra_free (fosfat_ra_t *ra)
+{
+  if (!ra)
+    return;
+
+#ifndef _WIN32
+  fosfat_mutex_lock (&ra->mutex);
+  ra->stop = 1;
+  pthread_cond_signal (&ra->cond);
+  fosfat_mutex_unlock (&ra->mutex);
+
+  if (ra->started)
+    pthread_join (ra->thread, NULL);
+
+  pthread_cond_destroy (&ra->cond);
+  pthread_cond_destroy (&ra->idle);
+#endif /* !_WIN32 */
+  fosfat_mutex_destroy (&ra->mutex);
+  free (ra);
+}
+
+/*
+ * Push a run of blocks to prefetch.
+ *
+ * ra           the readahead queue
+ * block        first block
+ * nbs          number of blocks
+ * return a boolean (false if the request is dropped)
+ */
+int
+fosfat_ra_push (fosfat_ra_t *ra, uint32_t block, unsigned int nbs)
+{
+  int res = 0;
+
+  if (!ra || !nbs)
+    return 0;
+
+#ifdef _WIN32
+  fosfat_mutex_lock (&ra->mutex);
+  ra->stats.requests++;
+  ra->stats.blocks += nbs;
+  fosfat_mutex_unlock (&ra->mutex);
+
+  ra->fetch (ra->data, block, nbs);
+  res = 1;
+#else
+  fosfat_mutex_lock (&ra->mutex);
+
+  if (!ra->started && !ra->stop)
+    ra->started = !pthread_create (&ra->thread, NULL, readahead_worker, ra);
+
+  if (ra->started && ra->pending < READAHEAD_QUEUE)
+  {
+    readahead_req_t *req =
+      &ra->queue[(ra->head + ra->pending) % READAHEAD_QUEUE];
+
+    req->block = block;
+    req->nbs   = nbs;
+    ra->pending++;
+    ra->stats.requests++;
+    ra->stats.blocks += nbs;
+    pthread_cond_signal (&ra->cond);
+    res = 1;
+  }
+  else
+    ra->stats.dropped++;
+
+  fosfat_mutex_unlock (&ra->mutex);
+#endif /* !_WIN32 */
+
+  return res;
+}
+
+/*
+ * Wait until all requests are fetched.
+ *
+ * ra           the readahead queue
+ */
+void
+fosfat_ra_wait (fosfat_ra_t *ra)
+{
+  if (!ra)
+    return;
+
+#ifndef _WIN32
+  fosfat_mutex_lock (&ra->mutex);
+  while (ra->started && (ra->pending || ra->busy))
+    pthread_cond_wait (&ra->idle, &ra->mutex);
+  fosfat_mutex_unlock (&ra->mutex);
+#endif /* !_WIN32 */
+}
+
+/*
+ * Wait until a run of blocks is no longer queued or fetched.
+ *
+ * Then the blocks are in the block cache (or the fetch has failed) and
+ * the reader does not read them a second time.
+ *
+ * ra           the readahead queue
+ * block        first block
+ * nbs          number of blocks
+ */
+void
+fosfat_ra_wait_range (fosfat_ra_t *ra, uint32_t block, unsigned int nbs)
+{
+  if (!ra || !nbs)
+    return;
+
+#ifndef _WIN32
+  fosfat_mutex_lock (&ra->mutex);
+  while (ra->started && !ra->stop && readahead_overlap (ra, block, nbs))
+    pthread_cond_wait (&ra->idle, &ra->mutex);
+  fosfat_mutex_unlock (&ra->mutex);
+#else
+  (void) block;
+#endif /* !_WIN32 */
+}
+
+/*
+ * Count a read of a file handle.
+ *
+ * ra           the readahead queue
+ * sequential   true if the read follows the previous one
+ */
+void
+fosfat_ra_account (fosfat_ra_t *ra, int sequential)
+{
+  if (!ra)
+    return;
+
+  fosfat_mutex_lock (&ra->mutex);
+  if (sequential)
+    ra->stats.sequential++;
+  else
+    ra->stats.random++;
+  fosfat_mutex_unlock (&ra->mutex);
+}
+
+/*
+ * Get the counters.
+ *
+ * ra           the readahead queue
+ * stats        where to copy the counters
+ */
+void
+fosfat_ra_counters (fosfat_ra_t *ra, fosfat_ra_stats_t *stats)
+{
+  memset (stats, 0, sizeof (*stats));
+
+  if (!ra)
+    return;
+
+  fosfat_mutex_lock (&ra->mutex);
+  *stats = ra->stats;
+  fosfat_mutex_unlock (&ra->mutex);
+}
@@ -0,0 +1,503 @@
+/*
+ * FOS libfosfat: API for Smaky file system
+ * Copyright (C) 2025 Mathieu Schroeter <mathieu@schroetersa.ch>
+ *
+ * This file is part of Fosfat.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif /* !_WIN32 */
+
+#include "fosfat.h"
+#include "fosfat_internal.h"
+
+/*
+ * Sidecar index
+ * ~~~~~~~~~~~~~
+ * The sidecar is a file which keeps the cache of a disk image between two
+ * fosfat_open(). It is written next to the image (foo.img.fosidx) or, if
+ * it is not possible, in $XDG_CACHE_HOME/fosfat (or ~/.cache/fosfat).
+ *
+ * The file is in the native byte order of the host:
+ *
+ *  | header | entries (count * entsize) | names (string table) |
+ *
+ * The entries are in the order of the cache: a directory is always before
+ * its content and the content of a directory is contiguous, then the cache
+ * can be rebuilt in one pass. The sidecar is only
+ * valid for the same image (size and mtime) and the same content of the
+ * block 0 and the SYS_LIST (checked by fosfat_open()).
+ *
+ * Only the regular files are supported (not the devices), and it is not
+ * available with Window$.
+ */
+
+#define SIDECAR_MAGIC         "FOSIDX\r\n"
+#define SIDECAR_VERSION       4
+#define SIDECAR_ENDIAN        0x01020304
+#define SIDECAR_EXT           ".fosidx"
+
+/* Header of the sidecar (88 bytes) */
+typedef struct sidecar_header_s {
+  char     magic[8];           /* SIDECAR_MAGIC                         */
+  uint32_t version;            /* SIDECAR_VERSION                       */
+  uint32_t endian;             /* SIDECAR_ENDIAN in the host order      */
+  uint32_t entsize;            /* Size of one entry                     */
+  uint32_t count;              /* Number of entries                     */
+  uint64_t names;              /* Size of the string table              */
+  uint64_t imgsize;            /* Size of the image                     */
+  int64_t  imgmtime;           /* Modification time of the image        */
+  uint64_t datachk;            /* Checksum of the entries and the names */
+  int32_t  fosboot;            /* FOSBOOT address                       */
+  uint32_t foschk;             /* CHK of the disk                       */
+  uint32_t viewdel;            /* Deleted files are in the entries      */
+  uint32_t reserved;           /* Unused                                */
+  uint64_t chk0;               /* Checksum of the block 0               */
+  uint64_t chksys;             /* Checksum of the SYS_LIST              */
+} sidecar_header_t;
+
+/* Main sidecar structure (a loaded sidecar) */
+struct sidecar_s {
+  fosfat_sidecar_info_t info;  /* Disk attributes                       */
+  uint8_t     *map;            /* Sidecar mapped in memory              */
+  size_t       size;           /* Size of the mapping                   */
+  uint32_t     count;          /* Number of entries                     */
+  const fosfat_sidecar_entry_t *entries;
+  const char  *names;          /* String table                          */
+  uint64_t     nsize;          /* Size of the string table              */
+};
+
+
+/*
+ * Checksum (FNV-1a 64 bits).
+ *
+ * data         the data
+ * size         number of bytes
+ * return the checksum
+ */
+uint64_t
+fosfat_checksum (const void *data, size_t size)
+{
+  size_t i;
+  const uint8_t *it = data;
+  uint64_t hash = 14695981039346656037ULL;
+
+  for (i = 0; i < size; i++)
+  {
+    hash ^= it[i];
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+#ifndef _WIN32
+
+static uint64_t
+sidecar_checksum2 (const void *a, size_t asize, const void *b, size_t bsize)
+{
+  size_t i;
+  const uint8_t *it;
+  uint64_t hash = fosfat_checksum (a, asize);
+
+  for (i = 0, it = b; i < bsize; i++)
+  {
+    hash ^= it[i];
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+/*
+ * Location of the sidecar for an image.
+ *
+ * dev          location of the image
+ * which        0 for next to the image, 1 for the cache directory
+ * mkdirs       create the cache directory if necessary
+ * return the location (must be freed) or NULL if not available
+ */
+static char *
+sidecar_path (const char *dev, int which, int mkdirs)
+{
+  char *path, *real;
+  const char *xdg, *home;
+  char dir[4096];
+
+  if (!which)
+  {
+    path = malloc (strlen (dev) + sizeof (SIDECAR_EXT));
+    if (path)
+      sprintf (path, "%s" SIDECAR_EXT, dev);
+    return path;
+  }
+
+  xdg  = getenv ("XDG_CACHE_HOME");
+  home = getenv ("HOME");
+
+  if (xdg && *xdg)
+    snprintf (dir, sizeof (dir), "%s", xdg);
+  else if (home && *home)
+    snprintf (dir, sizeof (dir), "%s/.cache", home);
+  else
+    return NULL;
+
+  if (mkdirs)
+    mkdir (dir, 0700);
+  strncat (dir, "/fosfat", sizeof (dir) - strlen (dir) - 1);
+  if (mkdirs)
+    mkdir (dir, 0700);
+
+  /* The name is a hash of the absolute location of the image */
+  real = realpath (dev, NULL);
+  if (!real)
+    return NULL;
+
+  path = malloc (strlen (dir) + 1 + 16 + sizeof (SIDECAR_EXT));
+  if (path)
+    sprintf (path, "%s/%016" PRIx64 SIDECAR_EXT,
+             dir, fosfat_checksum (real, strlen (real)));
+
+  free (real);
+  return path;
+}
+
+/*
+ * Test if a mapped sidecar is consistent and matches the image.
+ */
+static int
+sidecar_check (fosfat_sidecar_t *sc, const struct stat *img)
+{
+  uint32_t i;
+  uint64_t esize;
+  const sidecar_header_t *hdr = (const sidecar_header_t *) sc->map;
+
+  if (sc->size < sizeof (*hdr)
+      || memcmp (hdr->magic, SIDECAR_MAGIC, sizeof (hdr->magic))
+      || hdr->version != SIDECAR_VERSION
+      || hdr->endian  != SIDECAR_ENDIAN
+      || hdr->entsize != sizeof (fosfat_sidecar_entry_t))
+    return 0;
+
+  /* Same image? */
+  if (hdr->imgsize != (uint64_t) img->st_size
+      || hdr->imgmtime != (int64_t) img->st_mtime)
+    return 0;
+
+  esize = (uint64_t) hdr->count * hdr->entsize;
+  if (!hdr->count || !hdr->names
+      || sizeof (*hdr) + esize + hdr->names != sc->size)
+    return 0;
+
+  sc->count   = hdr->count;
+  sc->entries = (const fosfat_sidecar_entry_t *) (sc->map + sizeof (*hdr));
+  sc->names   = (const char *) sc->map + sizeof (*hdr) + esize;
+  sc->nsize   = hdr->names;
+
+  if (sidecar_checksum2 (sc->entries, (size_t) esize,
+                         sc->names, (size_t) sc->nsize) != hdr->datachk)
+    return 0;
+
+  /* The names and the tree must be usable without more checks */
+  if (sc->names[sc->nsize - 1] != '\0')
+    return 0;
+
+  for (i = 0; i < sc->count; i++)
+    if (sc->entries[i].name >= sc->nsize
+        || (sc->entries[i].parent != FOSFAT_SIDECAR_ROOT
+            && sc->entries[i].parent >= i))
+      return 0;
+
+  sc->info.fosboot = hdr->fosboot;
+  sc->info.foschk  = hdr->foschk;
+  sc->info.viewdel = (int) hdr->viewdel;
+  sc->info.chk0    = hdr->chk0;
+  sc->info.chksys  = hdr->chksys;
+
+  return 1;
+}
+
+/*
+ * Load the sidecar of an image.
+ *
+ * The sidecar is mapped in memory. Only the format and the image's
+ * attributes (size and mtime) are checked here.
+ *
+ * dev          location of the image
+ * return the sidecar or NULL if not available
+ */
+fosfat_sidecar_t *
+fosfat_sidecar_load (const char *dev)
+{
+  int which;
+  struct stat img;
+  fosfat_sidecar_t *sc;
+
+  if (!dev || stat (dev, &img) || !S_ISREG (img.st_mode))
+    return NULL;
+
+  sc = calloc (1, sizeof (fosfat_sidecar_t));
+  if (!sc)
+    return NULL;
+
+  for (which = 0; which < 2; which++)
+  {
+    int fd;
+    struct stat st;
+    void *map;
+    char *path = sidecar_path (dev, which, 0);
+
+    if (!path)
+      continue;
+
+    fd = open (path, O_RDONLY);
+    free (path);
+    if (fd < 0)
+      continue;
+
+    if (fstat (fd, &st) || st.st_size < (off_t) sizeof (sidecar_header_t))
+    {
+      close (fd);
+      continue;
+    }
+
+    map = mmap (NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (map == MAP_FAILED)
+      continue;
+
+    sc->map  = map;
+    sc->size = (size_t) st.st_size;
+
+    if (sidecar_check (sc, &img))
+      return sc;
+
+    munmap (sc->map, sc->size);
+    sc->map = NULL;
+  }
+
+  foslog (FOSLOG_NOTICE, "no valid sidecar index for %s", dev);
+  free (sc);
+  return NULL;
+}
+
+/*
+ * Release a loaded sidecar.
+ *
+ * sc           the sidecar
+ */
+void
+fosfat_sidecar_close (fosfat_sidecar_t *sc)
+{
+  if (!sc)
+    return;
+
+  if (sc->map)
+    munmap (sc->map, sc->size);
+  free (sc);
+}
+
+static int
+sidecar_write (int fd, const void *data, size_t size)
+{
+  const uint8_t *it = data;
+
+  while (size)
+  {
+    ssize_t res = write (fd, it, size);
+    if (res <= 0)
+      return 0;
+
+    it   += res;
+    size -= res;
+  }
+
+  return 1;
+}
+
+/*
+ * Save the sidecar of an image.
+ *
+ * The sidecar is written in a temporary file and then renamed, then an
+ * other process never sees an incomplete sidecar.
+ *
+ * dev          location of the image
+ * info         disk attributes
+ * entries      the entries in pre-order
+ * count        number of entries
+ * names        the string table
+ * nsize        size of the string table
+ * return a boolean (true for success)
+ */
+int
+fosfat_sidecar_save (const char *dev, const fosfat_sidecar_info_t *info,
+                     const fosfat_sidecar_entry_t *entries, uint32_t count,
+                     const char *names, size_t nsize)
+{
+  int which;
+  struct stat img;
+  sidecar_header_t hdr;
+
+  if (!dev || !info || !entries || !count || !names || !nsize)
+    return 0;
+
+  if (stat (dev, &img) || !S_ISREG (img.st_mode))
+    return 0;
+
+  memset (&hdr, 0, sizeof (hdr));
+  memcpy (hdr.magic, SIDECAR_MAGIC, sizeof (hdr.magic));
+  hdr.version  = SIDECAR_VERSION;
+  hdr.endian   = SIDECAR_ENDIAN;
+  hdr.entsize  = sizeof (fosfat_sidecar_entry_t);
+  hdr.count    = count;
+  hdr.names    = nsize;
+  hdr.imgsize  = (uint64_t) img.st_size;
+  hdr.imgmtime = (int64_t) img.st_mtime;
+  hdr.datachk  = sidecar_checksum2 (entries, count * sizeof (*entries),
+                                    names, nsize);
+  hdr.fosboot  = info->fosboot;
+  hdr.foschk   = info->foschk;
+  hdr.viewdel  = (uint32_t) info->viewdel;
+  hdr.chk0     = info->chk0;
+  hdr.chksys   = info->chksys;
+
+  for (which = 0; which < 2; which++)
+  {
+    int fd, res;
+    char *tmp, *path = sidecar_path (dev, which, 1);
+
+    if (!path)
+      continue;
+
+    tmp = malloc (strlen (path) + 8);
+    if (!tmp)
+    {
+      free (path);
+      continue;
+    }
+
+    sprintf (tmp, "%s.XXXXXX", path);
+    fd = mkstemp (tmp);
+    if (fd < 0)
+    {
+      free (tmp);
+      free (path);
+      continue;
+    }
+
+    res = sidecar_write (fd, &hdr, sizeof (hdr))
+          && sidecar_write (fd, entries, count * sizeof (*entries))
+          && sidecar_write (fd, names, nsize);
+
+    if (close (fd))
+      res = 0;
+    if (res && rename (tmp, path))
+      res = 0;
+    if (!res)
+      unlink (tmp);
+    else
+      foslog (FOSLOG_NOTICE, "sidecar index saved to %s", path);
+
+    free (tmp);
+    free (path);
+
+    if (res)
+      return 1;
+  }
+
+  foslog (FOSLOG_WARNING, "sidecar index of %s cannot be saved", dev);
+  return 0;
+}
+
+#else
+
+fosfat_sidecar_t *
+fosfat_sidecar_load (const char *dev)
+{
+  (void) dev;
+  return NULL;
+}
+
+void
+fosfat_sidecar_close (fosfat_sidecar_t *sc)
+{
+  (void) sc;
+}
+
+int
+fosfat_sidecar_save (const char *dev, const fosfat_sidecar_info_t *info,
+                     const fosfat_sidecar_entry_t *entries, uint32_t count,
+                     const char *names, size_t nsize)
+{
+  (void) dev;
+  (void) info;
+  (void) entries;
+  (void) count;
+  (void) names;
+  (void) nsize;
+  return 0;
+}
+
+#endif /* !_WIN32 */
+
+/*
+ * Get the disk attributes of a loaded sidecar.
+ *
+ * sc           the sidecar
+ * return the attributes
+ */
+const fosfat_sidecar_info_t *
+fosfat_sidecar_info (fosfat_sidecar_t *sc)
+{
+  return sc ? &sc->info : NULL;
+}
+
+/*
+ * Get the entries of a loaded sidecar.
+ *
+ * sc           the sidecar
+ * count        where to put the number of entries
+ * return the first entry (in pre-order)
+ */
+const fosfat_sidecar_entry_t *
+fosfat_sidecar_entries (fosfat_sidecar_t *sc, uint32_t *count)
+{
+  *count = sc ? sc->count : 0;
+  return sc ? sc->entries : NULL;
+}
+
+/*
+ * Get the name of an entry.
+ *
+ * sc           the sidecar
+ * entry        the entry
+ * return the name
+ */
+const char *
+fosfat_sidecar_name (fosfat_sidecar_t *sc, const fosfat_sidecar_entry_t *entry)
+{
+  return sc->names + entry->name;
+}
@@ -247,24 +247,31 @@ fosgra_header_open (uint8_t *buffer, fosgra_image_h_t *header)
 static int
 fosgra_get_header (fosfat_t *fosfat, const char *path, fosgra_image_h_t *header)
 {
-  uint8_t *buffer;
-  int res, jump = 0;
-
-  buffer = fosfat_get_buffer (fosfat, path, 0, 1);
-  if (!buffer)
+  uint8_t buffer[FOSGRA_IMAGE_HEADER_LENGTH] = { 0 };
+  int jump = 0;
+  int res = -1;
+  fosfat_fh_t *fh;
+
+  /* The file is resolved only one time for both reads */
+  fh = fosfat_fopen (fosfat, path);
+  if (!fh)
     return -1;
 
+  if (fosfat_fpread (fh, buffer, 1, 0) < 0)
+    goto out;
+
   /* ignore BIN header if available */
   if (strstr (path, ".image\0") && *buffer == FOSGRA_IMAGE_HEADER_BIN)
     jump = FOSGRA_IMAGE_HEADER_LENGTH_BIN;
-  free (buffer);
 
-  buffer = fosfat_get_buffer (fosfat, path, jump, FOSGRA_IMAGE_HEADER_LENGTH);
-  if (!buffer)
-    return -1;
+  memset (buffer, 0, sizeof (buffer));
+  if (fosfat_fpread (fh, buffer, sizeof (buffer), jump) < 0)
+    goto out;
 
   res = fosgra_header_open (buffer, header);
-  free (buffer);
+
+ out:
+  fosfat_fclose (fh);
   return res;
 }
 
@@ -272,10 +279,8 @@ uint32_t
 fosgra_color_get (fosfat_t *fosfat, const char *path, uint8_t idx)
 {
   fosgra_image_h_t header;
-  fosgra_color_map_t *map;
-  uint8_t *buffer;
+  fosgra_color_map_t map;
   int res;
-  uint32_t color;
 
   if (!fosfat || !path || idx >= 16)
     return 0;
@@ -287,20 +292,15 @@ fosgra_color_get (fosfat_t *fosfat, const char *path, uint8_t idx)
   if (header.bip != FOSGRA_COLOR_HEADER_BIT)
     return 0;
 
-  buffer = fosfat_get_buffer (fosfat, path,
-                              FOSGRA_IMAGE_HEADER_LENGTH,
-                              FOSGRA_COLOR_HEADER_LENGTH_MAP);
-  if (!buffer)
+  memset (&map, 0, sizeof (map));
+  if (fosfat_read_into (fosfat, path, FOSGRA_IMAGE_HEADER_LENGTH,
+                        FOSGRA_COLOR_HEADER_LENGTH_MAP, (uint8_t *) &map) < 0)
     return 0;
 
-  map = (fosgra_color_map_t *) buffer;
-  color =   map->map[idx].red[0]   << 0
-          | map->map[idx].green[0] << 8
-          | map->map[idx].blue[0]  << 16
-          | 0xFF                   << 24;
-
-  free (buffer);
-  return color;
+  return   map.map[idx].red[0]   << 0
+         | map.map[idx].green[0] << 8
+         | map.map[idx].blue[0]  << 16
+         | 0xFF                  << 24;
 }
 
 uint8_t *
@@ -37,6 +37,8 @@
 " -h --help             this help\n" \
 " -v --version          version\n" \
 " -f --force            overwrite the destination if exists\n" \
+" -k --keep             copy the image without to convert the disk type\n" \
+" -z --compress         write the destination in a compressed container\n" \
 " -l --fos-logger       that will turn on the FOS logger\n" \
 "\n" \
 "\nPlease, report bugs to <mathieu@schroetersa.ch>.\n"
@@ -57,19 +59,53 @@ print_version (void)
   printf (VERSION_TEXT);
 }
 
+/* Destination: a raw image or a compressed container. */
+typedef struct output_s {
+  FILE             *fp;
+  fosfat_cwriter_t *cw;
+} output_t;
+
+static int
+output_write (output_t *out, const void *data, size_t size)
+{
+  if (out->cw)
+    return fosfat_container_write (out->cw, data, size);
+
+  return fwrite (data, 1, size, out->fp) == size;
+}
+
+static int
+output_close (output_t *out)
+{
+  if (out->cw)
+    return fosfat_container_close (out->cw);
+
+  return !fclose (out->fp);
+}
+
 /* Add blocks at the beginning according to the disk type. */
 static int
-dd (fosfat_t *fosfat, fosfat_disk_t type, const char *output_file)
+dd (fosfat_t *fosfat, fosfat_disk_t type, const char *output_file,
+    int keep, int compress)
 {
-  FILE *f_out = NULL;
-  f_out = fopen (output_file, "wb");
-  if (!f_out)
+  output_t out = { NULL, NULL };
+  int res = 1;
+
+  if (compress)
+    out.cw = fosfat_container_create (output_file, 0);
+  else
+    out.fp = fopen (output_file, "wb");
+  if (!out.fp && !out.cw)
     return -1;
 
   size_t offset = 0x10;
 
+  /* Copy from the first block of the image */
+  if (keep)
+    offset = type == FOSFAT_FD ? 0x10 : 0x20;
+
   /* The source is a floppy and the destination a disk */
-  if (type == FOSFAT_FD)
+  if (type == FOSFAT_FD && !keep)
   {
     /* Add padding of 0x10 (offset) */
     static const char zero[FOSFAT_BLK] = {0};
@@ -115,7 +151,7 @@ dd (fosfat_t *fosfat, fosfat_disk_t type, const char *output_file)
       size_t to_write = (offset * FOSFAT_BLK) - read;
       if (to_write > FOSFAT_BLK)
         to_write = FOSFAT_BLK;
-      fwrite (read == 0x400 ? boot : zero, 1, to_write, f_out);
+      res &= output_write (&out, read == 0x400 ? boot : zero, to_write);
       read += to_write;
     }
   }
@@ -126,28 +162,30 @@ dd (fosfat_t *fosfat, fosfat_disk_t type, const char *output_file)
     if (!read_buffer)
       break;
 
-    fwrite (read_buffer->data, 1, FOSFAT_BLK, f_out);
+    res &= output_write (&out, read_buffer->data, FOSFAT_BLK);
     free (read_buffer);
   }
 
-  fclose (f_out);
-  return 0;
+  res &= output_close (&out);
+  return res ? 0 : -1;
 }
 
 int
 main (int argc, char **argv)
 {
   fosfat_t *fosfat;
-  int res = 0, force = 0, next_option;
+  int res = 0, force = 0, keep = 0, compress = 0, next_option;
   fosfat_disk_t type = FOSFAT_AD;
   const char *input_file;
   const char *output_file;
 
-  const char *const short_options = "hflv";
+  const char *const short_options = "hfklvz";
 
   const struct option long_options[] = {
     { "help",       no_argument, NULL, 'h' },
     { "force",      no_argument, NULL, 'f' },
+    { "keep",       no_argument, NULL, 'k' },
+    { "compress",   no_argument, NULL, 'z' },
     { "fos-logger", no_argument, NULL, 'l' },
     { "version",    no_argument, NULL, 'v' },
     { NULL,         0,           NULL,  0  }
@@ -170,6 +208,12 @@ main (int argc, char **argv)
     case 'f':
       force = 1;
       break;
+    case 'k':           /* -k or --keep */
+      keep = 1;
+      break;
+    case 'z':           /* -z or --compress */
+      compress = 1;
+      break;
     case 'l':           /* -l or --fos-logger */
       fosfat_logger (1);
       break;
@@ -194,7 +238,8 @@ main (int argc, char **argv)
     return -1;
   }
 
-  fosfat = fosfat_open (input_file, FOSFAT_AD, 0);
+  /* The files are not used, then only the root is loaded */
+  fosfat = fosfat_open (input_file, FOSFAT_AD, F_LAZY);
   if (!fosfat)
   {
     fprintf (stderr, "Could not open %s!\n", input_file);
@@ -205,15 +250,18 @@ main (int argc, char **argv)
   switch (type)
   {
   case FOSFAT_FD:
-    printf ("Convert floppy \"%s\" into disk image at \"%s\"\n",
-            input_file, output_file);
-    res = dd (fosfat, type, output_file);
-    break;
-
   case FOSFAT_HD:
-    printf ("Convert disk \"%s\" into floppy image at \"%s\"\n",
-            input_file, output_file);
-    res = dd (fosfat, type, output_file);
+    if (keep)
+      printf ("Copy %s \"%s\" into %simage at \"%s\"\n",
+              type == FOSFAT_FD ? "floppy" : "disk", input_file,
+              compress ? "compressed " : "", output_file);
+    else if (type == FOSFAT_FD)
+      printf ("Convert floppy \"%s\" into %sdisk image at \"%s\"\n",
+              input_file, compress ? "compressed " : "", output_file);
+    else
+      printf ("Convert disk \"%s\" into %sfloppy image at \"%s\"\n",
+              input_file, compress ? "compressed " : "", output_file);
+    res = dd (fosfat, type, output_file, keep, compress);
     break;
 
   default:
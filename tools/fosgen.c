@@ -0,0 +1,219 @@
+/*
+ * FOS fosgen: generator of synthetic Smaky disk images
+ * Copyright (C) 2025 Mathieu Schroeter <mathieu@schroetersa.ch>
+ *
+ * This file is part of Fosfat.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include "fosfat.h"
+#include "fosfat_internal.h"
+
+#define HELP_TEXT \
+"Tool to generate synthetic FOS disk images. fosfat-" LIBFOSFAT_VERSION_STR "\n\n" \
+"Usage: fosgen [options] destination\n\n" \
+" -h --help             this help\n" \
+" -v --version          version\n" \
+" -f --force            overwrite the destination if exists\n" \
+" -l --fos-logger       that will turn on the FOS logger\n" \
+" -a --harddisk         generate a hard disk (floppy by default)\n" \
+" -n --name=NAME        disk name [FOSGEN]\n" \
+" -s --seed=N           seed for the content [1]\n" \
+" -d --depth=N          depth of the tree [2]\n" \
+" -w --dirs=N           sub-directories by directory [2]\n" \
+" -c --files=N          files by directory [16]\n" \
+" -e --deleted=N        deleted files by directory [1]\n" \
+" -k --links=N          soft-links by directory [1]\n" \
+" -i --images=N         .image and .color files by directory [2]\n" \
+" -m --min-size=N       min size of a file in bytes [0]\n" \
+" -M --max-size=N       max size of a file in bytes [65536]\n" \
+" -g --fragment=N       max blocks by tranche, 0 for contiguous [0]\n" \
+" -b --tranches=N       max tranches by BD, 1 to 42 [42]\n" \
+"\n" \
+"\nPlease, report bugs to <mathieu@schroetersa.ch>.\n"
+
+#define VERSION_TEXT "fosgen-" LIBFOSFAT_VERSION_STR "\n"
+
+/* Print help. */
+static void
+print_info (void)
+{
+  printf (HELP_TEXT);
+}
+
+/* Print version. */
+static void
+print_version (void)
+{
+  printf (VERSION_TEXT);
+}
+
+/* Check the generated image with the library. */
+static int
+verify (const char *file)
+{
+  fosfat_t *fosfat;
+
+  fosfat = fosfat_open (file, FOSFAT_AD, 0);
+  if (!fosfat)
+    return -1;
+
+  fosfat_close (fosfat);
+  return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  int force = 0, next_option;
+  fosfat_gen_t gen;
+  fosfat_gen_info_t info;
+  const char *output_file;
+
+  const char *const short_options = "ab:c:d:e:fg:hi:k:lm:M:n:s:vw:";
+
+  const struct option long_options[] = {
+    { "help",       no_argument,       NULL, 'h' },
+    { "version",    no_argument,       NULL, 'v' },
+    { "force",      no_argument,       NULL, 'f' },
+    { "fos-logger", no_argument,       NULL, 'l' },
+    { "harddisk",   no_argument,       NULL, 'a' },
+    { "name",       required_argument, NULL, 'n' },
+    { "seed",       required_argument, NULL, 's' },
+    { "depth",      required_argument, NULL, 'd' },
+    { "dirs",       required_argument, NULL, 'w' },
+    { "files",      required_argument, NULL, 'c' },
+    { "deleted",    required_argument, NULL, 'e' },
+    { "links",      required_argument, NULL, 'k' },
+    { "images",     required_argument, NULL, 'i' },
+    { "min-size",   required_argument, NULL, 'm' },
+    { "max-size",   required_argument, NULL, 'M' },
+    { "fragment",   required_argument, NULL, 'g' },
+    { "tranches",   required_argument, NULL, 'b' },
+    { NULL,         0,                 NULL,  0  }
+  };
+
+  fosfat_gen_defaults (&gen);
+
+  /* check options */
+  do
+  {
+    next_option = getopt_long (argc, argv, short_options, long_options, NULL);
+    switch (next_option)
+    {
+    default :           /* unknown */
+    case '?':           /* invalid option */
+    case 'h':           /* -h or --help */
+      print_info ();
+      return -1;
+    case 'v':           /* -v or --version */
+      print_version ();
+      return -1;
+    case 'f':           /* -f or --force */
+      force = 1;
+      break;
+    case 'l':           /* -l or --fos-logger */
+      fosfat_logger (1);
+      break;
+    case 'a':           /* -a or --harddisk */
+      gen.disk = FOSFAT_HD;
+      break;
+    case 'n':           /* -n or --name */
+      gen.name = optarg;
+      break;
+    case 's':           /* -s or --seed */
+      gen.seed = (uint32_t) strtoul (optarg, NULL, 0);
+      break;
+    case 'd':           /* -d or --depth */
+      gen.depth = (unsigned int) strtoul (optarg, NULL, 0);
+      break;
+    case 'w':           /* -w or --dirs */
+      gen.dirs = (unsigned int) strtoul (optarg, NULL, 0);
+      break;
+    case 'c':           /* -c or --files */
+      gen.files = (unsigned int) strtoul (optarg, NULL, 0);
+      break;
+    case 'e':           /* -e or --deleted */
+      gen.deleted = (unsigned int) strtoul (optarg, NULL, 0);
+      break;
+    case 'k':           /* -k or --links */
+      gen.links = (unsigned int) strtoul (optarg, NULL, 0);
+      break;
+    case 'i':           /* -i or --images */
+      gen.images = (unsigned int) strtoul (optarg, NULL, 0);
+      break;
+    case 'm':           /* -m or --min-size */
+      gen.size_min = (uint32_t) strtoul (optarg, NULL, 0);
+      break;
+    case 'M':           /* -M or --max-size */
+      gen.size_max = (uint32_t) strtoul (optarg, NULL, 0);
+      break;
+    case 'g':           /* -g or --fragment */
+      gen.fragment = (unsigned int) strtoul (optarg, NULL, 0);
+      break;
+    case 'b':           /* -b or --tranches */
+      gen.tranches = (unsigned int) strtoul (optarg, NULL, 0);
+      break;
+    case -1:            /* end */
+      break;
+    }
+  } while (next_option != -1);
+
+  if (argc < optind + 1)
+  {
+    print_info ();
+    return -1;
+  }
+
+  output_file = argv[optind];
+
+  if (!force && !access (output_file, F_OK))
+  {
+    fprintf (stderr,
+             "The output file \"%s\" already exists, use --force to overwrite\n",
+             output_file);
+    return -1;
+  }
+
+  printf ("Generate %s image at \"%s\"\n",
+          gen.disk == FOSFAT_HD ? "disk" : "floppy", output_file);
+
+  if (!fosfat_gen_image (output_file, &gen, &info))
+  {
+    fprintf (stderr, "Unexpected error when generating the image!\n");
+    return -1;
+  }
+
+  printf ("%lu directories, %lu files, %lu deleted, %lu links, %lu images\n",
+          info.dirs, info.files, info.deleted, info.links, info.images);
+  printf ("%lu tranches, %lu BD, %lu BL, %lu DATA, %lu blocks (%.1f MiB)\n",
+          info.tranches, info.bds, info.blocks_list, info.blocks_data,
+          info.blocks, info.blocks * 256.0 / 1024 / 1024);
+
+  if (verify (output_file))
+  {
+    fprintf (stderr, "The generated image cannot be opened!\n");
+    return -2;
+  }
+
+  return 0;
+}
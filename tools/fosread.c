@@ -61,7 +61,8 @@ typedef struct ginfo {
 " -u --undelete         enable the undelete mode, even deleted files will\n" \
 "                       be listed and sometimes restorable with 'get' mode.\n" \
 " -i --image-bmp        convert .IMAGE and .COLOR to .BMP\n" \
-" -t --text             convert some text files to .TXT\n\n" \
+" -t --text             convert some text files to .TXT\n" \
+" -x --direct           bypass the page cache (O_DIRECT) with a device\n\n" \
 " device                " HELP_DEVICE \
 " mode\n" \
 "   list                list the content of a node\n" \
@@ -178,29 +179,27 @@ static int
 list_dir (fosfat_t *fosfat, const char *loc)
 {
   char *path;
-  fosfat_file_t *files, *first_file;
+  fosfat_dir_t *dir;
+  fosfat_file_t file;
 
   if (strcmp (loc, "/") && fosfat_islink (fosfat, loc))
     path = fosfat_symlink (fosfat, loc);
   else
     path = strdup (loc);
 
-  if ((files = fosfat_list_dir (fosfat, path)))
+  if ((dir = fosfat_opendir (fosfat, path)))
   {
-    first_file = files;
     printf ("path: %s\n\n", path);
     printf ("        size creation         last change");
     printf ("      last view        filename\n");
     printf ("        ---- --------         -----------");
     printf ("      ---------        --------\n");
 
-    do
-    {
-      print_file (files);
-    } while ((files = files->next_file));
+    while (fosfat_readdir (dir, &file))
+      print_file (&file);
 
     printf ("\nd:directory  l:link  h:hidden  e:encoded    (X):undelete\n");
-    fosfat_free_listdir (first_file);
+    fosfat_closedir (dir);
   }
   else
   {
@@ -227,6 +226,7 @@ get_file (fosfat_t *fosfat, const char *path, const char *dst)
 {
   int res = 0;
   char *new_file, *name = NULL;
+  fosfat_info_t info;
   fosfat_ftype_t ftype = FOSFAT_FTYPE_OTHER;
 
   if (!strcasecmp (dst, "./"))
@@ -234,7 +234,10 @@ get_file (fosfat_t *fosfat, const char *path, const char *dst)
   else
     new_file = strdup (dst);
 
-  if (!fosfat_islink (fosfat, path) && !fosfat_isdir (fosfat, path))
+  /* The attributes are cleared if the path is not found */
+  fosfat_lookup (fosfat, path, &info);
+
+  if (!info.att.islink && !info.att.isdir)
   {
     FILE *fp = NULL;
     uint8_t *buffer = NULL;
@@ -277,11 +280,15 @@ get_file (fosfat_t *fosfat, const char *path, const char *dst)
 
     if (g_txt && ftype == FOSFAT_FTYPE_TEXT)
     {
-      fosfat_file_t *file = fosfat_get_stat (fosfat, path);
-      size = file->size;
-      free (file);
-      buffer = fosfat_get_buffer (fosfat, path, 0, size);
-      fosfat_sma2iso8859 ((char *) buffer, size, FOSFAT_ASCII_LF);
+      size = info.size;
+      buffer = calloc (1, size);
+      if (buffer && fosfat_read_into (fosfat, path, 0, size, buffer) >= 0)
+        fosfat_sma2iso8859 ((char *) buffer, size, FOSFAT_ASCII_LF);
+      else if (buffer)
+      {
+        free (buffer);
+        buffer = NULL;
+      }
     }
 
     if (fp && buffer)
@@ -320,33 +327,33 @@ static int
 get_dir (fosfat_t *fosfat, const char *loc, const char *dst)
 {
   char *path;
-  fosfat_file_t *file, *first_file;
+  fosfat_dir_t *dir;
+  fosfat_file_t file;
 
   if (strcmp (loc, "/") && fosfat_islink (fosfat, loc))
     path = fosfat_symlink (fosfat, loc);
   else
     path = strdup (loc);
 
-  if ((file = fosfat_list_dir (fosfat, path)))
+  if ((dir = fosfat_opendir (fosfat, path)))
   {
     char out[4096] = {0};
     char in[256]  = {0};
-    first_file = file;
 
-    do
+    while (fosfat_readdir (dir, &file))
     {
-      if (file->att.islink)
+      if (file.att.islink)
         continue;
 
-      if (file->name[0] == '.')
+      if (file.name[0] == '.')
         continue;
 
-      snprintf (in , sizeof (in),  "%s/%s", loc, file->name);
-      snprintf (out, sizeof (out), "%s/%s", dst, file->name);
+      snprintf (in , sizeof (in),  "%s/%s", loc, file.name);
+      snprintf (out, sizeof (out), "%s/%s", dst, file.name);
       remove_dup_slashes (in);
       remove_dup_slashes (out);
 
-      if (file->att.isdir)
+      if (file.att.isdir)
       {
         char *it = strrchr (out, '.');
         if (it)
@@ -356,14 +363,14 @@ get_dir (fosfat_t *fosfat, const char *loc, const char *dst)
       }
       else
       {
-        if (file->size > 0)
+        if (file.size > 0)
           get_file (fosfat, in, out);
         else
           fprintf (stderr, "WARNING: skip empty file (0 bytes)\n");
       }
-    } while ((file = file->next_file));
+    }
 
-    fosfat_free_listdir (first_file);
+    fosfat_closedir (dir);
   }
   else
   {
@@ -395,13 +402,13 @@ int
 main (int argc, char **argv)
 {
   int res = 0, i, next_option, undelete = 0;
-  int flags = 0;
+  int flags = F_LAZY; /* only the directories in the path are loaded */
   fosfat_disk_t type = FOSFAT_AD;
   char *device = NULL, *mode = NULL, *node = NULL, *path = NULL;
   fosfat_t *fosfat;
   global_info_t *ginfo = NULL;
 
-  const char *const short_options = "afhluitv";
+  const char *const short_options = "afhluitvx";
 
   const struct option long_options[] = {
     { "harddisk",     no_argument, NULL, 'a' },
@@ -412,6 +419,7 @@ main (int argc, char **argv)
     { "image-bmp",    no_argument, NULL, 'i' },
     { "text",         no_argument, NULL, 't' },
     { "version",      no_argument, NULL, 'v' },
+    { "direct",       no_argument, NULL, 'x' },
     { NULL,           0,           NULL,  0  }
   };
 
@@ -447,6 +455,9 @@ main (int argc, char **argv)
     case 't':           /* -t or --text */
       g_txt = 1;
       break;
+    case 'x':           /* -x or --direct */
+      flags |= F_DIRECT;
+      break;
     case -1:            /* end */
       break ;
     }
@@ -471,7 +482,7 @@ main (int argc, char **argv)
   }
 
   if (undelete)
-    flags = F_UNDELETE;
+    flags |= F_UNDELETE;
 
   /* Open the floppy disk (or hard disk) */
   if (!(fosfat = fosfat_open (device, type, flags)))